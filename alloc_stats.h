@@ -0,0 +1,109 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/* Process-wide C++ heap counters.
+ *
+ * The counting operator new/delete are only compiled into the translation
+ * unit that defines ALLOC_STATS_DEFINE_OPERATORS before including this
+ * header (the executable's main file); it also sets `counting`, so a
+ * library linked into a program without them can tell its zeros apart
+ * from a real zero. Allocations made by FFmpeg itself
+ * (av_malloc) are not seen here; our frame buffers are counted by
+ * FrameBufferPool instead.
+ */
+struct AllocCounters {
+   std::atomic<uint64_t> allocs;
+   std::atomic<uint64_t> frees;
+   std::atomic<uint64_t> live_bytes;
+   std::atomic<uint64_t> peak_bytes;
+   std::atomic<bool> counting; // the counting operators are linked in
+};
+
+inline AllocCounters& allocCounters() {
+   static AllocCounters counters; // zero-initialized before any allocation
+   return counters;
+}
+
+struct AllocSnapshot {
+   uint64_t allocs;
+   uint64_t frees;
+   uint64_t live_bytes;
+   uint64_t peak_bytes;
+   bool counting;
+};
+
+inline AllocSnapshot allocSnapshot() {
+   const AllocCounters& c = allocCounters();
+   AllocSnapshot s = {c.allocs.load(std::memory_order_relaxed), c.frees.load(std::memory_order_relaxed),
+      c.live_bytes.load(std::memory_order_relaxed), c.peak_bytes.load(std::memory_order_relaxed),
+      c.counting.load(std::memory_order_relaxed)};
+   return s;
+}
+
+#ifdef ALLOC_STATS_DEFINE_OPERATORS
+
+namespace alloc_stats {
+
+// size header in front of every block; 16 bytes keeps malloc's alignment
+static const size_t HEADER = 16;
+
+inline void* allocate(size_t size) {
+   char* raw = static_cast<char*>(malloc(size + HEADER));
+   if (!raw)
+      return nullptr;
+   *reinterpret_cast<size_t*>(raw) = size;
+   AllocCounters& c = allocCounters();
+   c.allocs.fetch_add(1, std::memory_order_relaxed);
+   uint64_t live = c.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+   uint64_t peak = c.peak_bytes.load(std::memory_order_relaxed);
+   while (live > peak && !c.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+   }
+   return raw + HEADER;
+}
+
+inline void release(void* p) {
+   if (!p)
+      return;
+   char* raw = static_cast<char*>(p) - HEADER;
+   AllocCounters& c = allocCounters();
+   c.frees.fetch_add(1, std::memory_order_relaxed);
+   c.live_bytes.fetch_sub(*reinterpret_cast<size_t*>(raw), std::memory_order_relaxed);
+   free(raw);
+}
+
+struct MarkCounting {
+   MarkCounting() { allocCounters().counting.store(true, std::memory_order_relaxed); }
+};
+static MarkCounting mark_counting; // static init, before main() reads any counter
+
+} // namespace alloc_stats
+
+void* operator new(size_t size) {
+   void* p = alloc_stats::allocate(size);
+   if (!p)
+      throw std::bad_alloc();
+   return p;
+}
+
+void* operator new[](size_t size) {
+   void* p = alloc_stats::allocate(size);
+   if (!p)
+      throw std::bad_alloc();
+   return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return alloc_stats::allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return alloc_stats::allocate(size); }
+void operator delete(void* p) noexcept { alloc_stats::release(p); }
+void operator delete[](void* p) noexcept { alloc_stats::release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { alloc_stats::release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { alloc_stats::release(p); }
+
+#endif // ALLOC_STATS_DEFINE_OPERATORS
+
+#endif // ALLOC_STATS_H
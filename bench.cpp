@@ -0,0 +1,648 @@
+/* ffmpeg_seeker_bench: performance regression suite.
+ *
+ * Encodes synthetic clips with whatever encoder the local libavcodec has,
+ * writes a clean and a damaged copy of each, and measures the pieces the
+ * seeker spends its time in: SW decode, frame hashing, the corruption
+ * detector kernels, seek latency and memory. Results are written as JSON,
+ * to stdout without --out; progress and the --baseline comparison go to
+ * stderr, so stdout stays machine-readable.
+ *
+ *   ffmpeg_seeker_bench [--out results.json] [--baseline old.json] [--tolerance 10]
+ *                       [--frames 250] [--seeks 20] [--full] [--workdir DIR] [--keep]
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
+}
+
+#include "frame_hasher.h"
+#include "corruption_detector.h"
+#include "frame_pool.h"
+#define ALLOC_STATS_DEFINE_OPERATORS
+#include "alloc_stats.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+   return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct ClipSpec {
+   int width;
+   int height;
+   int gop;
+   int b_frames;
+
+   std::string name() const {
+      char buf[64];
+      snprintf(buf, sizeof(buf), "%dx%d_gop%d_b%d", width, height, gop, b_frames);
+      return buf;
+   }
+};
+
+// Flat metric map; the key suffix says which direction is better (see compareWithBaseline).
+typedef std::map<std::string, double> Metrics;
+
+/* ---------- synthetic clip generation ---------- */
+
+// Moving diagonal gradient with a drifting block and some per-frame noise,
+// so the encoder has real motion and texture to code.
+static void fillSyntheticFrame(AVFrame* frame, int index, uint32_t& rng) {
+   for (int y = 0; y < frame->height; y++) {
+      uint8_t* row = frame->data[0] + static_cast<ptrdiff_t>(y) * frame->linesize[0];
+      for (int x = 0; x < frame->width; x++) {
+         rng = rng * 1664525u + 1013904223u;
+         row[x] = static_cast<uint8_t>((x + y + index * 3) & 0xff) ^ ((rng >> 28) & 0x7);
+      }
+   }
+   const int bx = (index * 7) % std::max(1, frame->width / 2 - 64);
+   const int by = (index * 5) % std::max(1, frame->height / 2 - 64);
+   for (int p = 1; p < 3; p++) {
+      for (int y = 0; y < frame->height / 2; y++) {
+         uint8_t* row = frame->data[p] + static_cast<ptrdiff_t>(y) * frame->linesize[p];
+         for (int x = 0; x < frame->width / 2; x++) {
+            bool in_block = x >= bx && x < bx + 64 && y >= by && y < by + 64;
+            row[x] = in_block ? (p == 1 ? 40 : 220) : static_cast<uint8_t>(128 + ((x * p + index) & 31) - 16);
+         }
+      }
+   }
+}
+
+// Overwrites a run of bytes in the middle of the payload (deterministic).
+static void damagePacket(AVPacket* pkt, uint32_t& rng) {
+   if (av_packet_make_writable(pkt) < 0 || pkt->size < 64)
+      return;
+   int len = std::min(32, pkt->size / 4);
+   int offset = pkt->size / 2;
+   for (int i = 0; i < len; i++) {
+      rng = rng * 1664525u + 1013904223u;
+      pkt->data[offset + i] = static_cast<uint8_t>(rng >> 24);
+   }
+}
+
+static const AVCodec* pickEncoder() {
+   const char* preferred[] = {"libx264", "libopenh264", "mpeg4", "mpeg2video"};
+   for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+      const AVCodec* codec = avcodec_find_encoder_by_name(preferred[i]);
+      if (codec)
+         return codec;
+   }
+   return avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+}
+
+static AVFormatContext* openMuxer(const std::string& path, const AVCodecContext* enc) {
+   AVFormatContext* mux = nullptr;
+   if (avformat_alloc_output_context2(&mux, nullptr, "matroska", path.c_str()) < 0)
+      return nullptr;
+   AVStream* st = avformat_new_stream(mux, nullptr);
+   if (!st || avcodec_parameters_from_context(st->codecpar, enc) < 0 ||
+         avio_open(&mux->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+      avformat_free_context(mux);
+      return nullptr;
+   }
+   st->time_base = enc->time_base;
+   if (avformat_write_header(mux, nullptr) < 0) {
+      avio_closep(&mux->pb);
+      avformat_free_context(mux);
+      return nullptr;
+   }
+   return mux;
+}
+
+static void closeMuxer(AVFormatContext* mux) {
+   if (!mux)
+      return;
+   av_write_trailer(mux);
+   avio_closep(&mux->pb);
+   avformat_free_context(mux);
+}
+
+/* Encodes `frames` frames into <dir>/<name>.mkv and a copy with every 40th
+ * packet damaged into <dir>/<name>_damaged.mkv. Returns false if the
+ * encoder cannot be set up for this spec.
+ */
+static bool generateClip(const ClipSpec& spec, const AVCodec* codec, int frames, const std::string& dir,
+      std::string& clean_path, std::string& damaged_path, int& damaged_packets) {
+   AVCodecContext* enc = avcodec_alloc_context3(codec);
+   if (!enc)
+      return false;
+   enc->width = spec.width;
+   enc->height = spec.height;
+   enc->pix_fmt = AV_PIX_FMT_YUV420P;
+   enc->time_base = AVRational{1, 25};
+   enc->framerate = AVRational{25, 1};
+   enc->gop_size = spec.gop;
+   enc->max_b_frames = spec.b_frames;
+   enc->bit_rate = static_cast<int64_t>(spec.width) * spec.height * 3; // ~3 bits per pixel per second
+   enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER; // matroska wants extradata
+   if (codec->pix_fmts && codec->pix_fmts[0] != AV_PIX_FMT_NONE) {
+      bool has_420 = false;
+      for (const AVPixelFormat* f = codec->pix_fmts; *f != AV_PIX_FMT_NONE; f++)
+         has_420 |= *f == AV_PIX_FMT_YUV420P;
+      if (!has_420) {
+         avcodec_free_context(&enc);
+         return false;
+      }
+   }
+   if (!strcmp(codec->name, "libx264"))
+      av_opt_set(enc->priv_data, "preset", "ultrafast", 0);
+   if (avcodec_open2(enc, codec, nullptr) < 0) {
+      avcodec_free_context(&enc);
+      return false;
+   }
+
+   clean_path = dir + "/" + spec.name() + ".mkv";
+   damaged_path = dir + "/" + spec.name() + "_damaged.mkv";
+   AVFormatContext* clean = openMuxer(clean_path, enc);
+   AVFormatContext* damaged = openMuxer(damaged_path, enc);
+   if (!clean || !damaged) {
+      closeMuxer(clean);
+      closeMuxer(damaged);
+      avcodec_free_context(&enc);
+      return false;
+   }
+
+   AVFrame* frame = av_frame_alloc();
+   frame->format = enc->pix_fmt;
+   frame->width = enc->width;
+   frame->height = enc->height;
+   av_frame_get_buffer(frame, 0);
+   AVPacket* pkt = av_packet_alloc();
+   AVPacket* copy = av_packet_alloc();
+   uint32_t pixel_rng = 1, damage_rng = 12345;
+   int packet_index = 0;
+   damaged_packets = 0;
+
+   for (int i = 0; i <= frames; i++) {
+      AVFrame* input = nullptr;
+      if (i < frames) {
+         av_frame_make_writable(frame);
+         fillSyntheticFrame(frame, i, pixel_rng);
+         frame->pts = i;
+         input = frame;
+      }
+      if (avcodec_send_frame(enc, input) < 0)
+         break;
+      while (avcodec_receive_packet(enc, pkt) == 0) {
+         av_packet_rescale_ts(pkt, enc->time_base, clean->streams[0]->time_base);
+         pkt->stream_index = 0;
+         av_packet_ref(copy, pkt);
+         av_interleaved_write_frame(clean, pkt); // takes the reference
+         // spare the first GOP so every clip starts decodable
+         if (packet_index >= spec.gop && packet_index % 40 == 17) {
+            damagePacket(copy, damage_rng);
+            damaged_packets++;
+         }
+         av_packet_rescale_ts(copy, clean->streams[0]->time_base, damaged->streams[0]->time_base);
+         av_interleaved_write_frame(damaged, copy);
+         packet_index++;
+      }
+   }
+
+   closeMuxer(clean);
+   closeMuxer(damaged);
+   av_packet_free(&copy);
+   av_packet_free(&pkt);
+   av_frame_free(&frame);
+   avcodec_free_context(&enc);
+   return true;
+}
+
+/* ---------- decoding ---------- */
+
+struct Decoder {
+   AVFormatContext* fmt = nullptr;
+   AVCodecContext* dec = nullptr;
+   int stream = -1;
+
+   bool open(const std::string& path, FrameBufferPool* pool) {
+      if (avformat_open_input(&fmt, path.c_str(), nullptr, nullptr) < 0 ||
+            avformat_find_stream_info(fmt, nullptr) < 0)
+         return false;
+      stream = av_find_best_stream(fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+      if (stream < 0)
+         return false;
+      const AVCodec* codec = avcodec_find_decoder(fmt->streams[stream]->codecpar->codec_id);
+      if (!codec || !(dec = avcodec_alloc_context3(codec)))
+         return false;
+      avcodec_parameters_to_context(dec, fmt->streams[stream]->codecpar);
+      // same error settings as the seeker's SW path
+      dec->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT;
+      dec->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
+      dec->err_recognition = AV_EF_CAREFUL | AV_EF_CRCCHECK | AV_EF_BITSTREAM | AV_EF_BUFFER;
+      if (pool)
+         pool->install(dec);
+      return avcodec_open2(dec, codec, nullptr) >= 0;
+   }
+
+   ~Decoder() {
+      if (dec)
+         avcodec_free_context(&dec);
+      if (fmt)
+         avformat_close_input(&fmt);
+   }
+};
+
+struct DecodeResult {
+   int frames = 0;
+   int corrupt_frames = 0;
+   double seconds = 0;
+};
+
+// Decodes the whole file; keeps references to up to `keep_max` frames for the hash/detector runs.
+static bool decodeAll(const std::string& path, FrameBufferPool* pool, DecodeResult& result,
+      std::vector<AVFrame*>* keep, size_t keep_max) {
+   Decoder d;
+   if (!d.open(path, pool))
+      return false;
+   AVPacket* pkt = av_packet_alloc();
+   AVFrame* frame = av_frame_alloc();
+   Clock::time_point start = Clock::now();
+   bool eof = false;
+   while (!eof) {
+      int ret = av_read_frame(d.fmt, pkt);
+      if (ret < 0)
+         eof = true;
+      else if (pkt->stream_index != d.stream) {
+         av_packet_unref(pkt);
+         continue;
+      }
+      if (avcodec_send_packet(d.dec, eof ? nullptr : pkt) >= 0 || eof) {
+         while (avcodec_receive_frame(d.dec, frame) == 0) {
+            result.frames++;
+            if ((frame->flags & AV_FRAME_FLAG_CORRUPT) || frame->decode_error_flags)
+               result.corrupt_frames++;
+            if (keep && keep->size() < keep_max && result.frames % 7 == 0)
+               keep->push_back(av_frame_clone(frame));
+            av_frame_unref(frame);
+         }
+      }
+      av_packet_unref(pkt);
+   }
+   result.seconds = secondsSince(start);
+   av_frame_free(&frame);
+   av_packet_free(&pkt);
+   return result.frames > 0;
+}
+
+static size_t visibleBytes(const AVFrame* frame) {
+   PlaneSpan planes[4];
+   int n = framePlanes(frame, planes);
+   size_t bytes = 0;
+   for (int i = 0; i < n; i++)
+      bytes += static_cast<size_t>(planes[i].row_bytes) * planes[i].rows;
+   return bytes;
+}
+
+/* ---------- measurements ---------- */
+
+static void benchHashes(const std::string& prefix, const std::vector<AVFrame*>& frames, Metrics& m) {
+   const HashAlgo algos[] = {HASH_MD5, HASH_CRC32, HASH_XXH64};
+   size_t bytes_per_pass = 0;
+   for (size_t i = 0; i < frames.size(); i++)
+      bytes_per_pass += visibleBytes(frames[i]);
+
+   for (size_t a = 0; a < sizeof(algos) / sizeof(algos[0]); a++) {
+      FrameHasher hasher(algos[a]);
+      int hashed = 0;
+      Clock::time_point start = Clock::now();
+      double elapsed = 0;
+      do {
+         for (size_t i = 0; i < frames.size(); i++)
+            hasher.hash(frames[i]);
+         hashed += frames.size();
+         elapsed = secondsSince(start);
+      } while (elapsed < 0.5);
+      std::string name = hashAlgoName(algos[a]);
+      for (size_t i = 0; i < name.size(); i++)
+         name[i] = tolower(name[i]);
+      m[prefix + ".hash_" + name + "_fps"] = hashed / elapsed;
+      m[prefix + ".hash_" + name + "_mbps"] = bytes_per_pass * (hashed / frames.size()) / elapsed / 1e6;
+   }
+}
+
+static void benchDetector(const std::string& prefix, const std::vector<AVFrame*>& frames, Metrics& m) {
+   const char* kernels[] = {"scalar", "sse2", "avx2", "neon"};
+   for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+      if (!selectFlatRowKernel(kernels[k]))
+         continue; // not on this CPU
+      CorruptionDetector detector(8, kernels[k]);
+      int analyzed = 0;
+      Clock::time_point start = Clock::now();
+      double elapsed = 0;
+      do {
+         for (size_t i = 0; i < frames.size(); i++)
+            detector.analyze(frames[i]);
+         analyzed += frames.size();
+         elapsed = secondsSince(start);
+      } while (elapsed < 0.5);
+      m[prefix + ".detect_" + kernels[k] + "_fps"] = analyzed / elapsed;
+   }
+}
+
+static double percentile(std::vector<double> values, double p) {
+   if (values.empty())
+      return 0;
+   std::sort(values.begin(), values.end());
+   size_t i = static_cast<size_t>(p / 100.0 * (values.size() - 1) + 0.5);
+   return values[std::min(i, values.size() - 1)];
+}
+
+/* Random seeks: container seek to the keyframe before the target, then
+ * decode until the first frame (keyframe latency) and until the target
+ * PTS (exact-seek latency).
+ */
+static void benchSeeks(const std::string& prefix, const std::string& path, int seeks, Metrics& m) {
+   Decoder d;
+   if (!d.open(path, nullptr))
+      return;
+   const AVStream* st = d.fmt->streams[d.stream];
+   int64_t duration = st->duration != AV_NOPTS_VALUE ? st->duration
+      : av_rescale_q(d.fmt->duration, AV_TIME_BASE_Q, st->time_base);
+   if (duration <= 0)
+      return;
+
+   AVPacket* pkt = av_packet_alloc();
+   AVFrame* frame = av_frame_alloc();
+   std::vector<double> first_ms, exact_ms;
+   uint32_t rng = 777;
+   for (int s = 0; s < seeks; s++) {
+      rng = rng * 1664525u + 1013904223u;
+      int64_t target = static_cast<int64_t>((rng >> 8) / static_cast<double>(1 << 24) * duration * 0.9);
+
+      Clock::time_point start = Clock::now();
+      if (av_seek_frame(d.fmt, d.stream, target, AVSEEK_FLAG_BACKWARD) < 0)
+         continue;
+      avcodec_flush_buffers(d.dec);
+      bool got_first = false, got_exact = false;
+      bool eof = false;
+      while (!got_exact && !eof) {
+         if (av_read_frame(d.fmt, pkt) < 0) {
+            eof = true;
+            avcodec_send_packet(d.dec, nullptr);
+         } else if (pkt->stream_index == d.stream) {
+            avcodec_send_packet(d.dec, pkt);
+         }
+         av_packet_unref(pkt);
+         while (avcodec_receive_frame(d.dec, frame) == 0) {
+            if (!got_first) {
+               got_first = true;
+               first_ms.push_back(secondsSince(start) * 1000);
+            }
+            if (!got_exact && frame->pts != AV_NOPTS_VALUE && frame->pts >= target) {
+               got_exact = true;
+               exact_ms.push_back(secondsSince(start) * 1000);
+            }
+            av_frame_unref(frame);
+         }
+      }
+   }
+   av_frame_free(&frame);
+   av_packet_free(&pkt);
+
+   m[prefix + ".seek_first_p50_ms"] = percentile(first_ms, 50);
+   m[prefix + ".seek_first_p95_ms"] = percentile(first_ms, 95);
+   m[prefix + ".seek_exact_p50_ms"] = percentile(exact_ms, 50);
+   m[prefix + ".seek_exact_p95_ms"] = percentile(exact_ms, 95);
+}
+
+/* ---------- results ---------- */
+
+static bool writeResults(const std::string& path, const std::string& encoder, const Metrics& m) {
+   FILE* f = path.empty() ? stdout : fopen(path.c_str(), "w");
+   if (!f)
+      return false;
+   fprintf(f, "{\n  \"version\": 1,\n  \"encoder\": \"%s\",\n  \"cores\": %u,\n  \"metrics\": {\n",
+         encoder.c_str(), std::thread::hardware_concurrency());
+   size_t i = 0;
+   for (Metrics::const_iterator it = m.begin(); it != m.end(); ++it, ++i)
+      fprintf(f, "    \"%s\": %.6g%s\n", it->first.c_str(), it->second, i + 1 < m.size() ? "," : "");
+   fprintf(f, "  }\n}\n");
+   return f == stdout || fclose(f) == 0;
+}
+
+// Reads the "metrics" object of a results file written by writeResults().
+static bool readMetrics(const std::string& path, Metrics& m) {
+   std::ifstream in(path.c_str());
+   if (!in)
+      return false;
+   std::stringstream buf;
+   buf << in.rdbuf();
+   const std::string text = buf.str();
+   size_t pos = text.find("\"metrics\"");
+   if (pos == std::string::npos)
+      return false;
+   pos = text.find('{', pos);
+   const size_t end = text.find('}', pos);
+   while (pos != std::string::npos && pos < end) {
+      size_t key_start = text.find('"', pos);
+      if (key_start == std::string::npos || key_start > end)
+         break;
+      size_t key_end = text.find('"', key_start + 1);
+      size_t colon = text.find(':', key_end);
+      if (key_end == std::string::npos || colon == std::string::npos)
+         break;
+      m[text.substr(key_start + 1, key_end - key_start - 1)] = strtod(text.c_str() + colon + 1, nullptr);
+      pos = text.find(',', colon);
+   }
+   return !m.empty();
+}
+
+static bool endsWith(const std::string& s, const char* suffix) {
+   size_t n = strlen(suffix);
+   return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+/* Higher is better for *_fps / *_mbps, lower for *_ms / *_kib; other keys
+ * (counts) are informational. Returns the number of regressions beyond
+ * `tolerance` percent.
+ */
+static int compareWithBaseline(const Metrics& current, const Metrics& baseline, double tolerance) {
+   int regressions = 0;
+   std::cerr << "\n=== Compared with baseline (tolerance " << tolerance << "%) ===\n";
+   for (Metrics::const_iterator it = current.begin(); it != current.end(); ++it) {
+      Metrics::const_iterator base = baseline.find(it->first);
+      if (base == baseline.end() || base->second == 0)
+         continue;
+      int direction = 0;
+      if (endsWith(it->first, "_fps") || endsWith(it->first, "_mbps"))
+         direction = 1;
+      else if (endsWith(it->first, "_ms") || endsWith(it->first, "_kib"))
+         direction = -1;
+      if (!direction)
+         continue;
+      double change = (it->second - base->second) / base->second * 100.0;
+      bool regressed = direction * change < -tolerance;
+      regressions += regressed;
+      char line[256];
+      snprintf(line, sizeof(line), "%s %-48s %12.2f -> %12.2f  (%+.1f%%)\n",
+            regressed ? "REGRESSED" : "         ", it->first.c_str(), base->second, it->second, change);
+      std::cerr << line;
+   }
+   std::cerr << regressions << " regression(s)\n";
+   return regressions;
+}
+
+int main(int argc, char* argv[]) {
+   std::string out_path, baseline_path, workdir;
+   double tolerance = 10;
+   int frames = 250;
+   int seeks = 20;
+   bool full = false, keep = false;
+
+   static const struct option long_options[] = {
+      {"out", required_argument, nullptr, 'o'},
+      {"baseline", required_argument, nullptr, 'b'},
+      {"tolerance", required_argument, nullptr, 't'},
+      {"frames", required_argument, nullptr, 'f'},
+      {"seeks", required_argument, nullptr, 's'},
+      {"workdir", required_argument, nullptr, 'w'},
+      {"full", no_argument, nullptr, 'F'},
+      {"keep", no_argument, nullptr, 'k'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}
+   };
+   int opt;
+   while ((opt = getopt_long(argc, argv, "o:b:t:f:s:w:Fkh", long_options, nullptr)) != -1) {
+      switch (opt) {
+         case 'o': out_path = optarg; break;
+         case 'b': baseline_path = optarg; break;
+         case 't': tolerance = atof(optarg); break;
+         case 'f': frames = std::max(10, atoi(optarg)); break;
+         case 's': seeks = std::max(1, atoi(optarg)); break;
+         case 'w': workdir = optarg; break;
+         case 'F': full = true; break;
+         case 'k': keep = true; break;
+         default:
+            std::cerr << "Usage: " << argv[0] << " [--out results.json] [--baseline old.json] [--tolerance PCT]\n"
+               << "       [--frames N] [--seeks N] [--full (adds 4K)] [--workdir DIR] [--keep]\n"
+               << "Exit code 3 when a metric regressed beyond the tolerance.\n";
+            return 1;
+      }
+   }
+
+   av_log_set_level(AV_LOG_QUIET); // damaged clips are noisy by design
+
+   const AVCodec* encoder = pickEncoder();
+   if (!encoder) {
+      std::cerr << "Error: no usable video encoder in this libavcodec\n";
+      return 1;
+   }
+
+   bool own_workdir = workdir.empty();
+   if (own_workdir) {
+      char tmpl[] = "/tmp/ffseeker_bench_XXXXXX";
+      if (!mkdtemp(tmpl)) {
+         std::cerr << "Error: cannot create a work directory\n";
+         return 1;
+      }
+      workdir = tmpl;
+   }
+
+   std::vector<ClipSpec> specs;
+   specs.push_back(ClipSpec{640, 360, 12, 2});
+   specs.push_back(ClipSpec{1280, 720, 12, 2});
+   specs.push_back(ClipSpec{1920, 1080, 12, 2});
+   specs.push_back(ClipSpec{1920, 1080, 60, 0});
+   if (full)
+      specs.push_back(ClipSpec{3840, 2160, 30, 2});
+
+   std::cerr << "Encoder: " << encoder->name << ", " << frames << " frames per clip, work dir " << workdir << "\n";
+   Metrics m;
+   std::vector<std::string> generated;
+   FrameBufferPool pool;
+
+   for (size_t c = 0; c < specs.size(); c++) {
+      const ClipSpec& spec = specs[c];
+      const std::string prefix = spec.name();
+      std::string clean, damaged;
+      int damaged_packets = 0;
+      Clock::time_point gen_start = Clock::now();
+      if (!generateClip(spec, encoder, frames, workdir, clean, damaged, damaged_packets)) {
+         std::cerr << prefix << ": encoder cannot produce this clip, skipped\n";
+         continue;
+      }
+      generated.push_back(clean);
+      generated.push_back(damaged);
+      std::cerr << prefix << ": generated in " << secondsSince(gen_start) << "s\n";
+
+      std::vector<AVFrame*> kept;
+      DecodeResult clean_run;
+      if (!decodeAll(clean, &pool, clean_run, &kept, 16) || kept.empty()) {
+         std::cerr << prefix << ": decode failed, skipped\n";
+         continue;
+      }
+      m[prefix + ".decode_fps"] = clean_run.frames / clean_run.seconds;
+
+      DecodeResult default_alloc_run;
+      if (decodeAll(clean, nullptr, default_alloc_run, nullptr, 0))
+         m[prefix + ".decode_default_alloc_fps"] = default_alloc_run.frames / default_alloc_run.seconds;
+
+      DecodeResult damaged_run;
+      if (decodeAll(damaged, &pool, damaged_run, nullptr, 0)) {
+         m[prefix + ".damaged_decode_fps"] = damaged_run.frames / damaged_run.seconds;
+         m[prefix + ".damaged_packets_count"] = damaged_packets;
+         m[prefix + ".damaged_flagged_frames_count"] = damaged_run.corrupt_frames;
+      }
+
+      benchHashes(prefix, kept, m);
+      benchDetector(prefix, kept, m);
+      benchSeeks(prefix, clean, seeks, m);
+      for (size_t i = 0; i < kept.size(); i++)
+         av_frame_free(&kept[i]);
+
+      std::cerr << prefix << ": decode " << m[prefix + ".decode_fps"] << " fps, xxh64 "
+         << m[prefix + ".hash_xxh64_mbps"] << " MB/s, seek p50 " << m[prefix + ".seek_first_p50_ms"] << " ms\n";
+   }
+
+   struct rusage usage;
+   getrusage(RUSAGE_SELF, &usage);
+   m["memory.peak_rss_kib"] = usage.ru_maxrss;
+   m["memory.peak_cpp_heap_kib"] = allocSnapshot().peak_bytes >> 10;
+   m["memory.frame_pool_kib"] = pool.allocatedBytes() >> 10;
+
+   if (!keep) {
+      for (size_t i = 0; i < generated.size(); i++)
+         unlink(generated[i].c_str());
+      if (own_workdir)
+         rmdir(workdir.c_str());
+   }
+
+   if (!writeResults(out_path, encoder->name, m)) {
+      std::cerr << "Error: cannot write " << out_path << "\n";
+      return 1;
+   }
+   if (!out_path.empty())
+      std::cerr << "Results written to " << out_path << "\n";
+
+   if (!baseline_path.empty()) {
+      Metrics baseline;
+      if (!readMetrics(baseline_path, baseline)) {
+         std::cerr << "Error: cannot read baseline " << baseline_path << "\n";
+         return 1;
+      }
+      if (compareWithBaseline(m, baseline, tolerance))
+         return 3;
+   }
+   return 0;
+}
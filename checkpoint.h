@@ -0,0 +1,89 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "keyframe_index.h" // MediaIdentity
+
+/* Resume point of a long scan (--checkpoint / --resume).
+ *
+ * Taken in output order at a clean keyframe: everything before it has been
+ * reported and counted, nothing from it on. A resumed run seeks to that
+ * keyframe, drops frames presenting before it (open-GOP leading pictures,
+ * already reported) and continues with the saved frame number and totals.
+ * One fixed 144-byte struct in host byte order, replaced atomically. The
+ * golden-run coverage of --compare and the --streams totals are not part of
+ * it, so those modes don't combine with checkpoints.
+ */
+struct CheckpointState {
+   char magic[8];            // "FFSKCKP1"
+   uint32_t version;         // 3
+   uint32_t complete;        // the run reached EOF, nothing left to resume
+   MediaIdentity identity;   // 24 bytes
+   int32_t stream_index;
+   int32_t tb_num;           // of keyframe_pts
+   int32_t tb_den;
+   uint32_t reserved;
+   int64_t keyframe_pts;     // stream time base
+   int64_t keyframe_pos;     // byte offset of its packet, -1 if the demuxer did not say
+   int64_t frame_number;     // frames reported before the keyframe
+   // SeekerStats totals up to the keyframe
+   uint64_t corrupt_frames;
+   uint64_t visual_corruption;
+   uint64_t missing_pts;
+   uint64_t read_errors;
+   uint64_t temporal_freezes;
+   uint64_t temporal_flashes;
+   uint64_t temporal_tears;
+   int64_t log_bytes;        // text / JSON log file size up to the keyframe, -1: no log file
+};
+static_assert(sizeof(CheckpointState) == 144, "CheckpointState layout is part of the file format");
+
+inline void initCheckpoint(CheckpointState& state) {
+   memset(&state, 0, sizeof(state));
+   memcpy(state.magic, "FFSKCKP1", sizeof(state.magic));
+   state.version = 3;
+   state.keyframe_pts = AV_NOPTS_VALUE;
+   state.keyframe_pos = -1;
+   state.log_bytes = -1;
+}
+
+// Written next to `path` and renamed over it, synced first: a crash at any
+// point leaves either the previous checkpoint or this one.
+inline bool writeCheckpoint(const std::string& path, const CheckpointState& state) {
+   const std::string tmp = path + ".tmp";
+   int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0)
+      return false;
+   bool ok = write(fd, &state, sizeof(state)) == static_cast<ssize_t>(sizeof(state));
+   ok = fsync(fd) == 0 && ok;
+   ok = close(fd) == 0 && ok;
+   if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+      unlink(tmp.c_str());
+      return false;
+   }
+   return true;
+}
+
+// False with `error` set if the file is missing, damaged or from another version.
+inline bool readCheckpoint(const std::string& path, CheckpointState& state, std::string& error) {
+   FILE* f = fopen(path.c_str(), "rb");
+   if (!f) {
+      error = "cannot open " + path;
+      return false;
+   }
+   const bool read = fread(&state, sizeof(state), 1, f) == 1;
+   fclose(f);
+   if (!read || memcmp(state.magic, "FFSKCKP1", sizeof(state.magic)) != 0 || state.version != 3) {
+      error = path + " is not a checkpoint file";
+      return false;
+   }
+   return true;
+}
+
+#endif // CHECKPOINT_H
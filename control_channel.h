@@ -0,0 +1,279 @@
+#ifndef CONTROL_CHANNEL_H
+#define CONTROL_CHANNEL_H
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* Playback control, from the keyboard or from a --control-socket client. */
+struct ControlCommand {
+   enum Kind {
+      SEEK,         // value: seconds, relative unless `absolute`
+      PAUSE,
+      RESUME,
+      TOGGLE_PAUSE, // keyboard space / p
+      STEP,         // value: frames to release while paused
+      STATS,
+      QUIT
+   };
+   Kind kind;
+   double value = 0;
+   bool absolute = false;
+};
+
+/* One socket line: `seek +5`, `seek -5`, `seek 93.5` (absolute seconds),
+ * `pause`, `resume`, `step [N]`, `stats`, `quit`.
+ */
+inline bool parseControlCommand(const std::string& line, ControlCommand& cmd) {
+   size_t space = line.find(' ');
+   const std::string verb = line.substr(0, space);
+   const std::string arg = space == std::string::npos ? "" : line.substr(space + 1);
+   char* tail = nullptr;
+   cmd = ControlCommand();
+   if (verb == "seek") {
+      cmd.kind = ControlCommand::SEEK;
+      cmd.value = strtod(arg.c_str(), &tail);
+      cmd.absolute = !arg.empty() && arg[0] != '+' && arg[0] != '-';
+      return !arg.empty() && *tail == '\0' && (!cmd.absolute || cmd.value >= 0);
+   } else if (verb == "step") {
+      cmd.kind = ControlCommand::STEP;
+      cmd.value = arg.empty() ? 1 : strtol(arg.c_str(), &tail, 10);
+      return (arg.empty() || *tail == '\0') && cmd.value >= 1;
+   }
+   if (!arg.empty())
+      return false;
+   if (verb == "pause")
+      cmd.kind = ControlCommand::PAUSE;
+   else if (verb == "resume")
+      cmd.kind = ControlCommand::RESUME;
+   else if (verb == "stats")
+      cmd.kind = ControlCommand::STATS;
+   else if (verb == "quit")
+      cmd.kind = ControlCommand::QUIT;
+   else
+      return false;
+   return true;
+}
+
+/* Event-driven replacement for polling the keyboard: one epoll set holding
+ * the terminal, an optional listening Unix socket with its clients, and an
+ * eventfd that any thread writes to end the loop. The thread in run() sleeps
+ * until one of them is readable, so an idle player costs no CPU.
+ *
+ * The terminal is switched to non-canonical, no-echo mode once for the
+ * lifetime of the channel instead of around every read. Socket clients
+ * send newline-terminated commands and get one reply line each.
+ */
+class ControlChannel {
+   public:
+      // Gets a command, returns the reply line (without newline).
+      typedef std::function<std::string(const ControlCommand&)> Handler;
+
+      // `key_seek`: seconds the s / a keys jump.
+      ControlChannel(bool keyboard, const std::string& socket_path, double key_seek)
+      : epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+        wake_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+        listen_fd(-1),
+        path(socket_path),
+        key_seek(key_seek),
+        terminal_saved(false)
+      {
+         if (epoll_fd < 0 || wake_fd < 0) {
+            closeAll();
+            throw std::runtime_error("Failed to set up the control loop");
+         }
+         watch(wake_fd);
+         if (!path.empty())
+            listen(path); // may throw: before the terminal is touched
+         if (keyboard && isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved_terminal) == 0) {
+            struct termios raw = saved_terminal;
+            raw.c_lflag &= ~(ICANON | ECHO);
+            raw.c_cc[VMIN] = 1;
+            raw.c_cc[VTIME] = 0;
+            tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+            terminal_saved = true;
+            watch(STDIN_FILENO);
+         }
+      }
+
+      ~ControlChannel() {
+         if (terminal_saved)
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved_terminal);
+         closeAll();
+      }
+
+      ControlChannel(const ControlChannel&) = delete;
+      ControlChannel& operator=(const ControlChannel&) = delete;
+
+      bool keyboard() const { return terminal_saved; }
+
+      // Any thread: makes run() return.
+      void shutdown() {
+         uint64_t one = 1;
+         if (write(wake_fd, &one, sizeof(one)) < 0) {
+            // counter saturated: a wakeup is pending anyway
+         }
+      }
+
+      // Dispatches commands until shutdown().
+      void run(const Handler& handler) {
+         struct epoll_event events[16];
+         for (;;) {
+            int n = epoll_wait(epoll_fd, events, 16, -1);
+            if (n < 0) {
+               if (errno == EINTR)
+                  continue;
+               return;
+            }
+            for (int i = 0; i < n; i++) {
+               const int fd = events[i].data.fd;
+               if (fd == wake_fd)
+                  return;
+               else if (fd == STDIN_FILENO)
+                  readKeyboard(handler);
+               else if (fd == listen_fd)
+                  accept();
+               else
+                  readClient(fd, handler);
+            }
+         }
+      }
+
+   private:
+      int epoll_fd;
+      int wake_fd;
+      int listen_fd;
+      std::string path;
+      double key_seek;
+      struct termios saved_terminal;
+      bool terminal_saved;
+      std::map<int, std::string> clients; // fd -> partial line
+
+      static const size_t MAX_LINE = 256;
+
+      void watch(int fd) {
+         struct epoll_event ev;
+         memset(&ev, 0, sizeof(ev));
+         ev.events = EPOLLIN;
+         ev.data.fd = fd;
+         epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+      }
+
+      void unwatch(int fd) {
+         epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+      }
+
+      void listen(const std::string& socket_path) {
+         struct sockaddr_un addr;
+         memset(&addr, 0, sizeof(addr));
+         addr.sun_family = AF_UNIX;
+         if (socket_path.size() >= sizeof(addr.sun_path)) {
+            closeAll();
+            throw std::runtime_error("Control socket path too long: " + socket_path);
+         }
+         memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+         unlink(socket_path.c_str()); // stale socket of an earlier run
+         listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+         if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+               ::listen(listen_fd, 4) != 0) {
+            const std::string reason = strerror(errno);
+            closeAll();
+            throw std::runtime_error("Cannot listen on " + socket_path + ": " + reason);
+         }
+         watch(listen_fd);
+      }
+
+      void accept() {
+         int fd;
+         while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+            clients[fd] = std::string();
+            watch(fd);
+         }
+      }
+
+      void readKeyboard(const Handler& handler) {
+         char keys[16];
+         ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+         if (n <= 0) {
+            unwatch(STDIN_FILENO); // closed terminal: keep serving the socket
+            return;
+         }
+         for (ssize_t i = 0; i < n; i++) {
+            ControlCommand cmd;
+            switch (keys[i]) {
+               case 's': cmd.kind = ControlCommand::SEEK; cmd.value = key_seek; break;
+               case 'a': cmd.kind = ControlCommand::SEEK; cmd.value = -key_seek; break;
+               case 'p':
+               case ' ': cmd.kind = ControlCommand::TOGGLE_PAUSE; break;
+               case 'n': cmd.kind = ControlCommand::STEP; cmd.value = 1; break;
+               case 'i': cmd.kind = ControlCommand::STATS; break;
+               case 'q': cmd.kind = ControlCommand::QUIT; break;
+               default: continue;
+            }
+            const std::string reply = handler(cmd);
+            if (cmd.kind == ControlCommand::STATS)
+               std::cout << reply << "\n";
+         }
+      }
+
+      void readClient(int fd, const Handler& handler) {
+         char buf[512];
+         std::string& pending = clients[fd];
+         ssize_t n;
+         while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            pending.append(buf, n);
+            size_t newline;
+            while ((newline = pending.find('\n')) != std::string::npos) {
+               std::string line = pending.substr(0, newline);
+               pending.erase(0, newline + 1);
+               if (!line.empty() && line[line.size() - 1] == '\r')
+                  line.erase(line.size() - 1);
+               if (line.empty())
+                  continue;
+               ControlCommand cmd;
+               const std::string reply = parseControlCommand(line, cmd)
+                  ? handler(cmd) : "error: unknown command '" + line + "'";
+               send(fd, (reply + "\n").c_str(), reply.size() + 1, MSG_NOSIGNAL);
+            }
+            if (pending.size() > MAX_LINE) {
+               n = 0; // not speaking the protocol
+               break;
+            }
+         }
+         if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            unwatch(fd);
+            close(fd);
+            clients.erase(fd);
+         }
+      }
+
+      void closeAll() {
+         for (std::map<int, std::string>::iterator it = clients.begin(); it != clients.end(); ++it)
+            close(it->first);
+         clients.clear();
+         if (listen_fd >= 0) {
+            close(listen_fd);
+            unlink(path.c_str());
+            listen_fd = -1;
+         }
+         if (wake_fd >= 0)
+            close(wake_fd);
+         if (epoll_fd >= 0)
+            close(epoll_fd);
+         wake_fd = epoll_fd = -1;
+      }
+};
+
+#endif // CONTROL_CHANNEL_H
@@ -0,0 +1,323 @@
+#ifndef CORRUPTION_DETECTOR_H
+#define CORRUPTION_DETECTOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DETECTOR_X86 1
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DETECTOR_NEON 1
+#endif
+
+#include "frame_planes.h"
+
+/* Visual artifact detection in frame buffer
+ * Analyze decoded Y/U/V planes for
+ * 1. Solid colors
+ *    Y-plane solid check detects black/green/solid output typical of decoder error Concealment
+ * 2. Flat regions
+ *    UV-plane flatness check identifies gray/green block corruption (e.g. U=128, V=128 uniform)
+ *    and bands of flat rows, e.g. an undecoded lower part of the frame
+ *
+ * Every `stride`-th row of every plane is checked over its full visible width.
+ * A row is "flat" when every sample equals the row's first sample (for
+ * interleaved chroma: every U/V pair equals the first pair). The row test is
+ * the hot loop and has SSE2/AVX2/NEON kernels picked at runtime.
+ */
+
+// Row kernel: true if `bytes` bytes at `p` repeat the 4-byte `pattern`.
+// `bytes` is a multiple of the pattern period (1, 2 or 4 bytes).
+typedef bool (*FlatRowKernel)(const uint8_t* p, size_t bytes, uint32_t pattern);
+
+inline bool flatRowScalar(const uint8_t* p, size_t bytes, uint32_t pattern) {
+   size_t i = 0;
+   for (; i + 4 <= bytes; i += 4) {
+      uint32_t v;
+      memcpy(&v, p + i, 4);
+      if (v != pattern)
+         return false;
+   }
+   for (int k = 0; i < bytes; i++, k++) {
+      if (p[i] != static_cast<uint8_t>(pattern >> (8 * k)))
+         return false;
+   }
+   return true;
+}
+
+#ifdef DETECTOR_X86
+inline bool flatRowSSE2(const uint8_t* p, size_t bytes, uint32_t pattern) {
+   const __m128i ref = _mm_set1_epi32(static_cast<int>(pattern));
+   size_t i = 0;
+   for (; i + 64 <= bytes; i += 64) {
+      __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), ref);
+      __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 16)), ref);
+      __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 32)), ref);
+      __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 48)), ref);
+      if (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d))) != 0xffff)
+         return false;
+   }
+   for (; i + 16 <= bytes; i += 16) {
+      __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), ref);
+      if (_mm_movemask_epi8(a) != 0xffff)
+         return false;
+   }
+   return flatRowScalar(p + i, bytes - i, pattern); // i is a multiple of 16, pattern stays aligned
+}
+
+__attribute__((target("avx2")))
+inline bool flatRowAVX2(const uint8_t* p, size_t bytes, uint32_t pattern) {
+   const __m256i ref = _mm256_set1_epi32(static_cast<int>(pattern));
+   size_t i = 0;
+   for (; i + 128 <= bytes; i += 128) {
+      __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), ref);
+      __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 32)), ref);
+      __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 64)), ref);
+      __m256i d = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 96)), ref);
+      if (_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, d))) != -1)
+         return false;
+   }
+   for (; i + 32 <= bytes; i += 32) {
+      __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), ref);
+      if (_mm256_movemask_epi8(a) != -1)
+         return false;
+   }
+   return flatRowSSE2(p + i, bytes - i, pattern);
+}
+#endif
+
+#ifdef DETECTOR_NEON
+inline bool flatRowNEON(const uint8_t* p, size_t bytes, uint32_t pattern) {
+   const uint8x16_t ref = vreinterpretq_u8_u32(vdupq_n_u32(pattern));
+   size_t i = 0;
+   for (; i + 64 <= bytes; i += 64) {
+      uint8x16_t a = vceqq_u8(vld1q_u8(p + i), ref);
+      uint8x16_t b = vceqq_u8(vld1q_u8(p + i + 16), ref);
+      uint8x16_t c = vceqq_u8(vld1q_u8(p + i + 32), ref);
+      uint8x16_t d = vceqq_u8(vld1q_u8(p + i + 48), ref);
+      uint8x16_t all = vandq_u8(vandq_u8(a, b), vandq_u8(c, d));
+      if (vgetq_lane_u64(vreinterpretq_u64_u8(all), 0) != UINT64_MAX ||
+            vgetq_lane_u64(vreinterpretq_u64_u8(all), 1) != UINT64_MAX)
+         return false;
+   }
+   for (; i + 16 <= bytes; i += 16) {
+      uint8x16_t a = vceqq_u8(vld1q_u8(p + i), ref);
+      if (vgetq_lane_u64(vreinterpretq_u64_u8(a), 0) != UINT64_MAX ||
+            vgetq_lane_u64(vreinterpretq_u64_u8(a), 1) != UINT64_MAX)
+         return false;
+   }
+   return flatRowScalar(p + i, bytes - i, pattern);
+}
+#endif
+
+// "auto" picks the widest kernel the CPU supports. Returns nullptr for an
+// unknown or unavailable name.
+inline FlatRowKernel selectFlatRowKernel(const std::string& name, const char** chosen = nullptr) {
+   FlatRowKernel kernel = nullptr;
+   const char* label = nullptr;
+#ifdef DETECTOR_X86
+   bool avx2 = __builtin_cpu_supports("avx2");
+   if (name == "avx2" || (name == "auto" && avx2)) {
+      if (avx2) {
+         kernel = flatRowAVX2;
+         label = "avx2";
+      }
+   } else if (name == "sse2" || name == "auto") {
+      kernel = flatRowSSE2;
+      label = "sse2";
+   }
+#elif defined(DETECTOR_NEON)
+   if (name == "neon" || name == "auto") {
+      kernel = flatRowNEON;
+      label = "neon";
+   }
+#endif
+   if (!kernel && (name == "scalar" || name == "auto")) {
+      kernel = flatRowScalar;
+      label = "scalar";
+   }
+   if (chosen)
+      *chosen = label;
+   return kernel;
+}
+
+// Consecutive sampled rows of one plane that are flat, in plane rows.
+struct FlatRegion {
+   int plane;
+   int first_row;
+   int last_row;
+};
+
+struct DetectorResult {
+   static const int MAX_REGIONS = 8;
+
+   bool supported = false;
+   int rows_sampled = 0;        // luma
+   int flat_rows = 0;
+   int chroma_rows_sampled = 0;
+   int flat_chroma_rows = 0;
+   bool solid_luma = false;     // every sampled luma row flat, all with the same value
+   bool flat_chroma = false;    // same for chroma
+   bool partial = false;        // large flat band on one edge only (lower part not decoded, etc.)
+   int nb_regions = 0;
+   FlatRegion regions[MAX_REGIONS];
+
+   bool corrupt() const { return solid_luma || flat_chroma || partial; }
+
+   // "plane 0 rows 960-1079, ..." for the reported regions
+   std::string describe() const {
+      std::string out;
+      for (int i = 0; i < nb_regions; i++) {
+         if (i)
+            out += ", ";
+         out += "plane " + std::to_string(regions[i].plane) + " rows " +
+            std::to_string(regions[i].first_row) + "-" + std::to_string(regions[i].last_row);
+      }
+      return out;
+   }
+};
+
+class CorruptionDetector {
+   public:
+      // stride: check every Nth row. min_band: flat luma band (fraction of
+      // the height, as 1/min_band) that counts as a region.
+      explicit CorruptionDetector(int stride = 8, const std::string& kernel = "auto", int min_band = 8)
+      : stride(stride > 0 ? stride : 1),
+        min_band(min_band > 0 ? min_band : 8),
+        kernel_name("scalar")
+      {
+         row_flat = selectFlatRowKernel(kernel, &kernel_name);
+         if (!row_flat)
+            row_flat = selectFlatRowKernel("auto", &kernel_name);
+      }
+
+      const char* kernelName() const { return kernel_name; }
+
+      // Supported: planar and semi-planar YUV with 8 to 16 bit samples
+      // (NV12/NV21, yuv420p, P010, yuv420p10, ...).
+      DetectorResult analyze(const AVFrame* frame) const {
+         DetectorResult result;
+         const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+         if (!desc || desc->nb_components < 3 ||
+               (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_RGB |
+                               AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM)))
+            return result;
+
+         PlaneSpan planes[4];
+         int nb_planes = framePlanes(frame, planes);
+         const int sample_bytes = (desc->comp[0].depth + 7) / 8;
+         if (nb_planes < 2 || sample_bytes > 2)
+            return result;
+         result.supported = true;
+
+         // luma
+         PlaneStats luma = scanPlane(planes[0], sample_bytes, 0, result);
+         result.rows_sampled = luma.sampled;
+         result.flat_rows = luma.flat;
+         result.solid_luma = luma.sampled && luma.flat == luma.sampled && luma.uniform;
+
+         // chroma: one interleaved plane (NV12/P010) or two planes
+         bool semi_planar = desc->comp[1].plane == desc->comp[2].plane;
+         int chroma_planes = semi_planar ? 1 : 2;
+         bool chroma_uniform = true;
+         for (int p = 1; p <= chroma_planes && p < nb_planes; p++) {
+            PlaneStats chroma = scanPlane(planes[p], semi_planar ? sample_bytes * 2 : sample_bytes, p, result);
+            result.chroma_rows_sampled += chroma.sampled;
+            result.flat_chroma_rows += chroma.flat;
+            chroma_uniform = chroma_uniform && chroma.uniform;
+         }
+         result.flat_chroma = result.chroma_rows_sampled &&
+            result.flat_chroma_rows == result.chroma_rows_sampled && chroma_uniform;
+
+         result.partial = !result.solid_luma && luma.edge_band_bottom != luma.edge_band_top;
+         return result;
+      }
+
+   private:
+      struct PlaneStats {
+         int sampled;
+         int flat;
+         bool uniform;          // all flat rows share one value
+         bool edge_band_top;    // region of >= height/min_band rows touching the edge
+         bool edge_band_bottom;
+      };
+
+      int stride;
+      int min_band;
+      const char* kernel_name;
+      FlatRowKernel row_flat;
+
+      static uint32_t patternOf(const uint8_t* row, int period) {
+         uint32_t pattern;
+         if (period == 1) {
+            pattern = row[0] * 0x01010101u;
+         } else if (period == 2) {
+            uint16_t v;
+            memcpy(&v, row, 2);
+            pattern = v * 0x00010001u;
+         } else {
+            memcpy(&pattern, row, 4);
+         }
+         return pattern;
+      }
+
+      PlaneStats scanPlane(const PlaneSpan& span, int period, int plane, DetectorResult& result) const {
+         PlaneStats stats = {0, 0, true, false, false};
+         const size_t bytes = static_cast<size_t>(span.row_bytes) - span.row_bytes % period;
+         const int band = std::max(2 * stride, span.rows / min_band);
+         const int last = span.rows - 1;
+         uint32_t first_pattern = 0;
+         int run_start = -1;
+         int prev_y = 0;
+
+         // also sample the last row so bottom bands reach the edge
+         for (int y = 0; ; y += stride) {
+            if (y > last)
+               y = last;
+            const uint8_t* row = span.data + static_cast<ptrdiff_t>(y) * span.linesize;
+            const uint32_t pattern = patternOf(row, period);
+            const bool flat = row_flat(row, bytes, pattern);
+            stats.sampled++;
+            if (flat) {
+               if (!stats.flat)
+                  first_pattern = pattern;
+               else if (pattern != first_pattern)
+                  stats.uniform = false;
+               stats.flat++;
+               if (run_start < 0)
+                  run_start = y;
+            }
+            if (run_start >= 0 && (!flat || y == last)) {
+               int run_end = flat ? y : prev_y;
+               closeRun(plane, run_start, run_end, band, last, stats, result);
+               run_start = -1;
+            }
+            if (y == last)
+               break;
+            prev_y = y;
+         }
+         return stats;
+      }
+
+      static void closeRun(int plane, int first, int last_row, int band, int last,
+            PlaneStats& stats, DetectorResult& result) {
+         if (last_row - first + 1 < band)
+            return;
+         if (first == 0)
+            stats.edge_band_top = true;
+         if (last_row == last)
+            stats.edge_band_bottom = true;
+         if (result.nb_regions < DetectorResult::MAX_REGIONS) {
+            FlatRegion& region = result.regions[result.nb_regions++];
+            region.plane = plane;
+            region.first_row = first;
+            region.last_row = last_row;
+         }
+      }
+};
+
+#endif // CORRUPTION_DETECTOR_H
@@ -0,0 +1,171 @@
+#ifndef DECODER_TUNING_H
+#define DECODER_TUNING_H
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "ffseeker_types.h"
+
+inline bool parseTuneGoal(const std::string& name, TuneGoal& goal) {
+   if (name == "fps")
+      goal = TUNE_FPS;
+   else if (name == "latency")
+      goal = TUNE_LATENCY;
+   else if (name == "off")
+      goal = TUNE_OFF;
+   else
+      return false;
+   return true;
+}
+
+// 0 leaves libavcodec's default (frame and slice both allowed)
+inline bool parseThreadType(const std::string& name, int& type) {
+   if (name == "frame")
+      type = FF_THREAD_FRAME;
+   else if (name == "slice")
+      type = FF_THREAD_SLICE;
+   else if (name == "auto")
+      type = 0;
+   else
+      return false;
+   return true;
+}
+
+inline const char* threadTypeName(int type) {
+   switch (type) {
+      case FF_THREAD_FRAME: return "frame";
+      case FF_THREAD_SLICE: return "slice";
+      case 0:               return "auto";
+      default:              return "frame+slice";
+   }
+}
+
+struct ThreadConfig {
+   int threads; // 0: libavcodec picks (one per core)
+   int type;    // FF_THREAD_* or 0
+};
+
+struct TuneSample {
+   ThreadConfig config;
+   bool ok;
+   int frames;
+   double fps;
+   double first_frame_ms; // from the first packet sent
+};
+
+/* Decodes the same packets once per candidate configuration and returns
+ * the measurements. `open` creates a decoder for a configuration (and may
+ * throw); every decoder is freed before the next one is timed.
+ */
+inline std::vector<TuneSample> probeThreadConfigs(const std::vector<AVPacket*>& packets,
+      const std::vector<ThreadConfig>& candidates,
+      const std::function<AVCodecContext*(const ThreadConfig&)>& open) {
+   typedef std::chrono::steady_clock Clock;
+   std::vector<TuneSample> samples;
+   AVFrame* frame = av_frame_alloc();
+
+   for (size_t c = 0; c < candidates.size(); c++) {
+      TuneSample sample = {candidates[c], false, 0, 0, 0};
+      AVCodecContext* dec = nullptr;
+      try {
+         dec = open(candidates[c]);
+      } catch (const std::exception&) {
+         samples.push_back(sample);
+         continue;
+      }
+
+      Clock::time_point start = Clock::now();
+      Clock::time_point first = start;
+      for (size_t i = 0; i <= packets.size(); i++) {
+         // the last round drains the decoder
+         if (avcodec_send_packet(dec, i < packets.size() ? packets[i] : nullptr) < 0 && i < packets.size())
+            continue;
+         while (avcodec_receive_frame(dec, frame) == 0) {
+            if (!sample.frames++)
+               first = Clock::now();
+            av_frame_unref(frame);
+         }
+      }
+      double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+      avcodec_free_context(&dec);
+
+      sample.ok = sample.frames > 0;
+      sample.fps = seconds > 0 ? sample.frames / seconds : 0;
+      sample.first_frame_ms = std::chrono::duration<double, std::milli>(first - start).count();
+      samples.push_back(sample);
+   }
+
+   av_frame_free(&frame);
+   return samples;
+}
+
+// Single-threaded baseline plus slice and frame threading at half and all cores.
+inline std::vector<ThreadConfig> threadCandidates(int cores) {
+   std::vector<ThreadConfig> candidates;
+   candidates.push_back(ThreadConfig{1, FF_THREAD_SLICE});
+   const int counts[] = {std::max(2, cores / 2), std::max(2, cores)};
+   for (int i = 0; i < 2; i++) {
+      if (i == 1 && counts[1] == counts[0])
+         break;
+      candidates.push_back(ThreadConfig{counts[i], FF_THREAD_SLICE});
+      candidates.push_back(ThreadConfig{counts[i], FF_THREAD_FRAME});
+   }
+   return candidates;
+}
+
+// Index into `samples` of the winner for `goal`, -1 if nothing decoded.
+inline int pickThreadConfig(const std::vector<TuneSample>& samples, TuneGoal goal) {
+   int best = -1;
+   for (size_t i = 0; i < samples.size(); i++) {
+      const TuneSample& s = samples[i];
+      if (!s.ok)
+         continue;
+      if (best < 0) {
+         best = i;
+         continue;
+      }
+      const TuneSample& b = samples[best];
+      bool better = goal == TUNE_LATENCY
+         ? (s.first_frame_ms < b.first_frame_ms ||
+            (s.first_frame_ms == b.first_frame_ms && s.fps > b.fps))
+         : s.fps > b.fps;
+      if (better)
+         best = i;
+   }
+   return best;
+}
+
+// Reads the first `count` packets of one stream from a private demuxer.
+inline bool readProbePackets(const std::string& filename, int stream_index, int count,
+      std::vector<AVPacket*>& packets) {
+   AVFormatContext* ctx = nullptr;
+   if (avformat_open_input(&ctx, filename.c_str(), nullptr, nullptr) < 0)
+      return false;
+   if (avformat_find_stream_info(ctx, nullptr) < 0 || stream_index >= static_cast<int>(ctx->nb_streams)) {
+      avformat_close_input(&ctx);
+      return false;
+   }
+   AVPacket* pkt = av_packet_alloc();
+   while (static_cast<int>(packets.size()) < count && av_read_frame(ctx, pkt) >= 0) {
+      if (pkt->stream_index == stream_index) {
+         AVPacket* kept = av_packet_alloc();
+         av_packet_move_ref(kept, pkt);
+         packets.push_back(kept);
+      } else {
+         av_packet_unref(pkt);
+      }
+   }
+   av_packet_free(&pkt);
+   avformat_close_input(&ctx);
+   return !packets.empty();
+}
+
+#endif // DECODER_TUNING_H
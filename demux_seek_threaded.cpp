@@ -4,573 +4,493 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
-#include <termios.h>
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <chrono>
 #include <unistd.h>
-#include <fcntl.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libavutil/imgutils.h>
-#include <libavutil/time.h>
 #include <libavutil/error.h>
-#include <libavutil/md5.h>
 }
 
-#include <sys/select.h> // for select(), fd_set
-#include <sys/time.h>   // for timeval
-#include <fcntl.h>      // for file control options (not used here but often helpful)
+#include "ffseeker.h"
+// option parsers of the pipeline stages; the front end is not an embedder
+#include "pacer.h"
+#include "frame_hasher.h"
+#include "event_log.h"
+#include "decoder_tuning.h"
+#include "media_io.h"
+#include "seek_stress.h"
+#include "stream_decoder.h"
+#include "packet_scan.h"
+#include "mem_budget.h"
+#include "gop_sample.h"
+#include "corruption_detector.h"
+#include "work_pool.h"
+#include "lockstep_diff.h"
+#include "control_channel.h"
+#define ALLOC_STATS_DEFINE_OPERATORS // this executable counts its C++ heap use
+#include "alloc_stats.h"
+
+// ffmpeg_seeker: command line front end of libffseeker (ffseeker.h).
 
 #define SEEK_STEP 5 // seconds
 const char* loglevel = nullptr; // DEBUG Level
 
-enum DecoderType {
-   SOFTWARE,
-   HARDWARE
-};
-
-struct termios originalTermSettings;
-// Function to save the original terminal settings
-void saveTerminalSettings() {
-   tcgetattr(STDIN_FILENO, &originalTermSettings); // Save the current terminal settings
-}
-
-// Function to restore terminal settings to their original state
-void restoreTerminalSettings() {
-   tcsetattr(STDIN_FILENO, TCSANOW, &originalTermSettings); // Restore original settings
-}
-
-void cleanupKeyboard() {
-   restoreTerminalSettings(); // Restore terminal settings on cleanup
-}
+      /* Batch mode: validate many inputs headless on a work-stealing pool.
+       * Inputs are media files, directories (scanned recursively) or
+       * @manifest files with one path per line.
+       */
+      struct BatchResult {
+         std::string path;
+         bool ok = false;
+         std::string error;
+         SeekerStats stats;
+         double seconds = 0;
+      };
 
-class FFmpegDemuxSeeker {
-   public:
-   FFmpegDemuxSeeker(const std::string& filename, DecoderType decoder_type , const std::string& codecName = nullptr, bool enable_hash = false)
-   : decoder_type(decoder_type),
-     enable_hash(enable_hash),
-     codecStr(nullptr),
-     fmt_ctx(nullptr),
-     codec_ctx(nullptr),
-     video_stream_index(-1),
-     current_pos(0),
-     duration(0),
-     frame_number(0),
-     seek_offset(0),
-     quit_flag(false),
-     seek_requested(false)
-  {
-      // debug levels  av_log_set_level(AV_LOG_INFO); default
-      // AV_LOG_QUIE; // no output
-      // AV_LOG_PANIC // for unrecoverable errors that can cause prog to crash
-      // AV_LOG_FATAL // serious errors that might stop the program.
-      // AV_LOG_ERROR // Standard error messages (e.g., decoding failure).
-      // AV_LOG_WARNING // Warnings (recoverable problems).
-      // AV_LOG_INFO  // basic info
-      // AV_LOG_VERBOSE  // more then basic info
-      // AV_LOG_DEBUG  // Extremely detailed debug information.
-      // AV_LOG_TRACE  // All messages, including very low-level function calls.
-      // Trace should print 
-      // - decoder state transitions
-      // - frame timestamps
-      // - HW acceleratio"info"ls 
-      // - Internal buffer allocation information 
-
-      if (loglevel) {
-         printf(" Debug level: %s \n", loglevel);
-         if (strncmp(loglevel, "trace", 5) == 0) {  
-            av_log_set_level(AV_LOG_TRACE); 
-         } else if (strncmp(loglevel, "info", 4) == 0) {
-            av_log_set_level(AV_LOG_INFO); 
-         } else if (strncmp(loglevel, "debug", 5) == 0) {
-            av_log_set_level(AV_LOG_DEBUG); 
-         } else {
-            av_log_set_level(AV_LOG_INFO); 
-         }
-      } else {
-         av_log_set_level(AV_LOG_INFO);  // Default log level
+      static bool isDirectory(const std::string& path) {
+         struct stat st;
+         return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
       }
-      if (avformat_open_input(&fmt_ctx, filename.c_str(), nullptr, nullptr) < 0)
-         throw std::runtime_error("Failed to open file");
-
-      if (avformat_find_stream_info(fmt_ctx, nullptr) < 0)
-         throw std::runtime_error("Failed to find stream info");
 
-      for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
-         if (fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream_index = i;
-            break;
-         }
+      static bool endsWith(const std::string& s, const char* suffix) {
+         size_t n = strlen(suffix);
+         return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
       }
 
-      if (video_stream_index == -1)
-         throw std::runtime_error("No video stream found");
-
-      const AVCodec *codec = nullptr;
-      if (decoder_type == SOFTWARE) { 
-         codec = avcodec_find_decoder(fmt_ctx->streams[video_stream_index]->codecpar->codec_id);
-      } else if ( decoder_type == HARDWARE) {
-         // codec = avcodec_find_decoder_by_name("h264_v4l2m2m");
-         codec = avcodec_find_decoder_by_name(codecName.c_str());
-         if (!codec) {
-            std::cerr << "[Error] v4l2_m2m decoder not found!!!";
-            //fallback
-            ////codec = avcodec_find_decoder(fmt_ctx->streams[video_stream_index]->codecpar->codec_id); 
-            throw std::runtime_error("Error to open HW codec!!!!");
+      static void scanDirectory(const std::string& dir, std::vector<std::string>& files) {
+         DIR* d = opendir(dir.c_str());
+         if (!d) {
+            std::cerr << "[Batch] Cannot open directory " << dir << "\n";
+            return;
          }
-      }
-      if (!codec)
-         throw std::runtime_error("Unsupported codec");
-
-      codec_ctx = avcodec_alloc_context3(codec);
-      if (codec_ctx) {
-         codec_ctx->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT; // TODO need to check if this is true for HW
-                                                           // decode
-         codec_ctx->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
-         //Force errors to be visible ( SW decode only)
-         if ( decoder_type == SOFTWARE ) { 
-            // confirmed the below flags are used only by FFMpeg SW decoders for error detection
-            // on 1619 : HW decoding does not support them ( instead use is_hw_frame_corrupt() below)
-            codec_ctx->err_recognition = 
-               AV_EF_CAREFUL   | 
-               AV_EF_CRCCHECK  |
-               AV_EF_BITSTREAM | //bitstream errors
-               AV_EF_BUFFER    | // check buffer boundaries
-               AV_EF_EXPLODE    //aborts on error ( can not conceal )
-               ;
-            codec_ctx->debug = FF_DEBUG_MB_TYPE | FF_DEBUG_SKIP;// macroblock works SW H.264
+         std::vector<std::string> names;
+         while (struct dirent* entry = readdir(d)) {
+            if (entry->d_name[0] != '.')
+               names.push_back(entry->d_name);
+         }
+         closedir(d);
+         std::sort(names.begin(), names.end());
+
+         for (size_t i = 0; i < names.size(); i++) {
+            std::string path = dir + "/" + names[i];
+            if (isDirectory(path))
+               scanDirectory(path, files);
+            else if (!endsWith(path, ".kfidx") && !endsWith(path, ".tmp")) // our own sidecars
+               files.push_back(path);
          }
       }
 
-      avcodec_parameters_to_context(codec_ctx, fmt_ctx->streams[video_stream_index]->codecpar);
-      if (avcodec_open2(codec_ctx, codec, nullptr) < 0)
-         throw std::runtime_error("Failed to open codec");
-
-      duration = fmt_ctx->duration;
-      std::cout << "Loaded: " << filename << ", duration: " << (duration / AV_TIME_BASE) << " sec\n";
-      // Print general format-level info
-      std::cout << "Input file: " << fmt_ctx->url << "\n";
-      AVCodecParameters* codecpar = nullptr;
-      AVStream* video_stream = nullptr;
-      int video_stream_index = -1;
-
-      // Find the best video stream
-      for (unsigned int i = 0; i < fmt_ctx->nb_streams; ++i) {
-         if (fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream = fmt_ctx->streams[i];
-            codecpar = video_stream->codecpar;
-            video_stream_index = i;
-            break;
+      static bool collectBatchInputs(const std::vector<std::string>& args, std::vector<std::string>& files) {
+         for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            if (!arg.empty() && arg[0] == '@') {
+               std::ifstream manifest(arg.substr(1).c_str());
+               if (!manifest) {
+                  std::cerr << "Error: Cannot read manifest " << arg.substr(1) << "\n";
+                  return false;
+               }
+               std::string line;
+               while (std::getline(manifest, line)) {
+                  line.erase(0, line.find_first_not_of(" \t"));
+                  line.erase(line.find_last_not_of(" \t\r") + 1);
+                  if (!line.empty() && line[0] != '#')
+                     files.push_back(line);
+               }
+            } else if (isDirectory(arg)) {
+               scanDirectory(arg, files);
+            } else {
+               files.push_back(arg);
+            }
          }
-      }
-      if (!video_stream || !codecpar)
-         throw std::runtime_error("No video stream found");
-      const char* codec_long_name = codec ? codec->long_name : "unknown";
-
-      // Duration (in seconds)
-      double duration_sec = (fmt_ctx->duration != AV_NOPTS_VALUE)
-         ? fmt_ctx->duration * av_q2d(AV_TIME_BASE_Q)
-         : 0;
-
-      // Bitrate (in kbps)
-      int64_t bitrate = fmt_ctx->bit_rate;
-
-      std::cout << "Video stream index: " << video_stream_index << "\n";
-      std::cout << "Encoded format: " << codec_long_name << "\n";
-      std::cout << "Codec ID: " << codecpar->codec_id << "\n";
-      std::cout << "Resolution: " << codecpar->width << "x" << codecpar->height << "\n";
-      std::cout << "Pixel format: " << av_get_pix_fmt_name((AVPixelFormat)codecpar->format) << "\n";
-      std::cout << "Duration: " << duration_sec << " seconds\n";
-      std::cout << "Overall Bitrate:(includes all streams) " << (bitrate / 1000) << " kbps\n";
-      std::cout << "Video stream Bitrate: " << (codecpar->bit_rate / 1000) << " kbps\n";
-      std::cout << "Decoder used : " << (codec->name) << "\n";
-
-   }
-
-      ~FFmpegDemuxSeeker() {
-         if (codec_ctx)
-            avcodec_free_context(&codec_ctx);
-         if (fmt_ctx)
-            avformat_close_input(&fmt_ctx);
+         return true;
       }
 
-      void run() {
-         std::thread demux_thread(&FFmpegDemuxSeeker::demuxLoop, this);
-         std::thread input_thread(&FFmpegDemuxSeeker::inputLoop, this);
-
-         demux_thread.join();
-         input_thread.join();
+      static std::string jsonString(const std::string& text) {
+         std::string out = "\"";
+         for (size_t i = 0; i < text.size(); i++) {
+            char c = text[i];
+            if (c == '"' || c == '\\')
+               out += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20)
+               out += c;
+         }
+         return out + "\"";
       }
 
-   private:
-      DecoderType decoder_type;
-      bool enable_hash;
-      const char* codecStr = nullptr;
-      AVFormatContext* fmt_ctx;
-      AVCodecContext* codec_ctx;
-      int video_stream_index;
-      int64_t current_pos;
-      int64_t duration;
-      int64_t frame_number;
-
-      int64_t seek_offset; // in microseconds
-      std::atomic<bool> quit_flag;
-      std::mutex seek_mutex;
-      std::atomic<bool> seek_requested;
-
-      void demuxLoop() {
-         AVPacket* packet = av_packet_alloc();
-         AVFrame* frame = av_frame_alloc();
-
-         while (!quit_flag) {
-            if (seek_requested) {
-               std::lock_guard<std::mutex> lock(seek_mutex);
-               int64_t new_pos = current_pos + seek_offset;
-               if (new_pos < 0) new_pos = 0;
-               if (new_pos > duration) new_pos = duration;
-               current_pos = new_pos;
-
-               int64_t ts = av_rescale_q(current_pos, AV_TIME_BASE_Q,
-                     fmt_ctx->streams[video_stream_index]->time_base);
-               if (av_seek_frame(fmt_ctx, video_stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0) {
-                  std::cerr << "[Seek] Failed\n";
-               } else {
-                  avcodec_flush_buffers(codec_ctx);
-                  std::cout << "[Seek] Jumped to " << current_pos / AV_TIME_BASE << " sec\n";
-               }
-
-               seek_requested = false;
+      static bool writeBatchReport(const std::string& path, const std::vector<BatchResult>& results,
+            int jobs, int decoder_threads, double wall_seconds, bool temporal, bool sampled) {
+         FILE* f = fopen(path.c_str(), "w");
+         if (!f)
+            return false;
+         fprintf(f, "{\n  \"jobs\": %d,\n  \"decoder_threads\": %d,\n  \"wall_seconds\": %.3f,\n  \"peak_rss\": %llu,\n",
+               jobs, decoder_threads, wall_seconds, static_cast<unsigned long long>(peakRssBytes()));
+         if (sampled) {
+            uint64_t gops = 0, damaged = 0;
+            for (size_t i = 0; i < results.size(); i++) {
+               gops += results[i].ok ? results[i].stats.sampled_gops : 0;
+               damaged += results[i].ok ? results[i].stats.damaged_gops : 0;
             }
-
-            int ret = av_read_frame(fmt_ctx, packet);
-            if (ret < 0) {
-               if (ret == AVERROR_EOF) {
-                  std::cout << "[EOF reached]\n";
-                  quit_flag = true;
-               } else {
-                  char errbuf[AV_ERROR_MAX_STRING_SIZE];
-                  std::cerr << "[Error reading frame: "
-                     << av_make_error_string(errbuf, AV_ERROR_MAX_STRING_SIZE, ret)
-                     << "]\n";
+            const RateEstimate est = wilsonInterval(damaged, gops);
+            fprintf(f, "  \"sample\": {\"gops\": %llu, \"damaged_gops\": %llu, \"rate\": %.6f, \"ci95_low\": %.6f, \"ci95_high\": %.6f},\n",
+                  static_cast<unsigned long long>(gops), static_cast<unsigned long long>(damaged),
+                  est.rate, est.low, est.high);
+         }
+         fprintf(f, "  \"files\": [\n");
+         for (size_t i = 0; i < results.size(); i++) {
+            const BatchResult& r = results[i];
+            fprintf(f, "    {\"path\": %s, \"ok\": %s", jsonString(r.path).c_str(), r.ok ? "true" : "false");
+            if (r.ok) {
+               fprintf(f, ", \"frames\": %llu, \"corrupt_frames\": %llu, \"visual_corruption\": %llu, "
+                     "\"missing_pts\": %llu, \"read_errors\": %llu, \"eof\": %s, \"seconds\": %.3f",
+                     static_cast<unsigned long long>(r.stats.frames),
+                     static_cast<unsigned long long>(r.stats.corrupt_frames),
+                     static_cast<unsigned long long>(r.stats.visual_corruption),
+                     static_cast<unsigned long long>(r.stats.missing_pts),
+                     static_cast<unsigned long long>(r.stats.read_errors),
+                     r.stats.reached_eof ? "true" : "false", r.seconds);
+               fprintf(f, ", \"peak_queued\": {");
+               for (int s = 0; s < BUDGET_STAGE_COUNT; s++)
+                  fprintf(f, "%s\"%s\": %llu", s ? ", " : "", budgetStageName(s),
+                        static_cast<unsigned long long>(r.stats.peak_queued[s]));
+               fprintf(f, "}, \"budget_waits\": %llu", static_cast<unsigned long long>(r.stats.budget_waits));
+               if (sampled)
+                  fprintf(f, ", \"gops\": %llu, \"sampled_gops\": %llu, \"damaged_gops\": %llu",
+                        static_cast<unsigned long long>(r.stats.total_gops),
+                        static_cast<unsigned long long>(r.stats.sampled_gops),
+                        static_cast<unsigned long long>(r.stats.damaged_gops));
+               if (temporal)
+                  fprintf(f, ", \"freezes\": %llu, \"flashes\": %llu, \"tears\": %llu",
+                        static_cast<unsigned long long>(r.stats.temporal_freezes),
+                        static_cast<unsigned long long>(r.stats.temporal_flashes),
+                        static_cast<unsigned long long>(r.stats.temporal_tears));
+               if (!r.stats.streams.empty()) {
+                  fprintf(f, ", \"streams\": [");
+                  for (size_t k = 0; k < r.stats.streams.size(); k++) {
+                     const StreamStats& st = r.stats.streams[k];
+                     fprintf(f, "%s{\"index\": %d, \"type\": \"%c\", \"codec\": %s, \"packets\": %llu, "
+                           "\"frames\": %llu, \"samples\": %llu, \"corrupt_frames\": %llu, "
+                           "\"decode_errors\": %llu, \"visual_corruption\": %llu}",
+                           k ? ", " : "", st.index, st.type, jsonString(st.codec).c_str(),
+                           static_cast<unsigned long long>(st.packets),
+                           static_cast<unsigned long long>(st.frames),
+                           static_cast<unsigned long long>(st.samples),
+                           static_cast<unsigned long long>(st.corrupt_frames),
+                           static_cast<unsigned long long>(st.decode_errors),
+                           static_cast<unsigned long long>(st.visual_corruption));
+                  }
+                  fprintf(f, "]");
                }
-               break;
-            }
-
-            if (packet->stream_index == video_stream_index) {
-               if (avcodec_send_packet(codec_ctx, packet) == 0) {
-                  while (avcodec_receive_frame(codec_ctx, frame) == 0) {
-                     // bool is_corrupt = false;
-                     if (frame->flags & AV_FRAME_FLAG_CORRUPT || 
-                           frame->decode_error_flags || 
-                           (packet && (packet->flags & AV_PKT_FLAG_CORRUPT))
-                        ) 
-                     {
-                        // is_corrupt = true;
-                        std::cout << "\n=== CORRUPTION DETECTED === \n";
-                        std::cout << "\nPacket PTS: " << (packet ? packet->pts : -1);
-                        std::cout << "\nFrame PTS: " << frame->pts;
-                        std::cout << "\nError Flags: " << std::hex << frame->decode_error_flags << std::dec;
-                        printFrameInfo(frame); // This will now show macroblock map
-                     } else {
-                        printFrameInfo(frame); // Normal frame output
-                     }
-
-                     // if(frame->flags & AV_FRAME_FLAG_CORRUPT) {
-                     //    printf("[Warning] Corrupted frame detected at PTS %" PRId64 "\n", frame->pts);
-                     // }
-                     // // check if any part of frame (macroblocks) are affected
-                     // if (packet->flags & AV_PKT_FLAG_CORRUPT) {
-                     //    printf("[WARNING] Corrupted packet detected at PTS %" PRId64"\n", packet->pts);
-                     // }
-                     // // print frame info 
-                     // printFrameInfo(frame);
-                     if (is_hw_frame_corrupt(frame)) {
-                        std::cerr << "[HW] Visual corruption detected (PTS: " << frame->pts << ")\n";
-                        // is_corrupt = true;
-                     }
-                  } //--
+               if (!r.stats.packet_scan.empty()) {
+                  fprintf(f, ", \"packet_scan\": [");
+                  for (size_t k = 0; k < r.stats.packet_scan.size(); k++) {
+                     const PacketScanStats& st = r.stats.packet_scan[k];
+                     fprintf(f, "%s{\"index\": %d, \"type\": \"%c\", \"packets\": %llu, \"bytes\": %llu, "
+                           "\"keyframes\": %llu, \"missing_ts\": %llu, \"corrupt\": %llu, \"empty\": %llu, "
+                           "\"non_monotonic_dts\": %llu, \"pts_before_dts\": %llu, \"gaps\": %llu, \"oversized\": %llu}",
+                           k ? ", " : "", st.index, st.type,
+                           static_cast<unsigned long long>(st.packets), static_cast<unsigned long long>(st.bytes),
+                           static_cast<unsigned long long>(st.keyframes), static_cast<unsigned long long>(st.missing_ts),
+                           static_cast<unsigned long long>(st.corrupt), static_cast<unsigned long long>(st.empty),
+                           static_cast<unsigned long long>(st.non_monotonic),
+                           static_cast<unsigned long long>(st.pts_before_dts),
+                           static_cast<unsigned long long>(st.gaps), static_cast<unsigned long long>(st.oversized));
+                  }
+                  fprintf(f, "]");
                }
+            } else {
+               fprintf(f, ", \"error\": %s", jsonString(r.error).c_str());
             }
-            av_packet_unref(packet);
-            usleep(3300); // reduce CPU usage ( set to 30 fps )
+            fprintf(f, "}%s\n", i + 1 < results.size() ? "," : "");
          }
-
-         av_frame_free(&frame);
-         av_packet_free(&packet);
+         fprintf(f, "  ]\n}\n");
+         return fclose(f) == 0;
       }
 
-      void inputLoop() {
-         std::cout << "Controls:\n"
-            << "  s - Seek forward 5s\n"
-            << "  a - Seek backward 5s\n"
-            << "  q - Quit\n";
-
-         while (!quit_flag) {
-            //char c = getch(); // blocking 
-            char c = getch_select(); //non-blocking
-            if (c == 'q') {
-               quit_flag = true;
-               std::cout << "[Quit]\n";
-               break;
-            } else if (c == 's') {
-               requestSeek(SEEK_STEP * AV_TIME_BASE);
-            } else if (c == 'a') {
-               requestSeek(-SEEK_STEP * AV_TIME_BASE);
+      /* Keyboard and --control-socket commands for one playback: a thread
+       * sleeping in the ControlChannel's epoll loop, mapped onto the FFSeeker
+       * controls. Stops when the session is destroyed.
+       */
+      class ControlSession {
+         public:
+            ControlSession(FFSeeker& seeker, const std::string& socket_path)
+            : seeker(seeker),
+              channel(true, socket_path, SEEK_STEP)
+            {
+               if (channel.keyboard())
+                  std::cout << "Controls:\n"
+                     << "  s - Seek forward 5s\n"
+                     << "  a - Seek backward 5s\n"
+                     << "  p - Pause / resume\n"
+                     << "  n - Next frame (pauses)\n"
+                     << "  i - Stats\n"
+                     << "  q - Quit\n";
+               if (!socket_path.empty())
+                  std::cout << "Control socket: " << socket_path << "\n";
+               thread = std::thread([this] {
+                     channel.run([this](const ControlCommand& cmd) { return handle(cmd); });
+                  });
             }
-         }
-      }
-
-      void requestSeek(int64_t offset) {
-         std::lock_guard<std::mutex> lock(seek_mutex);
-         seek_offset = offset;
-         seek_requested = true;
-      }
 
-      void printFrameInfo(AVFrame* frame) {
-         char md5string[33];
-         if (enable_hash) { 
-            // Initialize MD5 context
-            AVMD5* md5 = av_md5_alloc();
-            if (!md5) {
-               std::cerr << "Failed to allocate MD5 context\n";
-               return;
+            ~ControlSession() {
+               channel.shutdown();
+               thread.join();
             }
 
-            av_md5_init(md5);
-
-            // Hash the pixel data
-            // int frame_size = 0;
-            for (int plane = 0; plane < AV_NUM_DATA_POINTERS && frame->data[plane]; plane++) {
-               int linesize = frame->linesize[plane];
-               int height = (plane == 0 || frame->format == AV_PIX_FMT_GRAY8) ? frame->height : frame->height / 2;
-
-               for (int y = 0; y < height; y++) {
-                  av_md5_update(md5, frame->data[plane] + y * linesize, linesize);
-                  // frame_size += linesize; //accumulated size
+            ControlSession(const ControlSession&) = delete;
+            ControlSession& operator=(const ControlSession&) = delete;
+
+         private:
+            FFSeeker& seeker;
+            ControlChannel channel;
+            std::thread thread;
+
+            std::string handle(const ControlCommand& cmd) {
+               switch (cmd.kind) {
+                  case ControlCommand::SEEK:
+                     if (cmd.absolute)
+                        seeker.seekTo(cmd.value);
+                     else
+                        seeker.seek(cmd.value);
+                     break;
+                  case ControlCommand::PAUSE:
+                     seeker.setPaused(true);
+                     break;
+                  case ControlCommand::RESUME:
+                     seeker.setPaused(false);
+                     break;
+                  case ControlCommand::TOGGLE_PAUSE:
+                     seeker.setPaused(!seeker.progress().paused);
+                     break;
+                  case ControlCommand::STEP:
+                     seeker.step(static_cast<int>(cmd.value));
+                     break;
+                  case ControlCommand::STATS: {
+                     const SeekerProgress now = seeker.progress();
+                     char line[256];
+                     snprintf(line, sizeof(line), "pos %.3f frames %llu packets %llu corrupt %llu visual %llu seeks %llu %s",
+                           now.position, static_cast<unsigned long long>(now.frames),
+                           static_cast<unsigned long long>(now.packets),
+                           static_cast<unsigned long long>(now.corrupt_frames),
+                           static_cast<unsigned long long>(now.visual_corruption),
+                           static_cast<unsigned long long>(now.seeks), now.paused ? "paused" : "playing");
+                     return line;
+                  }
+                  case ControlCommand::QUIT:
+                     seeker.quit();
+                     break;
                }
+               return "ok";
             }
+      };
 
-            uint8_t digest[16];
-            av_md5_final(md5, digest);
-            av_free(md5);
-
-            // Format MD5 as hex string
-            // char md5string[33];
-            for (int i = 0; i < 16; i++) {
-               snprintf(md5string + i * 2, 3, "%02x", digest[i]);
-            }
-         }
-
-         char pict_type_char = av_get_picture_type_char(frame->pict_type);
-
-         if (frame->pts == AV_NOPTS_VALUE)
-            std::cout << "[NOTICE] Frame missing PTS\n";
-
-         if (frame->pict_type == AV_PICTURE_TYPE_NONE)
-            std::cout << "[NOTICE] Frame picture type unknown\n";
-
-         // uncomment the below  HW decoder missing PTS/DTS and we wish to fix this.
-         // For this tool we do not fix (purpose is to raw comparision)
-         // bool use_best_effort = true;  //TODO: controlled via config or CLI arg
-         // int64_t raw_pts = frame->pts;
-         // int64_t effective_pts = -1;
-         // if (use_best_effort) {
-         //   effective_pts = (frame->best_effort_timestamp != AV_NOPTS_VALUE)
-         //           ? frame->best_effort_timestamp
-         //           : (frame->pts != AV_NOPTS_VALUE ? frame->pts : -1);
-         // } else {
-         //      effective_pts = frame->pts;
-         // }
-         // double timestamp = (effective_pts != -1)
-         //          ? effective_pts * av_q2d(fmt_ctx->streams[video_stream_index]->time_base)
-         //          : -1;
-
-         double timestamp = (frame->pts != AV_NOPTS_VALUE)
-            ? frame->pts * av_q2d(fmt_ctx->streams[video_stream_index]->time_base)
-            : -1;
-
-         // int buffer_size = av_image_get_buffer_size((AVPixelFormat)frame->format,
-         //                                         frame->width, frame->height, 1);
-
-         const char* pix_fmt_name = av_get_pix_fmt_name(static_cast<AVPixelFormat>(frame->format));
-
-         if (enable_hash) {
-            std::cout << "Frame #" << frame_number++
-               << " | Type: " << pict_type_char
-               << " | PTS: " << frame->pts
-               << " | DTS: " << frame->pkt_dts
-               << " | Timestamp: " << timestamp << "s"
-               << " | Resolution: " << frame->width << "x" << frame->height
-               //<< " | Frame Size: " << frame_size << " bytes"
-               //<< " | Estimated Buffer Size: " << buffer_size << " bytes"
-               << " | Pixel fmt: " << (pix_fmt_name ? pix_fmt_name : "unknown")
-               << " | Decoded frm MD5: " << md5string
-               << "\n";
-         } else {
-            std::cout << "Frame #" << frame_number++
-               << " | Type: " << pict_type_char
-               << " | PTS: " << frame->pts
-               << " | DTS: " << frame->pkt_dts
-               << " | Timestamp: " << timestamp << "s"
-               << " | Resolution: " << frame->width << "x" << frame->height
-               << " | Pixel fmt: " << (pix_fmt_name ? pix_fmt_name : "unknown")
-               << "\n";
-         }
-
-         // Update the current_pos here
-         if (frame->pts != AV_NOPTS_VALUE) {
-            current_pos = av_rescale_q(frame->pts,
-                  fmt_ctx->streams[video_stream_index]->time_base,
-                  AV_TIME_BASE_Q);
-         }
+      // Decoder chatter is unreadable in headless runs unless asked for with -v.
+      static void setHeadlessLogLevel() {
+         if (!loglevel)
+            av_log_set_level(AV_LOG_ERROR);
+         else if (strncmp(loglevel, "trace", 5) == 0)
+            av_log_set_level(AV_LOG_TRACE);
+         else if (strncmp(loglevel, "debug", 5) == 0)
+            av_log_set_level(AV_LOG_DEBUG);
+         else
+            av_log_set_level(AV_LOG_INFO);
+      }
 
-         if (frame->decode_error_flags) {
-            if (frame->decode_error_flags & FF_DECODE_ERROR_INVALID_BITSTREAM)
-               std::cout << "[WARNING] Invalid Bitstream!!!! \n";
-            if (frame->decode_error_flags & FF_DECODE_ERROR_MISSING_REFERENCE)
-               std::cout << "[WARNING] Missing Reference!!!! \n";
-            if (frame->decode_error_flags & FF_DECODE_ERROR_CONCEALMENT_ACTIVE) {
-               std::cout << "[WARNING] Error Concealment Used!!!! \n";
-               std::cout << "[Concealment Active] PTS: " << frame->pts << "\n";
-            }
+      // --diff: returns 2 if the decoders diverged, 1 on errors.
+      static int runDiff(const char* input, const DiffOptions& options) {
+         setHeadlessLogLevel();
+         try {
+            LockstepDiff diff(input, options);
+            std::cout << "Diff: A " << diff.decoderName(0) << " | B " << diff.decoderName(1)
+               << " | window " << options.window << " frames\n";
+            const DiffStats& stats = diff.run();
+            diff.printSummary(std::cout);
+            if (stats.read_error)
+               return 1;
+            return stats.diverged() ? 2 : 0;
+         } catch (const std::exception& ex) {
+            std::cerr << "Error: " << ex.what() << "\n";
+            return 1;
          }
       }
 
-      /* Visual artifact detection in frame buffer 
-       * Analyze decoded Y/U/V planes for 
-       * 1. Solid colors 
-       *    Y-plane solid check detects black/green/solid output typical of decoder error Concealment 
-       * 2. Flat regions 
-       *    UV-plane flatness check identifies gray/green block corruption (e.g. U=128, V=128 uniform) 
-       * 3. Dead Pixels or strips 
-       *
+      /* Runs every input to the end without pacing or keyboard, then prints
+       * one summary. Cores are split between files and decoder threads: many
+       * files get one decoder thread each, a handful share the cores.
+       * Returns the process exit code: 1 if any file failed, 2 if any file
+       * showed corruption, 0 otherwise.
        */
-      bool is_hw_frame_corrupt(AVFrame* frame) {
-         // Check known HW output formats 
-         if (frame->format == AV_PIX_FMT_NV12) {
-            // --- Solid Y plane check (black/green/pink screen, etc.)
-            if (frame->data[0] && frame->linesize[0] > 0) {
-               const uint8_t reference = frame->data[0][0];
-               const int stride = frame->linesize[0];
-               const int height = frame->height;
-
-               int solid_count = 0;
-               int sample_lines = std::min(10, height);  // sample only a few lines
-
-               for (int y = 0; y < sample_lines; ++y) {
-                  uint8_t* row = frame->data[0] + y * stride;
-                  bool uniform_line = true;
-
-                  for (int x = 1; x < frame->width; ++x) {
-                     if (row[x] != reference) {
-                        uniform_line = false;
-                        break;
+      static int runBatch(const std::vector<std::string>& files, DecoderType decoder, const char* codecStr,
+            bool enable_hash, SeekerOptions options, int jobs, const std::string& log_dir,
+            const std::string& report_path) {
+         const int cores = std::max(1u, std::thread::hardware_concurrency());
+         if (jobs <= 0)
+            jobs = (decoder == HARDWARE) ? 1 : cores; // HW decoders have few instances
+         jobs = std::max(1, std::min<int>(jobs, files.size()));
+         if (options.decoder_threads <= 0 && decoder == SOFTWARE)
+            options.decoder_threads = std::max(1, cores / jobs);
+         if (options.hash_threads <= 0)
+            options.hash_threads = 1;
+         if (options.mem_budget) // split evenly, so concurrent files can't starve each other
+            options.mem_budget = std::max<uint64_t>(options.mem_budget / jobs, 1 << 20);
+         options.interactive = false;
+         options.log_events = !log_dir.empty();
+         // one process-wide line/file would be overwritten by every file
+         options.stats_interval = 0;
+         options.prometheus_file.clear();
+
+         setHeadlessLogLevel();
+         std::cout << "Batch: " << files.size() << " files, " << jobs << " jobs, "
+            << options.decoder_threads << " decoder threads each";
+         if (options.mem_budget)
+            std::cout << ", " << (options.mem_budget >> 20) << " MiB memory budget each";
+         std::cout << "\n";
+
+         // longest first, so the big files don't end up last on a single worker
+         std::vector<size_t> order(files.size());
+         std::vector<off_t> sizes(files.size(), 0);
+         for (size_t i = 0; i < files.size(); i++) {
+            struct stat st;
+            if (stat(files[i].c_str(), &st) == 0)
+               sizes[i] = st.st_size;
+            order[i] = i;
+         }
+         std::stable_sort(order.begin(), order.end(),
+               [&sizes](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+         std::vector<BatchResult> results(files.size());
+         std::mutex progress_mutex;
+         size_t finished = 0;
+         const char* log_ext = options.log_format == LOG_JSON ? ".jsonl"
+            : options.log_format == LOG_BINARY ? ".bin" : ".log";
+         auto start = std::chrono::steady_clock::now();
+         {
+            WorkStealingPool pool(jobs);
+            for (size_t k = 0; k < order.size(); k++) {
+               const size_t i = order[k];
+               pool.submit([&, i] {
+                  BatchResult& result = results[i];
+                  result.path = files[i];
+                  SeekerOptions job_options = options;
+                  if (!log_dir.empty()) {
+                     std::string base = files[i].substr(files[i].find_last_of('/') + 1);
+                     char prefix[16];
+                     snprintf(prefix, sizeof(prefix), "%05zu_", i);
+                     job_options.log_file = log_dir + "/" + prefix + base + log_ext;
+                  }
+                  auto t0 = std::chrono::steady_clock::now();
+                  try {
+                     FFSeeker seeker(files[i], decoder, codecStr, enable_hash, job_options);
+                     seeker.run();
+                     result.stats = seeker.stats();
+                     result.ok = true;
+                  } catch (const std::exception& ex) {
+                     result.error = ex.what();
+                  }
+                  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+                  std::lock_guard<std::mutex> lock(progress_mutex);
+                  ++finished;
+                  if (result.ok && options.scan == SCAN_PACKETS) {
+                     uint64_t packets = 0, anomalies = 0;
+                     for (size_t k = 0; k < result.stats.packet_scan.size(); k++) {
+                        packets += result.stats.packet_scan[k].packets;
+                        anomalies += result.stats.packet_scan[k].anomalies();
                      }
+                     std::cout << "[" << finished << "/" << files.size() << "] " << result.path
+                        << " | packets " << packets << " | anomalies " << anomalies
+                        << " | " << result.seconds << "s\n";
+                  } else if (result.ok) {
+                     std::cout << "[" << finished << "/" << files.size() << "] " << result.path
+                        << " | frames " << result.stats.frames
+                        << " | corrupt " << result.stats.corrupt_frames
+                        << " | visual " << result.stats.visual_corruption;
+                     if (options.sample.kind != SAMPLE_OFF)
+                        std::cout << " | GOPs " << result.stats.damaged_gops << " damaged of "
+                           << result.stats.sampled_gops << "/" << result.stats.total_gops;
+                     std::cout << " | " << result.seconds << "s\n";
+                  } else {
+                     std::cout << "[" << finished << "/" << files.size() << "] " << result.path
+                        << " | FAILED: " << result.error << "\n";
                   }
-
-                  if (uniform_line)
-                     solid_count++;
-               }
-
-               if (solid_count == sample_lines) {
-                  // Very likely a corrupted frame (solid color)
-                  return true;
-               }
+               });
             }
-
-            // Optional: Add U/V plane check for highly compressed color distortions
-            // Example: check U and V planes for flat regions or 0x80 artifacts
-            if (frame->format == AV_PIX_FMT_NV12 && frame->data[1]) {
-               int uv_stride = frame->linesize[1];
-               uint8_t* uv_data = frame->data[1];
-
-               // Just check first row of UV interleaved
-               const uint8_t u0 = uv_data[0];
-               const uint8_t v0 = uv_data[1];
-               bool uv_flat = true;
-
-               for (int x = 2; x < frame->width; x += 2) {
-                  if (uv_data[x] != u0 || uv_data[x + 1] != v0) {
-                     uv_flat = false;
-                     break;
-                  }
-               }
-
-               if (uv_flat) {
-                  // UV too flat → may be gray/green block artifact
-                  return true;
-               }
+            pool.wait();
+         }
+         double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+         uint64_t frames = 0, corrupt = 0, visual = 0, sampled_gops = 0, damaged_gops = 0;
+         size_t failed = 0, damaged = 0;
+         for (size_t i = 0; i < results.size(); i++) {
+            const BatchResult& r = results[i];
+            if (!r.ok) {
+               failed++;
+               continue;
             }
+            frames += r.stats.frames;
+            corrupt += r.stats.corrupt_frames;
+            visual += r.stats.visual_corruption;
+            sampled_gops += r.stats.sampled_gops;
+            damaged_gops += r.stats.damaged_gops;
+            if (r.stats.damaged())
+               damaged++;
          }
 
-         return false;
-      }
-#if 0
-      bool is_hw_frame_corrupt(AVFrame* frame) {
-         // Check for solid-color frames in common HW formats
-         // TODO : handle DRM_PRIME if required
-
-         // if (frame->format == AV_PIX_FMT_DRM_PRIME || frame->format == AV_PIX_FMT_NV12) {
-         if ( frame->format == AV_PIX_FMT_NV12) {
-            // For NV12, check the Y plane (luma) for solid color
-            if (frame->data[0] && frame->linesize[0] > 0) {
-               const int sample_size = 10;
-               const uint8_t first_pixel = frame->data[0][0];
-
-               // Sample top-left corner pixels
-               for (int i = 0; i < sample_size; i++) {
-                  if (frame->data[0][i] != first_pixel) 
-                     return false;
+         std::cout << "\n=== Batch summary ===\n"
+            << "Files: " << results.size() << " | failed: " << failed << " | with corruption: " << damaged << "\n"
+            << "Frames: " << frames << " | corrupt: " << corrupt << " | visual corruption: " << visual << "\n"
+            << "Wall time: " << wall << "s | " << (wall > 0 ? frames / wall : 0) << " fps aggregate\n"
+            << "Peak RSS: " << (peakRssBytes() >> 20) << " MiB\n";
+         if (options.sample.kind != SAMPLE_OFF) {
+            const RateEstimate est = wilsonInterval(damaged_gops, sampled_gops);
+            char line[160];
+            snprintf(line, sizeof(line), "Sampled GOPs: %llu | damaged: %llu | rate %.2f%% (95%% CI %.2f-%.2f%%)\n",
+                  static_cast<unsigned long long>(sampled_gops), static_cast<unsigned long long>(damaged_gops),
+                  est.rate * 100, est.low * 100, est.high * 100);
+            std::cout << line;
+         }
+         for (size_t i = 0; i < results.size(); i++) {
+            const BatchResult& r = results[i];
+            if (!r.ok)
+               std::cout << "  FAILED  " << r.path << ": " << r.error << "\n";
+            else if (r.stats.damaged()) {
+               std::cout << "  CORRUPT " << r.path << " (" << r.stats.corrupt_frames << " flagged, "
+                  << r.stats.visual_corruption << " visual, " << r.stats.read_errors << " read errors";
+               if (r.stats.temporal_freezes || r.stats.temporal_flashes || r.stats.temporal_tears)
+                  std::cout << ", " << r.stats.temporal_freezes << " freezes, " << r.stats.temporal_flashes
+                     << " flashes, " << r.stats.temporal_tears << " tears";
+               for (size_t k = 0; k < r.stats.streams.size(); k++) {
+                  const StreamStats& st = r.stats.streams[k];
+                  if (st.damaged())
+                     std::cout << "; stream #" << st.index << " " << st.corrupt_frames << " flagged, "
+                        << st.decode_errors << " decode errors, " << st.visual_corruption << " visual";
                }
-               return true; // Likely corrupted (solid color)
+               for (size_t k = 0; k < r.stats.packet_scan.size(); k++) {
+                  const PacketScanStats& st = r.stats.packet_scan[k];
+                  if (st.anomalies())
+                     std::cout << "; stream #" << st.index << " " << st.anomalies() << " packet anomalies";
+               }
+               std::cout << ")\n";
             }
          }
-         return false;
-      }
-#endif
-      //blocking
-      char getch() {
-         char buf = 0;
-         struct termios old = {0};
-         tcgetattr(STDIN_FILENO, &old);
-         old.c_lflag &= ~(ICANON | ECHO);
-         tcsetattr(STDIN_FILENO, TCSANOW, &old);
-         read(STDIN_FILENO, &buf, 1);
-         tcsetattr(STDIN_FILENO, TCSANOW, &old);
-         return buf;
-      }
 
-      // Non-blocking use select()
-      // Returns: ascii value of character pressed, or -1 if no input within timeout
-      char getch_select(int timeout_ms = 0) {
-         struct termios oldt, newt;
-         tcgetattr(STDIN_FILENO, &oldt);         // get current terminal settings
-         newt = oldt;
-         newt.c_lflag &= ~(ICANON | ECHO);       // disable canonical mode and echo
-         tcsetattr(STDIN_FILENO, TCSANOW, &newt);// apply new settings immediately
-
-         fd_set readfds;
-         FD_ZERO(&readfds);
-         FD_SET(STDIN_FILENO, &readfds);
-
-         struct timeval tv;
-         tv.tv_sec = timeout_ms / 1000;
-         tv.tv_usec = (timeout_ms % 1000) * 1000;
-
-         char ch = -1;
-         int ret = select(STDIN_FILENO + 1, &readfds, NULL, NULL,
-               (timeout_ms >= 0 ? &tv : NULL)); // NULL means wait indefinitely
-
-         if (ret > 0 && FD_ISSET(STDIN_FILENO, &readfds)) {
-            char buf;
-            if (read(STDIN_FILENO, &buf, 1) == 1) {
-               ch = static_cast<unsigned char>(buf);
-            }
-         }
-         tcsetattr(STDIN_FILENO, TCSANOW, &oldt); // restore original terminal settings
-         return ch;
+         if (!report_path.empty() &&
+               !writeBatchReport(report_path, results, jobs, options.decoder_threads, wall, options.temporal,
+                  options.sample.kind != SAMPLE_OFF))
+            std::cerr << "Error: Failed to write report " << report_path << "\n";
+
+         if (failed)
+            return 1;
+         return damaged ? 2 : 0;
       }
-      };
 
       // Main
       int main(int argc, char* argv[]) {
@@ -580,9 +500,110 @@ class FFmpegDemuxSeeker {
          const char* enable_hash_str = nullptr;
          DecoderType decoder = SOFTWARE;
          bool enable_hash = false;
+         SeekerOptions options;
+         std::vector<std::string> batch_inputs;
+         int batch_jobs = 0;
+         std::string log_dir, report_path;
+         bool pace_set = false, index_set = false;
+         bool diff_mode = false;
+         std::string control_socket; // --control-socket, single playback only
+         DiffOptions diff_options;
+
+         // long-only options
+         enum {
+            OPT_PACE = 256,
+            OPT_HASH_THREADS,
+            OPT_DETECT_STRIDE,
+            OPT_DETECT_KERNEL,
+            OPT_LOG_FORMAT,
+            OPT_LOG_FILE,
+            OPT_INDEX,
+            OPT_SEEK_MODE,
+            OPT_GOP_CACHE_MB,
+            OPT_BATCH,
+            OPT_JOBS,
+            OPT_LOG_DIR,
+            OPT_REPORT,
+            OPT_SEGMENTS,
+            OPT_THREADS,
+            OPT_THREAD_TYPE,
+            OPT_AUTOTUNE,
+            OPT_AUTOTUNE_PACKETS,
+            OPT_FRAME_POOL,
+            OPT_STATS_INTERVAL,
+            OPT_PROMETHEUS,
+            OPT_IO,
+            OPT_IO_BUFFER_MB,
+            OPT_SEEK_SCRIPT,
+            OPT_SEEK_RANDOM,
+            OPT_SEEK_SEQ,
+            OPT_SEED,
+            OPT_STREAMS,
+            OPT_DIFF,
+            OPT_DIFF_WINDOW,
+            OPT_DIFF_PSNR,
+            OPT_HASH_DB,
+            OPT_COMPARE,
+            OPT_STOP_ON_MISMATCH,
+            OPT_SCAN,
+            OPT_CONTROL_SOCKET,
+            OPT_TEMPORAL,
+            OPT_FREEZE_FRAMES,
+            OPT_MEM_BUDGET,
+            OPT_CHECKPOINT,
+            OPT_CHECKPOINT_INTERVAL,
+            OPT_RESUME,
+            OPT_SAMPLE
+         };
+         static const struct option long_options[] = {
+            {"pace", required_argument, nullptr, OPT_PACE},
+            {"hash-threads", required_argument, nullptr, OPT_HASH_THREADS},
+            {"detect-stride", required_argument, nullptr, OPT_DETECT_STRIDE},
+            {"detect-kernel", required_argument, nullptr, OPT_DETECT_KERNEL},
+            {"log-format", required_argument, nullptr, OPT_LOG_FORMAT},
+            {"log-file", required_argument, nullptr, OPT_LOG_FILE},
+            {"index", required_argument, nullptr, OPT_INDEX},
+            {"seek-mode", required_argument, nullptr, OPT_SEEK_MODE},
+            {"gop-cache-mb", required_argument, nullptr, OPT_GOP_CACHE_MB},
+            {"batch", required_argument, nullptr, OPT_BATCH},
+            {"jobs", required_argument, nullptr, OPT_JOBS},
+            {"log-dir", required_argument, nullptr, OPT_LOG_DIR},
+            {"report", required_argument, nullptr, OPT_REPORT},
+            {"segments", required_argument, nullptr, OPT_SEGMENTS},
+            {"threads", required_argument, nullptr, OPT_THREADS},
+            {"thread-type", required_argument, nullptr, OPT_THREAD_TYPE},
+            {"autotune", required_argument, nullptr, OPT_AUTOTUNE},
+            {"autotune-packets", required_argument, nullptr, OPT_AUTOTUNE_PACKETS},
+            {"frame-pool", required_argument, nullptr, OPT_FRAME_POOL},
+            {"stats-interval", required_argument, nullptr, OPT_STATS_INTERVAL},
+            {"prometheus", required_argument, nullptr, OPT_PROMETHEUS},
+            {"io", required_argument, nullptr, OPT_IO},
+            {"io-buffer-mb", required_argument, nullptr, OPT_IO_BUFFER_MB},
+            {"seek-script", required_argument, nullptr, OPT_SEEK_SCRIPT},
+            {"seek-random", required_argument, nullptr, OPT_SEEK_RANDOM},
+            {"seek-seq", required_argument, nullptr, OPT_SEEK_SEQ},
+            {"seed", required_argument, nullptr, OPT_SEED},
+            {"streams", required_argument, nullptr, OPT_STREAMS},
+            {"diff", no_argument, nullptr, OPT_DIFF},
+            {"diff-window", required_argument, nullptr, OPT_DIFF_WINDOW},
+            {"diff-psnr", required_argument, nullptr, OPT_DIFF_PSNR},
+            {"hash-db", required_argument, nullptr, OPT_HASH_DB},
+            {"compare", required_argument, nullptr, OPT_COMPARE},
+            {"stop-on-mismatch", no_argument, nullptr, OPT_STOP_ON_MISMATCH},
+            {"scan", required_argument, nullptr, OPT_SCAN},
+            {"control-socket", required_argument, nullptr, OPT_CONTROL_SOCKET},
+            {"temporal", required_argument, nullptr, OPT_TEMPORAL},
+            {"freeze-frames", required_argument, nullptr, OPT_FREEZE_FRAMES},
+            {"mem-budget", required_argument, nullptr, OPT_MEM_BUDGET},
+            {"checkpoint", required_argument, nullptr, OPT_CHECKPOINT},
+            {"checkpoint-interval", required_argument, nullptr, OPT_CHECKPOINT_INTERVAL},
+            {"resume", no_argument, nullptr, OPT_RESUME},
+            {"sample", required_argument, nullptr, OPT_SAMPLE},
+            {nullptr, 0, nullptr, 0}
+         };
 
          int opt;
-         while ((opt = getopt(argc, argv, "i:d:c:v:m:h")) != -1) {
+         while ((opt = getopt_long(argc, argv, "i:d:c:v:m:h", long_options, nullptr)) != -1) {
             switch (opt) {
                case 'i':
                   inputFile = optarg;
@@ -598,6 +619,222 @@ class FFmpegDemuxSeeker {
                   break;
                case 'v': 
                   loglevel = optarg;
+                  options.log_level = optarg;
+                  break;
+               case OPT_PACE:
+                  if (!parsePaceMode(optarg, options.pace_mode, options.pace_fps)) {
+                     std::cerr << "Error: Invalid --pace '" << optarg
+                        << "'. Must be none, realtime or fps=N.\n";
+                     return 1;
+                  }
+                  pace_set = true;
+                  break;
+               case OPT_HASH_THREADS:
+                  options.hash_threads = atoi(optarg);
+                  break;
+               case OPT_DETECT_STRIDE:
+                  options.detect_stride = atoi(optarg);
+                  break;
+               case OPT_DETECT_KERNEL:
+                  if (!selectFlatRowKernel(optarg)) {
+                     std::cerr << "Error: detector kernel '" << optarg
+                        << "' is not available on this CPU.\n";
+                     return 1;
+                  }
+                  options.detect_kernel = optarg;
+                  break;
+               case OPT_TEMPORAL:
+                  options.temporal = strcmp(optarg, "on") == 0;
+                  if (!options.temporal && strcmp(optarg, "off") != 0) {
+                     std::cerr << "Error: --temporal must be on or off\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_FREEZE_FRAMES:
+                  options.freeze_frames = atoi(optarg);
+                  if (options.freeze_frames < 2) {
+                     std::cerr << "Error: --freeze-frames must be at least 2\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_CHECKPOINT:
+                  options.checkpoint = optarg;
+                  break;
+               case OPT_CHECKPOINT_INTERVAL:
+                  options.checkpoint_interval = atof(optarg);
+                  break;
+               case OPT_RESUME:
+                  options.resume = true;
+                  break;
+               case OPT_SAMPLE:
+                  if (!parseSamplePlan(optarg, options.sample)) {
+                     std::cerr << "Error: --sample must be every=N or gops=K\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_MEM_BUDGET:
+                  if (!parseByteSize(optarg, options.mem_budget)) {
+                     std::cerr << "Error: --mem-budget takes a size like 256M or 2G\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_LOG_FORMAT:
+                  if (!parseLogFormat(optarg, options.log_format)) {
+                     std::cerr << "Error: Invalid --log-format '" << optarg
+                        << "'. Must be text, json or binary.\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_LOG_FILE:
+                  options.log_file = optarg;
+                  break;
+               case OPT_INDEX:
+                  index_set = true;
+                  if (!strcmp(optarg, "off")) {
+                     options.index_mode = INDEX_OFF;
+                  } else if (!strcmp(optarg, "auto")) {
+                     options.index_mode = INDEX_AUTO;
+                  } else if (!strcmp(optarg, "build")) {
+                     options.index_mode = INDEX_BUILD;
+                  } else {
+                     std::cerr << "Error: Invalid --index '" << optarg
+                        << "'. Must be auto, build or off.\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_SEEK_MODE:
+                  if (!strcmp(optarg, "key")) {
+                     options.seek_mode = SEEK_KEY;
+                  } else if (!strcmp(optarg, "exact")) {
+                     options.seek_mode = SEEK_EXACT;
+                  } else {
+                     std::cerr << "Error: Invalid --seek-mode '" << optarg
+                        << "'. Must be key or exact.\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_GOP_CACHE_MB:
+                  options.gop_cache_mb = atoi(optarg);
+                  break;
+               case OPT_BATCH:
+                  batch_inputs.push_back(optarg);
+                  break;
+               case OPT_JOBS:
+                  batch_jobs = atoi(optarg);
+                  break;
+               case OPT_LOG_DIR:
+                  log_dir = optarg;
+                  break;
+               case OPT_REPORT:
+                  report_path = optarg;
+                  break;
+               case OPT_SEGMENTS:
+                  options.segments = atoi(optarg);
+                  break;
+               case OPT_THREADS:
+                  options.decoder_threads = atoi(optarg);
+                  break;
+               case OPT_THREAD_TYPE:
+                  if (!parseThreadType(optarg, options.thread_type)) {
+                     std::cerr << "Error: Invalid --thread-type '" << optarg
+                        << "'. Must be frame, slice or auto.\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_AUTOTUNE:
+                  if (!parseTuneGoal(optarg, options.autotune)) {
+                     std::cerr << "Error: Invalid --autotune '" << optarg
+                        << "'. Must be fps, latency or off.\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_AUTOTUNE_PACKETS:
+                  options.autotune_packets = atoi(optarg);
+                  break;
+               case OPT_FRAME_POOL:
+                  if (!strcmp(optarg, "on")) {
+                     options.frame_pool = true;
+                  } else if (!strcmp(optarg, "off")) {
+                     options.frame_pool = false;
+                  } else {
+                     std::cerr << "Error: Invalid --frame-pool '" << optarg << "'. Must be on or off.\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_STATS_INTERVAL:
+                  options.stats_interval = atof(optarg);
+                  break;
+               case OPT_PROMETHEUS:
+                  options.prometheus_file = optarg;
+                  break;
+               case OPT_IO:
+                  if (!parseIoMode(optarg, options.io_mode)) {
+                     std::cerr << "Error: Invalid --io '" << optarg
+                        << "'. Must be default, mmap, readahead or stream.\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_IO_BUFFER_MB:
+                  options.io_buffer_mb = atoi(optarg);
+                  break;
+               case OPT_SEEK_SCRIPT: {
+                  std::string error;
+                  options.seek_plan.script.clear();
+                  if (!loadSeekScript(optarg, options.seek_plan.script, error)) {
+                     std::cerr << "Error: --seek-script: " << error << "\n";
+                     return 1;
+                  }
+                  options.seek_plan.kind = PLAN_SCRIPT;
+                  break;
+               }
+               case OPT_SEEK_RANDOM:
+               case OPT_SEEK_SEQ:
+                  options.seek_plan.kind = opt == OPT_SEEK_RANDOM ? PLAN_RANDOM : PLAN_SEQUENTIAL;
+                  options.seek_plan.count = atoi(optarg);
+                  if (options.seek_plan.count <= 0) {
+                     std::cerr << "Error: --seek-random / --seek-seq need a positive count\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_SEED:
+                  options.seek_plan.seed = strtoull(optarg, nullptr, 10);
+                  break;
+               case OPT_DIFF:
+                  diff_mode = true;
+                  break;
+               case OPT_DIFF_WINDOW:
+                  diff_options.window = atoi(optarg);
+                  if (diff_options.window <= 0) {
+                     std::cerr << "Error: --diff-window must be positive\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_DIFF_PSNR:
+                  diff_options.psnr_threshold = atof(optarg);
+                  break;
+               case OPT_CONTROL_SOCKET:
+                  control_socket = optarg;
+                  break;
+               case OPT_SCAN:
+                  if (!parseScanLevel(optarg, options.scan)) {
+                     std::cerr << "Error: --scan must be packets, keyframes or full\n";
+                     return 1;
+                  }
+                  break;
+               case OPT_HASH_DB:
+                  options.hash_db = optarg;
+                  break;
+               case OPT_COMPARE:
+                  options.compare_db = optarg;
+                  break;
+               case OPT_STOP_ON_MISMATCH:
+                  options.stop_on_mismatch = true;
+                  break;
+               case OPT_STREAMS:
+                  if (!parseStreamSelection(optarg, options.streams)) {
+                     std::cerr << "Error: --streams must be all or a list like v:0,a:1\n";
+                     return 1;
+                  }
                   break;
                case 'h':
                default:
@@ -606,8 +843,12 @@ class FFmpegDemuxSeeker {
                   return 1;
             }
          }
+         // extra arguments are batch inputs
+         for (int i = optind; i < argc; i++)
+            batch_inputs.push_back(argv[i]);
+
          //check options
-         if (!inputFile || !decoderStr || !codecStr ||!enable_hash_str) {
+         if ((!inputFile && batch_inputs.empty()) || !decoderStr || !codecStr ||!enable_hash_str) {
             std::cerr << "Error: Missing required options -i and/or -d\n";
             std::cerr << "Usage: " << argv[0]
                << " -i <input_file> -d <HW|SW> [-c <codec>]\n";
@@ -619,7 +860,55 @@ class FFmpegDemuxSeeker {
             std::cerr << "\t -d Decoder type HW or SW \n";
             std::cerr << "\t -c ffmpeg codec to use (for SW decode use auto ) \n";
             std::cerr << "\t -v verbose level ( info ,debug, trace )\n";
-            std::cerr << "\t -m md5sum of each frame (slower for high bitrate media )\n";
+            std::cerr << "\t -m hash of each frame: true|md5, crc32, xxh64 or false (hashed on worker threads)\n";
+            std::cerr << "\t --hash-threads N  hash worker threads (default: half the cores)\n";
+            std::cerr << "\t --detect-stride N  corruption detector checks every Nth row (default 8)\n";
+            std::cerr << "\t --detect-kernel auto|scalar|sse2|avx2|neon  corruption detector kernel\n";
+            std::cerr << "\t --temporal on|off  frozen frame, flash and tear detection across frames (default off)\n";
+            std::cerr << "\t --freeze-frames N  identical frames after motion that count as frozen (default 5)\n";
+            std::cerr << "\t --pace none|realtime|fps=N  output pacing of video frames (default realtime)\n";
+            std::cerr << "\t --log-format text|json|binary  per-frame event log format (default text)\n";
+            std::cerr << "\t --log-file <path>  write the event log to a file instead of stdout\n";
+            std::cerr << "\t --index auto|build|off  keyframe index sidecar (<input>.kfidx) for seeks (default auto)\n";
+            std::cerr << "\t --seek-mode key|exact  land seeks on the keyframe or on the exact time (default key)\n";
+            std::cerr << "\t --gop-cache-mb N  decoded GOP cache for repeated seeks, 0 = off (default 256 with exact, else 0)\n";
+            std::cerr << "\t --threads N  decoder threads (default: libavcodec, one per core)\n";
+            std::cerr << "\t --thread-type frame|slice|auto  decoder threading; frame adds latency, slice keeps it low\n";
+            std::cerr << "\t --autotune fps|latency  time a few thread setups on the first packets and keep the best\n";
+            std::cerr << "\t --autotune-packets N  packets decoded per auto-tune candidate (default 200)\n";
+            std::cerr << "\t --frame-pool on|off  pooled frame buffers for SW decoders (default on)\n";
+            std::cerr << "\t --mem-budget SIZE  cap on queued packets + frames waiting for hashing, e.g. 256M (batch: split per job)\n";
+            std::cerr << "\t --stats-interval SEC  print per-stage latency percentiles and counters every SEC seconds (stderr)\n";
+            std::cerr << "\t --prometheus <path>  export stage histograms and counters in Prometheus text format\n";
+            std::cerr << "\t --io default|mmap|readahead|stream  demuxer I/O layer (default: libavformat file I/O)\n";
+            std::cerr << "\t --io-buffer-mb N  read-ahead window for --io readahead (default 32)\n";
+            std::cerr << "\t --control-socket <path>  also take commands on a Unix socket, one per line:\n"
+               << "\t\t seek +N|-N|SEC, pause, resume, step [N], stats, quit\n";
+            std::cerr << "\t --checkpoint <file>  save the resume point ( clean keyframe, frame number, totals ) atomically\n";
+            std::cerr << "\t --checkpoint-interval SEC  seconds between checkpoints (default 30)\n";
+            std::cerr << "\t --resume  continue from --checkpoint after a crash: seek to its keyframe, keep numbering and totals\n";
+            std::cerr << "\t --scan packets|keyframes|full  triage: demux-only integrity checks, keyframes only, or everything (default full)\n";
+            std::cerr << "\t --streams all|v:N,a:N  also decode these video/audio streams, one thread each (default: first video only)\n";
+            std::cerr << "\t --segments N  decode N keyframe-aligned ranges of the file in parallel (no pacing, no controls)\n";
+            std::cerr << "\t --sample every=N|gops=K  decode every Nth GOP, or K GOPs spread over the duration, and\n"
+               << "\t\t estimate the damaged GOP rate (95% Wilson interval); exit code 2 on damage\n";
+            std::cerr << "Seek stress ( headless, no pacing, exit code 2 if a seek failed or landed wrong ):\n";
+            std::cerr << "\t --seek-script <file>  seeks to run, one per line: seconds, +N or -N\n";
+            std::cerr << "\t --seek-random N  N random seeks ( --seed S, default 1 )\n";
+            std::cerr << "\t --seek-seq N  N forward seeks evenly spread over the file\n";
+            std::cerr << "Frame hash database ( implies hashing, md5 unless -m picks another ):\n";
+            std::cerr << "\t --hash-db <path>  write PTS, type, flags and digest of every frame ( 32 bytes each )\n";
+            std::cerr << "\t --compare <golden>  check every frame against a --hash-db file; exit code 2 on mismatch\n";
+            std::cerr << "\t --stop-on-mismatch  quit at the first frame that differs from the golden run\n";
+            std::cerr << "Decoder diff ( headless, exit code 2 on divergence ):\n";
+            std::cerr << "\t --diff  decode with the SW decoder and the -c decoder side by side and compare every frame\n";
+            std::cerr << "\t --diff-window N  frames per decoder waiting for their PTS partner (default 8)\n";
+            std::cerr << "\t --diff-psnr DB  minimum PSNR when the two pixel formats differ (default 40)\n";
+            std::cerr << "Batch mode ( headless, no pacing ):\n";
+            std::cerr << "\t --batch <file|dir|@manifest>  validate many inputs; repeatable, extra arguments are inputs too\n";
+            std::cerr << "\t --jobs N  files decoded concurrently (default: all cores for SW, 1 for HW)\n";
+            std::cerr << "\t --log-dir <dir>  per-file event logs (default: only the summary)\n";
+            std::cerr << "\t --report <path>  write the aggregated report as JSON\n";
             return 1;
          }
          // Validate decoder option and codec option
@@ -633,22 +922,138 @@ class FFmpegDemuxSeeker {
 
             return 1;
          }
-         if (strncmp(enable_hash_str, "true", 4) == 0) {
+         if (parseHashAlgo(enable_hash_str, options.hash_algo)) {
             enable_hash = true;
+         } else if (strncmp(enable_hash_str, "false", 5) != 0) {
+            std::cerr << "Error: Invalid -m '" << enable_hash_str
+               << "'. Must be true, md5, crc32, xxh64 or false.\n";
+            return 1;
          }
 
-         saveTerminalSettings();
+         if (!options.hash_db.empty() || !options.compare_db.empty()) {
+            if (!batch_inputs.empty()) {
+               std::cerr << "Error: --hash-db / --compare work on a single input\n";
+               return 1;
+            }
+            enable_hash = true; // digests are what gets stored and compared
+         }
 
+         const bool seek_stress = options.seek_plan.kind != PLAN_NONE;
+         if (options.scan == SCAN_PACKETS && (seek_stress || options.segments > 1 || diff_mode)) {
+            std::cerr << "Error: --scan packets reads the file once, without seeks, segments or --diff\n";
+            return 1;
+         }
+         if (options.temporal && options.scan != SCAN_FULL) {
+            std::cerr << "Error: --temporal compares consecutive frames and needs --scan full\n";
+            return 1;
+         }
+         if (options.temporal && options.segments > 1) {
+            std::cerr << "Error: --temporal needs every frame in order, a segment's detector would miss its seams\n";
+            return 1;
+         }
+         const bool sampling = options.sample.kind != SAMPLE_OFF;
+         if (sampling && (seek_stress || diff_mode || options.segments > 1 || options.scan == SCAN_PACKETS ||
+                  !options.checkpoint.empty() || !options.compare_db.empty() || !control_socket.empty() ||
+                  options.streams.all || !options.streams.specs.empty())) {
+            std::cerr << "Error: --sample seeks through the primary video stream on its own, not with seek stress, --diff, "
+               "--segments, --scan packets, --checkpoint, --compare, --control-socket or --streams\n";
+            return 1;
+         }
+         if ((options.scan != SCAN_FULL || sampling) && !pace_set)
+            options.pace_mode = PACE_NONE; // triage runs at disk / decoder speed
+         if (!control_socket.empty() && (seek_stress || diff_mode || !batch_inputs.empty() ||
+                  options.segments > 1 || options.scan == SCAN_PACKETS)) {
+            std::cerr << "Error: --control-socket drives a single playback, not batch, segments, seek stress, --diff or --scan packets\n";
+            return 1;
+         }
+         if (seek_stress && (!batch_inputs.empty() || options.segments > 1)) {
+            std::cerr << "Error: seek stress runs on a single input without --segments\n";
+            return 1;
+         }
+         if (options.resume && options.checkpoint.empty()) {
+            std::cerr << "Error: --resume needs --checkpoint <file>\n";
+            return 1;
+         }
+         if (!options.checkpoint.empty() && (seek_stress || diff_mode || !batch_inputs.empty() ||
+                  options.segments > 1 || options.scan == SCAN_PACKETS)) {
+            std::cerr << "Error: --checkpoint follows one sequential decode, not batch, segments, seek stress, --diff or --scan packets\n";
+            return 1;
+         }
+         if (!options.checkpoint.empty() && (!options.compare_db.empty() ||
+                  options.streams.all || !options.streams.specs.empty())) {
+            std::cerr << "Error: --checkpoint does not save --compare coverage or --streams totals, run those without it\n";
+            return 1;
+         }
+
+         if (diff_mode) {
+            if (!batch_inputs.empty() || seek_stress || options.segments > 1) {
+               std::cerr << "Error: --diff runs on a single input without --batch, --segments or seek stress\n";
+               return 1;
+            }
+            if (strcmp(codecStr, "auto") == 0) {
+               std::cerr << "Error: --diff compares against the decoder named with -c ( e.g. -d HW -c h264_v4l2m2m )\n";
+               return 1;
+            }
+            diff_options.codec = codecStr;
+            diff_options.hash_algo = options.hash_algo;
+            diff_options.decoder_threads = options.decoder_threads;
+            diff_options.io_mode = options.io_mode;
+            diff_options.io_window = static_cast<size_t>(std::max(1, options.io_buffer_mb)) << 20;
+            return runDiff(inputFile, diff_options);
+         }
+
+         if (!batch_inputs.empty()) {
+            if (inputFile)
+               batch_inputs.insert(batch_inputs.begin(), inputFile);
+            std::vector<std::string> files;
+            if (!collectBatchInputs(batch_inputs, files))
+               return 1;
+            if (files.empty()) {
+               std::cerr << "Error: No input files found\n";
+               return 1;
+            }
+            if (!pace_set)
+               options.pace_mode = PACE_NONE;
+            if (!index_set)
+               options.index_mode = INDEX_OFF; // don't litter the corpus with sidecars
+            return runBatch(files, decoder, codecStr, enable_hash, options, batch_jobs, log_dir, report_path);
+         }
+
+         if (options.segments > 1 && options.decoder_threads <= 0 && decoder == SOFTWARE)
+            options.decoder_threads = std::max(1u, std::thread::hardware_concurrency() / options.segments);
+
+         if (seek_stress) {
+            options.interactive = false;
+            options.log_events = !options.log_file.empty(); // per-frame lines would drown the summary
+            if (!pace_set)
+               options.pace_mode = PACE_NONE;
+            setHeadlessLogLevel();
+            try {
+               FFSeeker seeker(inputFile, decoder, codecStr, enable_hash, options);
+               seeker.run();
+               return (seeker.seekStressFailures() || seeker.stats().hash_mismatches) ? 2 : 0;
+            } catch (const std::exception& ex) {
+               std::cerr << "Error: " << ex.what() << "\n";
+               return 1;
+            }
+         }
 
+         uint64_t hash_mismatches = 0;
+         bool suspicious = false;
          try {
-            FFmpegDemuxSeeker demux_seeker(inputFile, decoder, codecStr, enable_hash);
-            demux_seeker.run();
+            FFSeeker seeker(inputFile, decoder, codecStr, enable_hash, options);
+            // segments, samples and packet scans run unattended
+            std::unique_ptr<ControlSession> control;
+            if (options.segments <= 1 && options.scan != SCAN_PACKETS && !sampling)
+               control.reset(new ControlSession(seeker, control_socket));
+            const SeekerStats& stats = seeker.run();
+            control.reset(); // terminal back to normal before the summaries
+            hash_mismatches = stats.hash_mismatches;
+            suspicious = (options.scan != SCAN_FULL || sampling) && stats.damaged();
          } catch (const std::exception& ex) {
             std::cerr << "Error: " << ex.what() << "\n";
-            cleanupKeyboard();
             return 1;
          }
 
-         cleanupKeyboard();
-         return 0;
+         return (hash_mismatches || suspicious) ? 2 : 0;
       }
@@ -0,0 +1,468 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "stage_metrics.h"
+#include "ffseeker_types.h"
+
+inline bool parseLogFormat(const std::string& name, LogFormat& format) {
+   if (name == "text")
+      format = LOG_TEXT;
+   else if (name == "json")
+      format = LOG_JSON;
+   else if (name == "binary")
+      format = LOG_BINARY;
+   else
+      return false;
+   return true;
+}
+
+inline void setRecordText(LogRecord& record, const char* text) {
+   strncpy(record.text, text, sizeof(record.text) - 1);
+   record.text[sizeof(record.text) - 1] = '\0';
+}
+
+/* Asynchronous event log.
+ *
+ * push() is lock-free and wait-free for practical purposes: it claims a slot
+ * in a bounded multi-producer ring (per-slot sequence numbers, Vyukov style)
+ * and never blocks. When the ring is full the record is dropped and counted.
+ * A single writer thread drains the ring in batches, formats them and issues
+ * one write per batch, timed into `write_latency` when one is given.
+ * A `sink` sees every record in order on the writer thread, before it is
+ * formatted; with a null `out` it is the only consumer.
+ * sync() is the one blocking call, for checkpoints (one caller at a time).
+ */
+class EventLog {
+   public:
+      typedef std::function<void(const LogRecord& record)> Sink;
+
+      EventLog(LogFormat format, FILE* out, size_t capacity = 1 << 16, LatencyHistogram* write_latency = nullptr,
+            const Sink& sink = Sink())
+      : format(format),
+        out(out),
+        write_latency(write_latency),
+        sink(sink),
+        err(out == stdout ? stderr : out),
+        cells(roundUp(capacity)),
+        mask(cells.size() - 1),
+        enqueue_pos(0),
+        dequeue_pos(0),
+        dropped_records(0),
+        written_records(0),
+        running(true),
+        sync_requested(false),
+        sync_target(0),
+        sync_done(false),
+        sync_ok(false),
+        sync_offset(-1),
+        writer_exited(false)
+      {
+         for (size_t i = 0; i < cells.size(); i++)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+         if (format == LOG_BINARY && out)
+            writeBinaryHeader();
+         writer = std::thread(&EventLog::writerLoop, this);
+      }
+
+      ~EventLog() { stop(); }
+
+      EventLog(const EventLog&) = delete;
+      EventLog& operator=(const EventLog&) = delete;
+
+      bool push(const LogRecord& record) {
+         size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+         for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+               if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                  cell.record = record;
+                  cell.seq.store(pos + 1, std::memory_order_release);
+                  return true;
+               }
+            } else if (diff < 0) {
+               dropped_records.fetch_add(1, std::memory_order_relaxed);
+               return false; // full: the writer is behind
+            } else {
+               pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+         }
+      }
+
+      // Drains everything queued so far and joins the writer.
+      void stop() {
+         if (!running.exchange(false))
+            return;
+         writer.join();
+         if (out)
+            fflush(out);
+         if (dropped())
+            fprintf(stderr, "[Log] %llu records dropped (writer fell behind)\n",
+                  static_cast<unsigned long long>(dropped()));
+      }
+
+      /* Waits until every record pushed before the call is written, then
+       * flushes and fsyncs `out`; `offset` is its file position right after
+       * them, later records not included. False if `out` is not a file.
+       */
+      bool sync(int64_t& offset) {
+         if (!out)
+            return false;
+         std::unique_lock<std::mutex> lock(sync_mutex);
+         sync_target = enqueue_pos.load(std::memory_order_acquire);
+         sync_done = false;
+         sync_requested.store(true, std::memory_order_release);
+         sync_cv.wait(lock, [this] { return sync_done || writer_exited; });
+         sync_requested.store(false, std::memory_order_relaxed);
+         if (!sync_done)
+            return false;
+         offset = sync_offset;
+         return sync_ok;
+      }
+
+      uint64_t dropped() const { return dropped_records.load(std::memory_order_relaxed); }
+      uint64_t written() const { return written_records.load(std::memory_order_relaxed); }
+
+   private:
+      struct Cell {
+         std::atomic<size_t> seq;
+         LogRecord record;
+      };
+
+      static const size_t BATCH = 512;
+
+      LogFormat format;
+      FILE* out;
+      LatencyHistogram* write_latency;
+      Sink sink;
+      FILE* err; // text mode: corruption/errors go to stderr when logging to stdout
+      std::vector<Cell> cells;
+      const size_t mask;
+      std::atomic<size_t> enqueue_pos;
+      char pad[64];                   // keep producer and writer positions on separate cache lines
+      size_t dequeue_pos; // writer only
+      std::atomic<uint64_t> dropped_records;
+      std::atomic<uint64_t> written_records;
+      std::atomic<bool> running;
+      // sync() handshake; the writer stops its batches at sync_target
+      std::mutex sync_mutex;
+      std::condition_variable sync_cv;
+      std::atomic<bool> sync_requested;
+      size_t sync_target;   // published by sync_requested
+      bool sync_done;       // under sync_mutex, like the two below
+      bool sync_ok;
+      int64_t sync_offset;
+      bool writer_exited;
+      std::thread writer;
+
+      static size_t roundUp(size_t n) {
+         size_t p = 2;
+         while (p < n)
+            p <<= 1;
+         return p;
+      }
+
+      bool pop(LogRecord& record) {
+         Cell& cell = cells[dequeue_pos & mask];
+         size_t seq = cell.seq.load(std::memory_order_acquire);
+         if (seq != dequeue_pos + 1)
+            return false;
+         record = cell.record;
+         cell.seq.store(dequeue_pos + mask + 1, std::memory_order_release);
+         dequeue_pos++;
+         return true;
+      }
+
+      void writerLoop() {
+         std::vector<LogRecord> batch(BATCH);
+         std::string text, errors;
+         for (;;) {
+            // read `running` before draining so nothing pushed before stop() is lost
+            bool last = !running.load(std::memory_order_acquire);
+            const bool syncing = sync_requested.load(std::memory_order_acquire);
+            size_t n = 0;
+            while (n < BATCH && !(syncing && dequeue_pos == sync_target) && pop(batch[n]))
+               n++;
+
+            if (n) {
+               const uint64_t start = write_latency ? StageMetrics::now() : 0;
+               writeBatch(batch.data(), n, text, errors);
+               if (write_latency)
+                  write_latency->record(StageMetrics::now() - start);
+               written_records.fetch_add(n, std::memory_order_relaxed);
+               continue;
+            }
+            if (syncing && dequeue_pos == sync_target) {
+               finishSync();
+               continue;
+            }
+            if (last) {
+               std::lock_guard<std::mutex> lock(sync_mutex);
+               writer_exited = true;
+               sync_cv.notify_all();
+               return;
+            }
+            if (out)
+               fflush(out);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+         }
+      }
+
+      void finishSync() {
+         const bool flushed = fflush(out) == 0 && fsync(fileno(out)) == 0;
+         const int64_t offset = flushed ? static_cast<int64_t>(ftello(out)) : -1;
+         std::lock_guard<std::mutex> lock(sync_mutex);
+         sync_ok = flushed && offset >= 0;
+         sync_offset = offset;
+         sync_done = true;
+         sync_requested.store(false, std::memory_order_relaxed);
+         sync_cv.notify_all();
+      }
+
+      void writeBatch(const LogRecord* records, size_t n, std::string& text, std::string& errors) {
+         if (sink) {
+            for (size_t i = 0; i < n; i++)
+               sink(records[i]);
+         }
+         if (!out)
+            return;
+         if (format == LOG_BINARY) {
+            fwrite(records, sizeof(LogRecord), n, out);
+            return;
+         }
+         text.clear();
+         errors.clear();
+         for (size_t i = 0; i < n; i++) {
+            if (format == LOG_JSON)
+               formatJson(records[i], text);
+            else
+               formatText(records[i], text, err == out ? text : errors);
+         }
+         fwrite(text.data(), 1, text.size(), out);
+         if (!errors.empty()) {
+            fflush(out);
+            fwrite(errors.data(), 1, errors.size(), err);
+         }
+      }
+
+      void writeBinaryHeader() {
+         const char magic[8] = {'F', 'F', 'S', 'K', 'L', 'O', 'G', '1'};
+         uint32_t header[2] = {1, static_cast<uint32_t>(sizeof(LogRecord))}; // version, record size
+         fwrite(magic, 1, sizeof(magic), out);
+         fwrite(header, sizeof(header), 1, out);
+      }
+
+      __attribute__((format(printf, 2, 3)))
+      static void append(std::string& s, const char* fmt, ...) {
+         char buf[256];
+         va_list args;
+         va_start(args, fmt);
+         int len = vsnprintf(buf, sizeof(buf), fmt, args);
+         va_end(args);
+         if (len > 0)
+            s.append(buf, std::min<size_t>(len, sizeof(buf) - 1));
+      }
+
+      // fixed-size results so formatting a record never touches the heap
+      struct DigestHex { char str[2 * sizeof(LogRecord::digest) + 1]; };
+      struct JsonText { char str[2 * sizeof(LogRecord::text)]; };
+
+      static DigestHex digestHex(const LogRecord& r) {
+         static const char digits[] = "0123456789abcdef";
+         DigestHex hex;
+         int len = std::min<int>(r.digest_len, sizeof(r.digest));
+         for (int i = 0; i < len; i++) {
+            hex.str[i * 2] = digits[r.digest[i] >> 4];
+            hex.str[i * 2 + 1] = digits[r.digest[i] & 0xf];
+         }
+         if (len)
+            hex.str[len * 2] = '\0';
+         else
+            strcpy(hex.str, "n/a");
+         return hex;
+      }
+
+      // record text is short and mostly ours; av_err2str() output may contain quotes
+      static JsonText jsonText(const char* text) {
+         JsonText out;
+         size_t n = 0;
+         for (const char* c = text; *c && n + 2 < sizeof(out.str); c++) {
+            if (*c == '"' || *c == '\\')
+               out.str[n++] = '\\';
+            if (static_cast<unsigned char>(*c) >= 0x20)
+               out.str[n++] = *c;
+         }
+         out.str[n] = '\0';
+         return out;
+      }
+
+      static const char* pixFmtName(int format) {
+         const char* name = av_get_pix_fmt_name(static_cast<AVPixelFormat>(format));
+         return name ? name : "unknown";
+      }
+
+      static void formatText(const LogRecord& r, std::string& s, std::string& e) {
+         switch (r.type) {
+            case EV_FRAME:
+               if (r.flags & LOGF_CORRUPT) {
+                  s += "\n=== CORRUPTION DETECTED === \n";
+                  append(s, "\nPacket PTS: %lld", static_cast<long long>(r.pkt_pts));
+                  append(s, "\nFrame PTS: %lld", static_cast<long long>(r.pts));
+                  append(s, "\nError Flags: %x", r.decode_error_flags);
+               }
+               if (r.flags & LOGF_MISSING_PTS)
+                  s += "[NOTICE] Frame missing PTS\n";
+               if (r.pict_type == '?')
+                  s += "[NOTICE] Frame picture type unknown\n";
+               append(s, "Frame #%lld | Type: %c | PTS: %lld | DTS: %lld | Timestamp: %gs | Resolution: %dx%d | Pixel fmt: %s",
+                     static_cast<long long>(r.frame_number), r.pict_type,
+                     static_cast<long long>(r.pts), static_cast<long long>(r.dts),
+                     r.timestamp, r.width, r.height, pixFmtName(r.format));
+               if (r.text[0])
+                  append(s, " | Decoded frm %s: %s", r.text, digestHex(r).str);
+               s += "\n";
+               if (r.decode_error_flags & FF_DECODE_ERROR_INVALID_BITSTREAM)
+                  s += "[WARNING] Invalid Bitstream!!!! \n";
+               if (r.decode_error_flags & FF_DECODE_ERROR_MISSING_REFERENCE)
+                  s += "[WARNING] Missing Reference!!!! \n";
+               if (r.decode_error_flags & FF_DECODE_ERROR_CONCEALMENT_ACTIVE) {
+                  s += "[WARNING] Error Concealment Used!!!! \n";
+                  append(s, "[Concealment Active] PTS: %lld\n", static_cast<long long>(r.pts));
+               }
+               break;
+            case EV_VISUAL_CORRUPTION:
+               append(e, "%s Visual corruption detected (PTS: %lld)",
+                     (r.flags & LOGF_HW_DECODER) ? "[HW]" : "[SW]", static_cast<long long>(r.pts));
+               if (r.text[0])
+                  append(e, " flat: %s", r.text);
+               e += "\n";
+               break;
+            case EV_SEEK:
+               if (r.flags & LOGF_SEEK_EXACT)
+                  append(s, "[Seek] Jumped to %.3f sec (exact)", r.timestamp);
+               else
+                  append(s, "[Seek] Jumped to %lld sec", static_cast<long long>(r.timestamp));
+               s += (r.flags & LOGF_SEEK_CACHED) ? " [GOP cache hit]\n" : "\n";
+               break;
+            case EV_SEEK_FAILED:
+               e += "[Seek] Failed\n";
+               break;
+            case EV_EOF:
+               s += "[EOF reached]\n";
+               break;
+            case EV_READ_ERROR:
+               append(e, "[Error reading frame: %s]\n", r.text);
+               break;
+            case EV_QUIT:
+               s += "[Quit]\n";
+               break;
+            case EV_PACKET_ANOMALY:
+               append(e, "[Scan] Stream #%d packet #%lld: %s (PTS %lld, DTS %lld)\n", r.stream,
+                     static_cast<long long>(r.frame_number), r.text, static_cast<long long>(r.pts),
+                     static_cast<long long>(r.dts));
+               break;
+            case EV_TEMPORAL:
+               append(e, "[Temporal] Frame #%lld (PTS: %lld) %s\n", static_cast<long long>(r.frame_number),
+                     static_cast<long long>(r.pts), r.text);
+               break;
+            case EV_HASH_MISMATCH:
+               append(e, "[Hash] Frame #%lld PTS %lld: %s, golden %s\n", static_cast<long long>(r.frame_number),
+                     static_cast<long long>(r.pts), digestHex(r).str, r.text);
+               break;
+            case EV_STREAM_ERROR:
+               if (r.flags & (LOGF_DETECT_SOLID | LOGF_DETECT_FLAT_UV | LOGF_DETECT_PARTIAL))
+                  append(e, "[Stream #%d %c] Visual corruption detected (PTS: %lld) flat: %s\n", r.stream,
+                        r.pict_type, static_cast<long long>(r.pts), r.text);
+               else
+                  append(e, "[Stream #%d %c] %s (PTS: %lld)\n", r.stream, r.pict_type, r.text,
+                        static_cast<long long>(r.pts));
+               break;
+         }
+      }
+
+      static void formatJson(const LogRecord& r, std::string& s) {
+         static const char* names[] = {"frame", "visual_corruption", "seek", "seek_failed", "eof", "read_error", "quit",
+            "stream_error", "hash_mismatch",
+            "packet_anomaly", "temporal"};
+         append(s, "{\"event\":\"%s\"", r.type < sizeof(names) / sizeof(names[0]) ? names[r.type] : "unknown");
+         switch (r.type) {
+            case EV_FRAME:
+               append(s, ",\"frame\":%lld,\"type\":\"%c\",\"pts\":%lld,\"dts\":%lld,\"time\":%.6f,"
+                     "\"width\":%d,\"height\":%d,\"pix_fmt\":\"%s\",\"corrupt\":%s,\"error_flags\":%d",
+                     static_cast<long long>(r.frame_number), r.pict_type,
+                     static_cast<long long>(r.pts), static_cast<long long>(r.dts), r.timestamp,
+                     r.width, r.height, pixFmtName(r.format),
+                     (r.flags & LOGF_CORRUPT) ? "true" : "false", r.decode_error_flags);
+               if (r.flags & LOGF_CORRUPT)
+                  append(s, ",\"pkt_pts\":%lld", static_cast<long long>(r.pkt_pts));
+               if (r.text[0])
+                  append(s, ",\"hash\":\"%s\",\"digest\":\"%s\"", r.text, digestHex(r).str);
+               break;
+            case EV_VISUAL_CORRUPTION:
+               append(s, ",\"frame\":%lld,\"pts\":%lld,\"decoder\":\"%s\",\"solid\":%s,\"flat_uv\":%s,\"partial\":%s,\"regions\":\"%s\"",
+                     static_cast<long long>(r.frame_number), static_cast<long long>(r.pts),
+                     (r.flags & LOGF_HW_DECODER) ? "HW" : "SW",
+                     (r.flags & LOGF_DETECT_SOLID) ? "true" : "false",
+                     (r.flags & LOGF_DETECT_FLAT_UV) ? "true" : "false",
+                     (r.flags & LOGF_DETECT_PARTIAL) ? "true" : "false", jsonText(r.text).str);
+               break;
+            case EV_SEEK:
+               append(s, ",\"target\":%.3f,\"exact\":%s,\"cached\":%s", r.timestamp,
+                     (r.flags & LOGF_SEEK_EXACT) ? "true" : "false",
+                     (r.flags & LOGF_SEEK_CACHED) ? "true" : "false");
+               break;
+            case EV_READ_ERROR:
+               append(s, ",\"error\":\"%s\"", jsonText(r.text).str);
+               break;
+            case EV_PACKET_ANOMALY:
+               append(s, ",\"stream\":%d,\"packet\":%lld,\"pts\":%lld,\"dts\":%lld,\"time\":%.6f,\"anomalies\":%u,\"text\":\"%s\"",
+                     r.stream, static_cast<long long>(r.frame_number), static_cast<long long>(r.pts),
+                     static_cast<long long>(r.dts), r.timestamp, r.flags, jsonText(r.text).str);
+               break;
+            case EV_TEMPORAL:
+               append(s, ",\"frame\":%lld,\"pts\":%lld,\"freeze\":%s,\"flash\":%s,\"tear\":%s,\"text\":\"%s\"",
+                     static_cast<long long>(r.frame_number), static_cast<long long>(r.pts),
+                     (r.flags & LOGF_TEMPORAL_FREEZE) ? "true" : "false",
+                     (r.flags & LOGF_TEMPORAL_FLASH) ? "true" : "false",
+                     (r.flags & LOGF_TEMPORAL_TEAR) ? "true" : "false", jsonText(r.text).str);
+               break;
+            case EV_HASH_MISMATCH:
+               append(s, ",\"frame\":%lld,\"pts\":%lld,\"digest\":\"%s\",\"golden\":\"%s\"",
+                     static_cast<long long>(r.frame_number), static_cast<long long>(r.pts),
+                     digestHex(r).str, jsonText(r.text).str);
+               break;
+            case EV_STREAM_ERROR:
+               append(s, ",\"stream\":%d,\"type\":\"%c\",\"frame\":%lld,\"pts\":%lld,\"corrupt\":%s,\"error_flags\":%d,\"error\":\"%s\"",
+                     r.stream, r.pict_type, static_cast<long long>(r.frame_number), static_cast<long long>(r.pts),
+                     (r.flags & LOGF_CORRUPT) ? "true" : "false", r.decode_error_flags, jsonText(r.text).str);
+               break;
+            default:
+               break;
+         }
+         s += "}\n";
+      }
+};
+
+#endif // EVENT_LOG_H
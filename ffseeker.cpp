@@ -0,0 +1,2049 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include <deque>
+#include <condition_variable>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+#include <libavutil/error.h>
+}
+
+#include "ffseeker.h"
+#include "pacer.h"
+#include "frame_hasher.h"
+#include "event_log.h"
+#include "decoder_tuning.h"
+#include "media_io.h"
+#include "seek_stress.h"
+#include "stream_decoder.h"
+#include "packet_scan.h"
+#include "mem_budget.h"
+#include "gop_sample.h"
+#include "packet_queue.h"
+#include "hash_pool.h"
+#include "corruption_detector.h"
+#include "temporal_detector.h"
+#include "keyframe_index.h"
+#include "gop_cache.h"
+#include "frame_pool.h"
+#include "stage_metrics.h"
+#include "hash_db.h"
+#include "checkpoint.h"
+#include "alloc_stats.h" // counted only when the executable defines the operators
+
+#define PACKET_QUEUE_SIZE 256 // packets buffered between demux and decode threads
+#define WARMUP_FRAMES 120     // allocation counters are compared from here on
+
+/* Unit of work travelling from the demux thread to the decode thread.
+ * FLUSH is queued after a successful container seek so the decoder is flushed
+ * in stream order, END marks the end of input.
+ * `serial` is the seek generation the packet was read in; the decoder drops
+ * packets from older generations instead of decoding them.
+ * A FLUSH carries the seek target (stream time base) and, on a GOP cache hit,
+ * the cached GOP to replay; demuxing then resumes at the GOP's end.
+ */
+struct PacketItem {
+   enum Kind {
+      PACKET,
+      FLUSH,
+      END
+   };
+   Kind kind;
+   AVPacket* pkt;
+   int serial;
+   int64_t target;
+   GopRef gop;
+};
+
+// Everything printed for one decoded frame. Built on the decode thread so the
+// frame itself can be released (or handed to a hash worker) right away.
+struct FrameReport {
+   int64_t pts;
+   int64_t dts;
+   int64_t pkt_pts;
+   double timestamp;
+   int width;
+   int height;
+   int format;
+   char pict_type;
+   bool key;
+   int decode_error_flags;
+   bool corrupt;    // decoder/packet flagged corruption
+   DetectorResult detect; // visual artifact check of the decoded planes
+   TemporalResult temporal; // against the previous frames, with --temporal
+   uint64_t budget_bytes = 0; // frame bytes charged to BUDGET_FRAMES until hashed
+   int64_t key_pos = -1;      // keyframes: byte offset of their packet, for checkpoints
+   FrameDigest digest;
+};
+
+class FFmpegDemuxSeeker {
+   public:
+   FFmpegDemuxSeeker(const std::string& filename, DecoderType decoder_type , const std::string& codecName = nullptr, bool enable_hash = false,
+         const SeekerOptions& options = SeekerOptions())
+   : decoder_type(decoder_type),
+     enable_hash(enable_hash),
+     codecStr(nullptr),
+     fmt_ctx(nullptr),
+     codec_ctx(nullptr),
+     video_stream_index(-1),
+     current_pos(0),
+     duration(0),
+     frame_number(0),
+     seek_offset(0),
+     quit_flag(false),
+     seek_requested(false),
+     packet_queue(PACKET_QUEUE_SIZE),
+     budget(options.mem_budget),
+     seek_serial(0),
+     hash_algo(options.hash_algo),
+     detector(options.detect_stride, options.detect_kernel),
+     temporal(options.temporal && options.scan == SCAN_FULL ? new TemporalDetector(options.detect_kernel, options.freeze_frames) : nullptr),
+     log_out(nullptr),
+     input_path(filename),
+     index_complete(false),
+     index_recording(false),
+     byte_seek(false),
+     seek_mode(options.seek_mode),
+     interactive(options.interactive),
+     info(options.interactive ? std::cout.rdbuf() : nullptr),
+     codec_name(codecName),
+     decoder_threads(options.decoder_threads),
+     thread_type(options.thread_type),
+     segments(options.segments),
+     free_packets(PACKET_QUEUE_SIZE),
+     packet_allocs(0),
+     stats_interval(options.stats_interval),
+     prometheus_file(options.prometheus_file),
+     io_mode(options.io_mode),
+     io_window(static_cast<size_t>(std::max(1, options.io_buffer_mb)) << 20),
+     scan_level(options.scan),
+     sample_plan(options.sample),
+     seek_plan(options.seek_plan),
+     hold_at_eof(options.seek_plan.kind != PLAN_NONE)
+  {
+      // debug levels  av_log_set_level(AV_LOG_INFO); default
+      // AV_LOG_QUIE; // no output
+      // AV_LOG_PANIC // for unrecoverable errors that can cause prog to crash
+      // AV_LOG_FATAL // serious errors that might stop the program.
+      // AV_LOG_ERROR // Standard error messages (e.g., decoding failure).
+      // AV_LOG_WARNING // Warnings (recoverable problems).
+      // AV_LOG_INFO  // basic info
+      // AV_LOG_VERBOSE  // more then basic info
+      // AV_LOG_DEBUG  // Extremely detailed debug information.
+      // AV_LOG_TRACE  // All messages, including very low-level function calls.
+      // Trace should print 
+      // - decoder state transitions
+      // - frame timestamps
+      // - HW acceleratio"info"ls 
+      // - Internal buffer allocation information 
+
+      if (!interactive) {
+         // headless runs share the process-wide level set by the caller
+      } else if (!options.log_level.empty()) {
+         const char* loglevel = options.log_level.c_str();
+         printf(" Debug level: %s \n", loglevel);
+         if (strncmp(loglevel, "trace", 5) == 0) {  
+            av_log_set_level(AV_LOG_TRACE); 
+         } else if (strncmp(loglevel, "info", 4) == 0) {
+            av_log_set_level(AV_LOG_INFO); 
+         } else if (strncmp(loglevel, "debug", 5) == 0) {
+            av_log_set_level(AV_LOG_DEBUG); 
+         } else {
+            av_log_set_level(AV_LOG_INFO); 
+         }
+      } else {
+         av_log_set_level(AV_LOG_INFO);  // Default log level
+      }
+      if (options.log_events && !options.log_file.empty() && options.resume && options.log_format == LOG_BINARY)
+         throw std::runtime_error("--resume continues text or JSON logs only, the binary log has one header");
+      if (options.temporal && options.segments > 1)
+         throw std::runtime_error("--temporal needs every frame in order, not --segments");
+      if (options.frame_sink && (options.segments > 1 || options.sample.kind != SAMPLE_OFF))
+         throw std::runtime_error("A frame sink needs a sequential run: segmented and sampled runs output no frames");
+
+      // a throw from here on skips the destructor: close what the members' own destructors don't
+      struct CloseOnThrow {
+         FFmpegDemuxSeeker* seeker;
+         ~CloseOnThrow() {
+            if (seeker)
+               seeker->closeFiles();
+         }
+      } close_on_throw = {this};
+
+      if (openMediaInput(&fmt_ctx, filename, io_mode, io_window, media_io) < 0)
+         throw std::runtime_error("Failed to open file");
+
+      if (avformat_find_stream_info(fmt_ctx, nullptr) < 0)
+         throw std::runtime_error("Failed to find stream info");
+
+      // the primary pipeline (seeking, pacing, hashing) follows the first
+      // selected video stream, or the first video stream of the file
+      const std::vector<int> selected = selectStreams(fmt_ctx, options.streams);
+      for (size_t k = 0; k < selected.size() && video_stream_index == -1; k++) {
+         if (fmt_ctx->streams[selected[k]]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+            video_stream_index = selected[k];
+      }
+      for (unsigned i = 0; i < fmt_ctx->nb_streams && video_stream_index == -1; i++) {
+         if (fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+            video_stream_index = i;
+      }
+
+      if (video_stream_index == -1)
+         throw std::runtime_error("No video stream found");
+
+      if (options.frame_pool && decoder_type == SOFTWARE && scan_level != SCAN_PACKETS)
+         frame_pool.reset(new FrameBufferPool);
+      if (options.autotune != TUNE_OFF && scan_level != SCAN_PACKETS)
+         autotuneThreads(options.autotune, options.autotune_packets);
+      if (scan_level != SCAN_PACKETS) // packet scans never create a decoder
+         codec_ctx = openDecoder(fmt_ctx->streams[video_stream_index]->codecpar);
+      const AVCodec* codec = codec_ctx ? codec_ctx->codec : nullptr;
+
+      duration = fmt_ctx->duration;
+      info << "Loaded: " << filename << ", duration: " << (duration / AV_TIME_BASE) << " sec\n";
+      // Print general format-level info
+      info << "Input file: " << fmt_ctx->url << "\n";
+      AVStream* video_stream = fmt_ctx->streams[video_stream_index];
+      AVCodecParameters* codecpar = video_stream->codecpar;
+      const char* codec_long_name = codec ? codec->long_name : "unknown";
+
+      // Duration (in seconds)
+      double duration_sec = (fmt_ctx->duration != AV_NOPTS_VALUE)
+         ? fmt_ctx->duration * av_q2d(AV_TIME_BASE_Q)
+         : 0;
+
+      // Bitrate (in kbps)
+      int64_t bitrate = fmt_ctx->bit_rate;
+
+      info << "Video stream index: " << video_stream_index << "\n";
+      info << "Encoded format: " << codec_long_name << "\n";
+      info << "Codec ID: " << codecpar->codec_id << "\n";
+      info << "Resolution: " << codecpar->width << "x" << codecpar->height << "\n";
+      info << "Pixel format: " << av_get_pix_fmt_name((AVPixelFormat)codecpar->format) << "\n";
+      info << "Duration: " << duration_sec << " seconds\n";
+      info << "Overall Bitrate:(includes all streams) " << (bitrate / 1000) << " kbps\n";
+      info << "Video stream Bitrate: " << (codecpar->bit_rate / 1000) << " kbps\n";
+      if (codec) {
+         info << "Decoder used : " << (codec->name) << "\n";
+         info << "Decoder threads: " << codec_ctx->thread_count << " ("
+            << threadTypeName(codec_ctx->active_thread_type) << ")\n";
+      }
+      if (scan_level != SCAN_FULL)
+         info << "Scan: " << scanLevelName(scan_level) << "\n";
+      info << "Corruption detector: " << detector.kernelName()
+         << ", every " << options.detect_stride << " rows\n";
+      if (temporal)
+         info << "Temporal detector: " << temporal->kernelName()
+            << ", freeze after " << options.freeze_frames << " frames\n";
+      if (options.mem_budget)
+         info << "Memory budget: " << (options.mem_budget >> 20) << " MiB of queued packets and frames\n";
+      if (media_io)
+         info << "I/O: " << ioModeName(io_mode)
+            << (io_mode == IO_READAHEAD ? ", " + std::to_string(io_window >> 20) + " MB window" : "") << "\n";
+
+      setupKeyframeIndex(options.index_mode);
+
+      int cache_mb = options.gop_cache_mb;
+      if (cache_mb < 0) {
+         cache_mb = (seek_mode == SEEK_EXACT) ? 256 : 0;
+         if (options.mem_budget) // the cache holds decoded frames outside the budget
+            cache_mb = std::min<uint64_t>(cache_mb, options.mem_budget >> 21);
+      }
+      if (cache_mb > 0) {
+         gop_cache.reset(new GopCache(static_cast<size_t>(cache_mb) << 20));
+         info << "GOP cache: " << cache_mb << " MB\n";
+      }
+
+      // realtime falls back to the nominal frame rate for frames without a PTS
+      if (options.pace_mode == PACE_REALTIME)
+         pacer = FramePacer(PACE_REALTIME, av_q2d(video_stream->avg_frame_rate));
+      else
+         pacer = FramePacer(options.pace_mode, options.pace_fps);
+
+      // everything that can reject the options comes before the first output file is opened
+      if (!options.compare_db.empty()) {
+         golden.reset(new GoldenHashDb(options.compare_db));
+         if (golden->algo() != hash_algo)
+            throw std::runtime_error(options.compare_db + " holds " + hashAlgoName(golden->algo()) +
+                  " digests, run with -m " + hashAlgoName(golden->algo()));
+         golden_seen.assign(golden->size(), false);
+         info << "Comparing against " << options.compare_db << " (" << golden->size() << " frames)\n";
+      }
+      if (!options.checkpoint.empty())
+         setupCheckpoint(options);
+
+      if (options.log_events) {
+         log_out = stdout;
+         if (!options.log_file.empty()) {
+            log_out = resuming ? reopenLog(options.log_file, resume_state.log_bytes) :
+               fopen(options.log_file.c_str(), options.log_format == LOG_BINARY ? "wb" : "w");
+            if (!log_out)
+               throw std::runtime_error("Failed to open log file " + options.log_file);
+         }
+      }
+      if (log_out || options.event_sink)
+         event_log.reset(new EventLog(options.log_format, log_out, 1 << 16, &metrics.stage(STAGE_LOG_WRITE),
+                  options.event_sink));
+      openStreamDecoders(selected, options); // they log into event_log
+
+      if (enable_hash) {
+         int threads = options.hash_threads;
+         if (threads <= 0)
+            threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+         hash_pool.reset(new OrderedHashPool<FrameReport>(hash_algo, threads,
+                  [this](FrameReport& report, const FrameDigest& digest) {
+                     if (report.budget_bytes)
+                        budget.release(BUDGET_FRAMES, report.budget_bytes);
+                     report.digest = digest;
+                     printFrameReport(report);
+                  }, &metrics.stage(STAGE_HASH)));
+      }
+      if (!options.hash_db.empty())
+         hash_db.reset(new HashDbWriter(options.hash_db, hash_algo, video_stream->time_base,
+                  resuming ? resume_state.frame_number : -1));
+      stop_on_mismatch = options.stop_on_mismatch;
+      frame_sink = options.frame_sink;
+      close_on_throw.seeker = nullptr;
+   }
+
+      ~FFmpegDemuxSeeker() {
+         hash_pool.reset(); // finish in-flight hashes before the codec goes away
+         finishHashDb();
+         stream_decoders.clear(); // they log into event_log
+         event_log.reset();
+         stats_reporter.reset(); // last export, now that the log writer is done too
+         printStageSummary();
+         printIoSummary();
+         printAllocationSummary();
+         printMemorySummary();
+         if (gop_cache)
+            info << "GOP cache: " << gop_cache->hits() << " hits, "
+               << gop_cache->misses() << " misses\n";
+         closeFiles();
+      }
+
+      void run() {
+         if (!stats_reporter && (stats_interval > 0 || !prometheus_file.empty()))
+            stats_reporter.reset(new StatsReporter(metrics, stats_interval, stats_interval > 0,
+                     prometheus_file, input_path));
+         if (scan_level == SCAN_PACKETS)
+            runPacketScan();
+         else if (sample_plan.kind != SAMPLE_OFF)
+            runSampled();
+         else if (segments > 1)
+            runSegmented();
+         else
+            runThreaded();
+         for (int s = 0; s < BUDGET_STAGE_COUNT; s++)
+            run_stats.peak_queued[s] = budget.peak(static_cast<BudgetStage>(s));
+         run_stats.budget_waits = budget.waits();
+         run_stats.peak_rss = peakRssBytes();
+      }
+
+      // Demux, decode and secondary stream threads, plus the seek stress driver.
+      void runThreaded() {
+         if (resuming)
+            resumeFromCheckpoint();
+         for (size_t k = 0; k < stream_decoders.size(); k++)
+            stream_decoders[k]->start();
+         std::thread demux_thread(&FFmpegDemuxSeeker::demuxLoop, this);
+         std::thread decode_thread(&FFmpegDemuxSeeker::decodeLoop, this);
+         std::thread input_thread;
+         if (hold_at_eof)
+            input_thread = std::thread(&FFmpegDemuxSeeker::seekStressLoop, this);
+
+         demux_thread.join();
+         decode_thread.join();
+         if (input_thread.joinable())
+            input_thread.join();
+         for (size_t k = 0; k < stream_decoders.size(); k++) {
+            stream_decoders[k]->join(); // the demuxer closed their queues
+            run_stats.streams.push_back(stream_decoders[k]->stats());
+         }
+         printStreamSummary();
+         if (hold_at_eof)
+            printSeekStressSummary(std::cout, seek_samples, seek_wall_seconds);
+         if (!checkpoint_path.empty() && run_stats.reached_eof && !hold_at_eof) {
+            fillCheckpoint(AV_NOPTS_VALUE, -1);
+            checkpoint.complete = 1; // a later --resume starts over
+            if (!writeCheckpoint(checkpoint_path, checkpoint))
+               std::cerr << "[Checkpoint] Failed to write " << checkpoint_path << "\n";
+         }
+
+         // release whatever was still queued when we quit
+         PacketItem item;
+         while (packet_queue.tryPop(item)) {
+            if (item.pkt)
+               budget.release(BUDGET_PACKETS, packetBytes(item.pkt));
+            av_packet_free(&item.pkt);
+         }
+         AVPacket* spare;
+         while (free_packets.tryPop(spare))
+            av_packet_free(&spare);
+      }
+
+      const SeekerStats& stats() const { return run_stats; }
+
+      // Seeks of a stress run that failed, timed out or landed on the wrong PTS.
+      size_t seekStressFailures() const {
+         size_t failures = 0;
+         for (size_t i = 0; i < seek_samples.size(); i++)
+            failures += seek_samples[i].outcome != SEEK_OK;
+         return failures;
+      }
+
+      // Controls, from any thread while run() is going. Offsets and positions in AV_TIME_BASE units.
+      void requestSeek(int64_t offset) {
+         std::lock_guard<std::mutex> lock(seek_mutex);
+         seek_offset = offset;
+         seek_requested = true;
+         seek_cv.notify_one();
+      }
+
+      void requestSeekTo(int64_t pos) {
+         std::lock_guard<std::mutex> lock(seek_mutex);
+         seek_absolute = pos;
+         seek_requested = true;
+         seek_cv.notify_one();
+      }
+
+      void setPaused(bool pause) {
+         std::lock_guard<std::mutex> lock(pause_mutex);
+         paused = pause;
+         step_frames = 0;
+         pause_cv.notify_one();
+      }
+
+      // Pauses if needed and lets `frames` more frames out.
+      void step(int64_t frames) {
+         std::lock_guard<std::mutex> lock(pause_mutex);
+         paused = true;
+         step_frames += frames;
+         pause_cv.notify_one();
+      }
+
+      void quit() {
+         std::lock_guard<std::mutex> lock(pause_mutex);
+         if (!quit_flag) {
+            quit_flag = true;
+            logEvent(EV_QUIT);
+         }
+         pause_cv.notify_one();
+         seek_cv.notify_all();
+      }
+
+      SeekerProgress progress() {
+         SeekerProgress now;
+         {
+            std::lock_guard<std::mutex> lock(pause_mutex);
+            now.paused = paused;
+         }
+         now.position = static_cast<double>(current_pos) / AV_TIME_BASE;
+         now.frames = metrics.counter(CNT_FRAMES);
+         now.packets = metrics.counter(CNT_PACKETS);
+         now.corrupt_frames = metrics.counter(CNT_CORRUPT_FRAMES);
+         now.visual_corruption = metrics.counter(CNT_VISUAL_CORRUPTION);
+         now.seeks = metrics.counter(CNT_SEEKS);
+         return now;
+      }
+
+   private:
+      DecoderType decoder_type;
+      bool enable_hash;
+      const char* codecStr = nullptr;
+      AVFormatContext* fmt_ctx;
+      AVCodecContext* codec_ctx;
+      int video_stream_index;
+      std::atomic<int64_t> current_pos; // AV_TIME_BASE units, updated by the decode thread
+      int64_t duration;
+      int64_t frame_number;
+
+      int64_t seek_offset; // in microseconds
+      std::atomic<bool> quit_flag;
+      std::mutex seek_mutex;
+      std::condition_variable seek_cv;        // seek_requested / quit_flag, for a demuxer parked at EOF
+      std::atomic<bool> seek_requested;
+      int64_t seek_absolute = AV_NOPTS_VALUE; // under seek_mutex: absolute target instead of seek_offset
+
+      SpscQueue<PacketItem> packet_queue; // demux -> decode
+      MemoryBudget budget;                 // --mem-budget: bytes queued between the threads
+      std::atomic<int> seek_serial;        // bumped on every successful seek
+      FramePacer pacer;                    // decode thread only
+      HashAlgo hash_algo;
+      std::unique_ptr<OrderedHashPool<FrameReport> > hash_pool; // only with enable_hash
+      CorruptionDetector detector;
+      std::unique_ptr<TemporalDetector> temporal; // decode thread only, null without --temporal
+      FILE* log_out;
+      std::unique_ptr<EventLog> event_log; // every per-frame line goes through here
+
+      std::string input_path;
+      KeyframeIndex kf_index;  // demux thread only once running
+      MediaIdentity media_id;
+      bool index_complete;     // covers the whole file (loaded, built or fully recorded)
+      bool index_recording;    // linear pass from the start, no seek yet
+      bool byte_seek;          // demuxer resyncs after a raw byte seek (TS/PS/ES)
+
+      SeekMode seek_mode;
+      std::unique_ptr<GopCache> gop_cache;      // null when disabled
+      std::unique_ptr<CachedGop> recording_gop; // decode thread only
+      int64_t discard_before = AV_NOPTS_VALUE;  // decode thread: drop earlier frames
+
+      bool interactive;
+      std::ostream info;       // stream info banner, discarded when headless
+      SeekerStats run_stats;   // frame counters are updated in output order
+      std::string codec_name;  // HW decoder name
+      int decoder_threads;
+      int thread_type;
+      int segments;
+
+      std::unique_ptr<FrameBufferPool> frame_pool; // SW decoders, outlives every decoder
+      SpscQueue<AVPacket*> free_packets;  // decode -> demux, emptied shells for reuse
+      std::atomic<uint64_t> packet_allocs;
+      AllocSnapshot warm_heap;             // taken at WARMUP_FRAMES
+      uint64_t warm_buffers = 0;
+      uint64_t warm_packets = 0;
+
+      StageMetrics metrics;                // per-stage latencies and event counters, any thread
+      double stats_interval;
+      std::string prometheus_file;
+      std::unique_ptr<StatsReporter> stats_reporter; // while running with --stats-interval / --prometheus
+
+      IoMode io_mode;
+      size_t io_window;
+      std::unique_ptr<MediaIO> media_io; // main demuxer's I/O, null with IO_DEFAULT
+
+      std::vector<std::unique_ptr<StreamDecoder> > stream_decoders; // --streams, besides the primary
+      std::vector<StreamDecoder*> stream_routes; // by stream index, null: primary or discarded
+
+      ScanLevel scan_level;
+      std::vector<int> scan_streams; // --scan packets: primary video stream, then --streams
+      SamplePlan sample_plan;        // --sample
+
+      std::unique_ptr<HashDbWriter> hash_db;  // --hash-db, output order
+      std::unique_ptr<GoldenHashDb> golden;   // --compare
+      std::vector<bool> golden_seen;          // golden records some frame was checked against
+      std::string checkpoint_path;            // --checkpoint, empty: off
+      uint64_t checkpoint_interval_ns = 0;
+      uint64_t last_checkpoint_ns = 0;        // output thread
+      bool checkpoint_failed = false;         // output thread, reported once
+      CheckpointState checkpoint;             // identity part filled once, totals per write
+      bool resuming = false;                  // --resume with a usable checkpoint
+      CheckpointState resume_state;
+      uint64_t resumed_frames = 0;            // frames counted before this process started
+      KeyframeEntry recent_keys[8];           // decode thread: last keyframe packets, for key_pos
+      unsigned recent_key_count = 0;
+      uint64_t golden_seen_count = 0;
+      bool stop_on_mismatch = false;
+
+      FrameSink frame_sink; // decode thread
+      std::mutex pause_mutex;
+      std::condition_variable pause_cv;       // paused / step_frames / quit_flag, for the decode thread
+      bool paused = false;                    // under pause_mutex
+      int64_t step_frames = 0;                // under pause_mutex: frames to output while paused
+
+      SeekPlan seek_plan;
+      bool hold_at_eof;      // seek stress: wait for the next seek at EOF instead of ending
+      int active_serial = 0; // decode thread: serial of the last FLUSH
+      std::vector<SeekSample> seek_samples; // driver thread, read after it is joined
+      double seek_wall_seconds = 0;
+
+      // The seek currently timed by the stress driver; filled in by the
+      // demux thread (target, expected keyframe) and the decode thread (frames).
+      struct SeekTrace {
+         std::mutex mutex;
+         std::condition_variable cv;
+         bool active = false;
+         int serial = 0;                        // FLUSH serial, 0 until the demuxer seeked
+         int64_t target = AV_NOPTS_VALUE;       // stream time base
+         int64_t expected_key = AV_NOPTS_VALUE; // from the keyframe index or the cached GOP
+         int64_t landed_key = AV_NOPTS_VALUE;   // first keyframe out of the decoder
+         bool cached = false;
+         std::chrono::steady_clock::time_point requested;
+         double first_ms = -1;
+         double target_ms = -1;
+         bool failed = false;
+         bool ended = false; // drained at EOF without reaching the target
+      } trace;
+
+      // The log file, decoder and demuxer, which no member destructor closes; the
+      // demuxer before the I/O object it reads through, the decoder before the
+      // frame pool it allocates from. Stops the log writer first.
+      void closeFiles() {
+         stream_decoders.clear(); // they log into event_log
+         event_log.reset();
+         if (log_out && log_out != stdout)
+            fclose(log_out);
+         log_out = nullptr;
+         if (codec_ctx)
+            avcodec_free_context(&codec_ctx);
+         if (fmt_ctx)
+            avformat_close_input(&fmt_ctx);
+         media_io.reset(); // caller-owned I/O, only after the context is gone
+      }
+
+      // Creates and opens a decoder for the selected HW/SW type; used for the
+      // main stream and for every segment of a segmented run.
+      AVCodecContext* openDecoder(const AVCodecParameters* codecpar) {
+         const AVCodec *codec = nullptr;
+         if (decoder_type == SOFTWARE) { 
+            codec = avcodec_find_decoder(codecpar->codec_id);
+         } else if ( decoder_type == HARDWARE) {
+            // codec = avcodec_find_decoder_by_name("h264_v4l2m2m");
+            codec = avcodec_find_decoder_by_name(codec_name.c_str());
+            if (!codec) {
+               std::cerr << "[Error] v4l2_m2m decoder not found!!!";
+               //fallback
+               ////codec = avcodec_find_decoder(codecpar->codec_id); 
+               throw std::runtime_error("Error to open HW codec!!!!");
+            }
+         }
+         if (!codec)
+            throw std::runtime_error("Unsupported codec");
+
+         AVCodecContext* ctx = avcodec_alloc_context3(codec);
+         if (!ctx)
+            throw std::runtime_error("Failed to allocate codec context");
+         ctx->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT; // TODO need to check if this is true for HW
+                                                     // decode
+         ctx->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
+         //Force errors to be visible ( SW decode only)
+         if ( decoder_type == SOFTWARE ) { 
+            // confirmed the below flags are used only by FFMpeg SW decoders for error detection
+            // on 1619 : HW decoding does not support them ( instead use CorruptionDetector below)
+            ctx->err_recognition = 
+               AV_EF_CAREFUL   | 
+               AV_EF_CRCCHECK  |
+               AV_EF_BITSTREAM | //bitstream errors
+               AV_EF_BUFFER    | // check buffer boundaries
+               AV_EF_EXPLODE    //aborts on error ( can not conceal )
+               ;
+            ctx->debug = FF_DEBUG_MB_TYPE | FF_DEBUG_SKIP;// macroblock works SW H.264
+         }
+
+         avcodec_parameters_to_context(ctx, codecpar);
+         if (decoder_threads > 0)
+            ctx->thread_count = decoder_threads;
+         if (thread_type)
+            ctx->thread_type = thread_type;
+         if (frame_pool)
+            frame_pool->install(ctx);
+         if (scan_level == SCAN_KEYFRAMES)
+            ctx->skip_frame = AVDISCARD_NONKEY; // the decoder drops the rest before decoding it
+         if (avcodec_open2(ctx, codec, nullptr) < 0) {
+            avcodec_free_context(&ctx);
+            throw std::runtime_error("Failed to open codec");
+         }
+         return ctx;
+      }
+
+      void printStageSummary() {
+         char mean[16], p50[16], p99[16], max[16];
+         info << "Stage latency (calls | mean | p50 | p99 | max | total):\n";
+         for (int s = 0; s < STAGE_COUNT; s++) {
+            const LatencyHistogram& h = metrics.stage(s);
+            if (!h.count())
+               continue;
+            HistogramSnapshot snap;
+            snap.take(h);
+            char line[160];
+            snprintf(line, sizeof(line), "  %-10s %10llu | %9s | %9s | %9s | %9s | %.3fs\n", stageName(s),
+                  static_cast<unsigned long long>(snap.count), formatNs(snap.sum_ns / snap.count, mean, sizeof(mean)),
+                  formatNs(snap.percentile(50), p50, sizeof(p50)), formatNs(snap.percentile(99), p99, sizeof(p99)),
+                  formatNs(h.maxNs(), max, sizeof(max)), snap.sum_ns / 1e9);
+            info << line;
+         }
+         info << "Counters:";
+         for (int c = 0; c < CNT_COUNT; c++)
+            info << (c ? " | " : " ") << counterName(c) << " " << metrics.counter(c);
+         info << "\n";
+      }
+
+      /* One StreamDecoder per selected stream other than the primary one;
+       * everything else is discarded in the demuxer.
+       */
+      void openStreamDecoders(const std::vector<int>& selected, const SeekerOptions& options) {
+         stream_routes.assign(fmt_ctx->nb_streams, nullptr);
+         for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+            if (static_cast<int>(i) != video_stream_index &&
+                  std::find(selected.begin(), selected.end(), static_cast<int>(i)) == selected.end())
+               fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+         }
+         scan_streams.assign(1, video_stream_index);
+         for (size_t k = 0; k < selected.size(); k++) {
+            if (selected[k] != video_stream_index)
+               scan_streams.push_back(selected[k]);
+         }
+         if (scan_level == SCAN_PACKETS)
+            return; // checked in the demuxer, nothing to decode
+         if (segments > 1 && selected.size() > 1) {
+            std::cerr << "[Streams] Segmented decode covers the primary video stream only\n";
+            return;
+         }
+         for (size_t k = 0; k < selected.size(); k++) {
+            if (selected[k] == video_stream_index)
+               continue;
+            AVStream* st = fmt_ctx->streams[selected[k]];
+            stream_decoders.emplace_back(new StreamDecoder(st, PACKET_QUEUE_SIZE, seek_serial, quit_flag,
+                     event_log.get(), options.detect_stride, options.detect_kernel, &budget));
+            stream_routes[selected[k]] = stream_decoders.back().get();
+            const StreamStats& stats = stream_decoders.back()->stats();
+            info << "Stream #" << stats.index << " (" << stats.type << "): " << stats.codec << "\n";
+         }
+      }
+
+      void printStreamSummary() {
+         for (size_t k = 0; k < run_stats.streams.size(); k++) {
+            const StreamStats& st = run_stats.streams[k];
+            info << "Stream #" << st.index << " (" << st.type << ", " << st.codec << "): "
+               << st.packets << " packets, " << st.frames << " frames";
+            if (st.type == 'a')
+               info << ", " << st.samples << " samples";
+            info << " | corrupt " << st.corrupt_frames << " | decode errors " << st.decode_errors;
+            if (st.type == 'v')
+               info << " | visual " << st.visual_corruption;
+            info << "\n";
+         }
+      }
+
+      void printIoSummary() {
+         if (!media_io)
+            return;
+         const IoStats io = media_io->stats();
+         info << "I/O (" << ioModeName(io_mode) << "): " << (io.bytes >> 20) << " MiB in " << io.reads
+            << " reads, " << io.seeks << " seeks, waited " << io.wait_ns / 1e9 << "s";
+         if (io_mode == IO_READAHEAD)
+            info << ", " << (io.prefetched >> 20) << " MiB prefetched";
+         info << "\n";
+      }
+
+      void printAllocationSummary() {
+         const AllocSnapshot heap = allocSnapshot();
+         if (heap.counting)
+            info << "Allocations: peak C++ heap " << (heap.peak_bytes >> 10) << " KiB, "
+               << heap.allocs << " operator new calls in total";
+         else
+            info << "Allocations: C++ heap n/a (operator new not counted in this program)";
+         if (frame_pool)
+            info << "; frame pool " << frame_pool->allocated() << " buffers ("
+               << (frame_pool->allocatedBytes() >> 20) << " MiB) for " << frame_pool->served() << " frames";
+         info << "; " << packet_allocs << " packet shells\n";
+         if (run_stats.warm_frames) {
+            info << "Steady state (" << run_stats.warm_frames << " frames after warm-up): "
+               << (run_stats.heap_counted ? std::to_string(run_stats.warm_heap_allocs) : std::string("n/a"))
+               << " heap, " << run_stats.warm_buffer_allocs << " frame buffer, "
+               << run_stats.warm_packet_allocs << " packet allocations\n";
+         }
+      }
+
+      void printMemorySummary() {
+         info << "Memory: peak RSS " << (peakRssBytes() >> 20) << " MiB | peak queued";
+         for (int s = 0; s < BUDGET_STAGE_COUNT; s++)
+            info << (s ? ", " : " ") << budgetStageName(s) << " " << (budget.peak(static_cast<BudgetStage>(s)) >> 10) << " KiB";
+         if (budget.budget())
+            info << " | budget " << (budget.budget() >> 20) << " MiB, " << budget.waits() << " waits ("
+               << budget.waitSeconds() << "s)";
+         info << "\n";
+      }
+
+      /* Decodes the first packets under a few thread configurations and keeps
+       * the best one for `goal`. Explicit --threads / --thread-type settings
+       * narrow the candidates instead of being overridden.
+       */
+      void autotuneThreads(TuneGoal goal, int packet_count) {
+         if (decoder_type == HARDWARE) {
+            info << "Decoder threads: auto-tune skipped (HW decoder)\n";
+            return;
+         }
+         std::vector<AVPacket*> packets;
+         if (!readProbePackets(input_path, video_stream_index, packet_count, packets)) {
+            std::cerr << "[Autotune] Could not read probe packets, using defaults\n";
+            return;
+         }
+
+         const int cores = std::max(1u, std::thread::hardware_concurrency());
+         std::vector<ThreadConfig> candidates;
+         std::vector<ThreadConfig> all = threadCandidates(cores);
+         for (size_t i = 0; i < all.size(); i++) {
+            if ((!decoder_threads || all[i].threads == decoder_threads) &&
+                  (!thread_type || all[i].type == thread_type || all[i].threads == 1))
+               candidates.push_back(all[i]);
+         }
+         if (candidates.empty())
+            candidates.push_back(ThreadConfig{decoder_threads, thread_type});
+
+         const AVCodecParameters* codecpar = fmt_ctx->streams[video_stream_index]->codecpar;
+         const int saved_threads = decoder_threads, saved_type = thread_type;
+         std::vector<TuneSample> samples = probeThreadConfigs(packets, candidates,
+               [this, codecpar](const ThreadConfig& config) {
+                  decoder_threads = config.threads;
+                  thread_type = config.type;
+                  return openDecoder(codecpar);
+               });
+         for (size_t i = 0; i < packets.size(); i++)
+            av_packet_free(&packets[i]);
+
+         info << "Decoder threads: auto-tune over " << packets.size() << " packets ("
+            << (goal == TUNE_LATENCY ? "latency" : "fps") << ")\n";
+         for (size_t i = 0; i < samples.size(); i++) {
+            const TuneSample& sample = samples[i];
+            info << "  " << sample.config.threads << " x " << threadTypeName(sample.config.type) << ": ";
+            if (sample.ok)
+               info << sample.fps << " fps, first frame " << sample.first_frame_ms << " ms\n";
+            else
+               info << "failed\n";
+         }
+
+         int best = pickThreadConfig(samples, goal);
+         if (best < 0) {
+            decoder_threads = saved_threads;
+            thread_type = saved_type;
+            std::cerr << "[Autotune] No configuration decoded, using defaults\n";
+            return;
+         }
+         decoder_threads = samples[best].config.threads;
+         thread_type = samples[best].config.type;
+         info << "Decoder threads: picked " << decoder_threads << " x " << threadTypeName(thread_type) << "\n";
+      }
+
+      void setupKeyframeIndex(IndexMode mode) {
+         if (mode == INDEX_OFF || !MediaIdentity::of(input_path, media_id))
+            return;
+
+         const AVStream* st = fmt_ctx->streams[video_stream_index];
+         const std::string sidecar = KeyframeIndex::sidecarPath(input_path);
+         const char* name = fmt_ctx->iformat->name;
+         byte_seek = !(fmt_ctx->iformat->flags & AVFMT_NO_BYTE_SEEK) &&
+            (!strcmp(name, "mpegts") || !strcmp(name, "mpeg") || !strcmp(name, "mpegvideo") ||
+             !strcmp(name, "h264") || !strcmp(name, "hevc"));
+
+         if (kf_index.load(sidecar, media_id, video_stream_index) &&
+               av_cmp_q(kf_index.timeBase(), st->time_base) == 0) {
+            index_complete = true;
+            info << "Keyframe index: " << kf_index.size() << " keyframes from " << sidecar << "\n";
+            return;
+         }
+
+         if (mode == INDEX_BUILD) {
+            info << "Keyframe index: building (packet scan)...\n";
+            if (kf_index.build(input_path, video_stream_index)) {
+               index_complete = true;
+               if (!kf_index.save(sidecar, media_id, video_stream_index))
+                  std::cerr << "[Index] Failed to write " << sidecar << "\n";
+               info << "Keyframe index: " << kf_index.size() << " keyframes written to " << sidecar << "\n";
+               return;
+            }
+            std::cerr << "[Index] Indexing pass failed, recording during playback instead\n";
+         }
+
+         kf_index.setTimeBase(st->time_base);
+         index_recording = true;
+      }
+
+      // Container seek to the keyframe at or before `ts` (stream time base).
+      // Uses the keyframe index when it covers `ts`: the landing keyframe is
+      // known up front, so we byte-seek straight to it where the demuxer allows
+      // it, or ask for its exact PTS otherwise.
+      bool seekVideo(int64_t ts) {
+         const KeyframeEntry* key = nullptr;
+         if (!kf_index.empty() && (index_complete || ts < kf_index.at(kf_index.size() - 1).pts))
+            key = kf_index.find(ts);
+
+         if (key) {
+            if (byte_seek && key->pos >= 0 &&
+                  av_seek_frame(fmt_ctx, video_stream_index, key->pos, AVSEEK_FLAG_BYTE) >= 0)
+               return true;
+            if (av_seek_frame(fmt_ctx, video_stream_index, key->pts, AVSEEK_FLAG_BACKWARD) >= 0)
+               return true;
+         }
+         return av_seek_frame(fmt_ctx, video_stream_index, ts, AVSEEK_FLAG_BACKWARD) >= 0;
+      }
+
+      /* Segmented decode: the file is cut at keyframes into ranges that are
+       * demuxed and decoded on their own threads, each with a private
+       * AVFormatContext and decoder. A range owns the frames with
+       * start <= pts < end, where start/end are the PTS of its first and
+       * the next range's keyframe; reports are replayed in range order, so
+       * frame numbers match a sequential run.
+       */
+      struct SegmentOutput {
+         int64_t begin;   // split point (keyframe timestamp), AV_NOPTS_VALUE: file start
+         int64_t finish;  // next split point, AV_NOPTS_VALUE: EOF
+         bool key_pts = false; // split points are PTS (our index), not container index DTS
+         std::mutex mutex;
+         std::condition_variable cv;
+         std::deque<FrameReport> reports;
+         bool done = false;
+         bool reached_eof = false;
+         int read_error = 0;
+         std::string error;
+      };
+
+      // Every keyframe of the video stream with its byte offset, sorted and
+      // unique by timestamp; empty if the file has no usable keyframe index.
+      // key_pts tells which timestamp the list holds: the container index
+      // stores DTS, our own index PTS.
+      std::vector<KeyframeEntry> keyframeList(const char* purpose, bool& key_pts) {
+         std::vector<KeyframeEntry> keys;
+         key_pts = false;
+         AVStream* st = fmt_ctx->streams[video_stream_index];
+         const int entries = avformat_index_get_entries_count(st);
+         for (int i = 0; i < entries; i++) {
+            const AVIndexEntry* entry = avformat_index_get_entry(st, i);
+            if (entry && (entry->flags & AVINDEX_KEYFRAME))
+               keys.push_back(KeyframeEntry{entry->timestamp, entry->pos});
+         }
+
+         // TS/ES have no container index: use ours, building it if needed
+         if (keys.size() < 2 && video_stream_index >= 0) {
+            if (!index_complete) {
+               info << "Keyframe index: building (packet scan) for " << purpose << "...\n";
+               if (kf_index.build(input_path, video_stream_index)) {
+                  index_complete = true;
+                  index_recording = false;
+                  if (media_id.size)
+                     kf_index.save(KeyframeIndex::sidecarPath(input_path), media_id, video_stream_index);
+               }
+            }
+            keys.clear();
+            if (index_complete)
+               keys.assign(kf_index.begin(), kf_index.end());
+            key_pts = true;
+         }
+         std::sort(keys.begin(), keys.end(),
+               [](const KeyframeEntry& a, const KeyframeEntry& b) { return a.pts < b.pts; });
+         keys.erase(std::unique(keys.begin(), keys.end(),
+                  [](const KeyframeEntry& a, const KeyframeEntry& b) { return a.pts == b.pts; }), keys.end());
+         return keys;
+      }
+
+      // Index timestamps of evenly spread keyframes to split at, empty if the
+      // file has no usable keyframe index.
+      std::vector<int64_t> segmentSplitPoints(int segments, bool& key_pts) {
+         const std::vector<KeyframeEntry> keys = keyframeList("segment split points", key_pts);
+         std::vector<int64_t> splits;
+         for (int k = 1; k < segments && keys.size() > 1; k++) {
+            int64_t key = keys[static_cast<size_t>(k) * keys.size() / segments].pts;
+            if (key != keys.front().pts && (splits.empty() || key > splits.back()))
+               splits.push_back(key);
+         }
+         return splits;
+      }
+
+      // The packet a split point refers to: the first keyframe at or after it,
+      // compared by the timestamp the split points were taken from (with
+      // B-frames a keyframe's DTS is below its PTS). Both neighbouring
+      // segments apply the same rule to the same packets.
+      static bool isSplitPacket(const AVPacket* pkt, int64_t split, bool key_pts) {
+         int64_t ts = key_pts ? pkt->pts : pkt->dts;
+         if (ts == AV_NOPTS_VALUE)
+            ts = key_pts ? pkt->dts : pkt->pts;
+         return (pkt->flags & AV_PKT_FLAG_KEY) && ts != AV_NOPTS_VALUE && ts >= split;
+      }
+
+      /* Decodes the frames of one range into out.reports, with `ctx` already
+       * seeked to (or before) its first keyframe. Shared by the segments and
+       * the sampled GOPs; leaves `dec` drained.
+       */
+      void decodeRange(AVFormatContext* ctx, AVCodecContext* dec, SegmentOutput& out,
+            TemporalDetector* temporal_detector, FrameHasher* hasher, AVPacket* pkt, AVFrame* frame) {
+         bool started = out.begin == AV_NOPTS_VALUE;
+         int64_t start_pts = AV_NOPTS_VALUE; // first keyframe, earlier (leading) frames belong to the previous range
+         int64_t end_pts = AV_NOPTS_VALUE;   // next range's keyframe, once reached
+         bool draining = false;
+
+         auto emit = [&](const AVPacket* packet) {
+            for (;;) {
+               const uint64_t t0 = StageMetrics::now();
+               int ret = avcodec_receive_frame(dec, frame);
+               metrics.record(STAGE_RECEIVE, t0);
+               if (ret == AVERROR(EAGAIN))
+                  metrics.count(CNT_EAGAIN_RECEIVE);
+               if (ret < 0)
+                  break;
+               bool mine = frame->pts == AV_NOPTS_VALUE ||
+                  ((start_pts == AV_NOPTS_VALUE || frame->pts >= start_pts) &&
+                   (end_pts == AV_NOPTS_VALUE || frame->pts < end_pts));
+               if (mine && !quit_flag) {
+                  FrameReport report = makeFrameReport(frame, packet, temporal_detector);
+                  if (hasher) {
+                     const uint64_t t0 = StageMetrics::now();
+                     report.digest = hasher->hash(frame);
+                     metrics.record(STAGE_HASH, t0);
+                  }
+                  std::lock_guard<std::mutex> lock(out.mutex);
+                  out.reports.push_back(report);
+                  out.cv.notify_one();
+               }
+               av_frame_unref(frame);
+            }
+         };
+
+         while (!quit_flag) {
+            const uint64_t t0 = StageMetrics::now();
+            int ret = av_read_frame(ctx, pkt);
+            metrics.record(STAGE_READ, t0);
+            if (ret < 0) {
+               if (ret == AVERROR_EOF)
+                  out.reached_eof = true;
+               else
+                  out.read_error = ret;
+               break;
+            }
+            if (pkt->stream_index != video_stream_index) {
+               av_packet_unref(pkt);
+               continue;
+            }
+            if (!started) {
+               // the seek may land on an earlier keyframe
+               if (!isSplitPacket(pkt, out.begin, out.key_pts)) {
+                  av_packet_unref(pkt);
+                  continue;
+               }
+               started = true;
+               start_pts = pkt->pts;
+            } else if (out.finish != AV_NOPTS_VALUE && !draining && isSplitPacket(pkt, out.finish, out.key_pts)) {
+               // the next range starts here; keep feeding its leading
+               // pictures (pts before the keyframe), they are still ours
+               draining = true;
+               end_pts = pkt->pts;
+            } else if (draining && (pkt->pts == AV_NOPTS_VALUE || end_pts == AV_NOPTS_VALUE ||
+                     pkt->pts > end_pts)) {
+               av_packet_unref(pkt);
+               break;
+            }
+            metrics.count(CNT_PACKETS);
+            const uint64_t send_start = StageMetrics::now();
+            ret = avcodec_send_packet(dec, pkt);
+            metrics.record(STAGE_SEND, send_start);
+            if (ret == AVERROR(EAGAIN))
+               metrics.count(CNT_EAGAIN_SEND);
+            if (ret == 0)
+               emit(pkt);
+            av_packet_unref(pkt);
+         }
+         if (avcodec_send_packet(dec, nullptr) == 0)
+            emit(nullptr);
+      }
+
+      void decodeSegment(SegmentOutput& out) {
+         std::unique_ptr<MediaIO> io; // outlives ctx
+         AVFormatContext* ctx = nullptr;
+         AVCodecContext* dec = nullptr;
+         AVPacket* pkt = av_packet_alloc();
+         AVFrame* frame = av_frame_alloc();
+         std::unique_ptr<FrameHasher> hasher;
+         if (enable_hash)
+            hasher.reset(new FrameHasher(hash_algo));
+
+         try {
+            if (openMediaInput(&ctx, input_path, io_mode, io_window, io) < 0)
+               throw std::runtime_error("Failed to open file");
+            if (avformat_find_stream_info(ctx, nullptr) < 0 ||
+                  video_stream_index >= static_cast<int>(ctx->nb_streams))
+               throw std::runtime_error("Failed to find stream info");
+            for (unsigned i = 0; i < ctx->nb_streams; i++) {
+               if (static_cast<int>(i) != video_stream_index)
+                  ctx->streams[i]->discard = AVDISCARD_ALL;
+            }
+            dec = openDecoder(ctx->streams[video_stream_index]->codecpar);
+            if (out.begin != AV_NOPTS_VALUE &&
+                  av_seek_frame(ctx, video_stream_index, out.begin, AVSEEK_FLAG_BACKWARD) < 0)
+               throw std::runtime_error("Failed to seek to segment start");
+
+            decodeRange(ctx, dec, out, nullptr, hasher.get(), pkt, frame); // no --temporal here
+         } catch (const std::exception& ex) {
+            out.error = ex.what();
+         }
+
+         av_frame_free(&frame);
+         av_packet_free(&pkt);
+         if (dec)
+            avcodec_free_context(&dec);
+         if (ctx)
+            avformat_close_input(&ctx);
+
+         std::lock_guard<std::mutex> lock(out.mutex);
+         out.done = true;
+         out.cv.notify_one();
+      }
+
+      void runSegmented() {
+         bool key_pts = false;
+         std::vector<int64_t> splits = segmentSplitPoints(segments, key_pts);
+         if (splits.empty()) {
+            std::cerr << "[Segments] No keyframe index to split at, decoding sequentially\n";
+            runThreaded();
+            return;
+         }
+
+         std::vector<std::unique_ptr<SegmentOutput> > outputs;
+         for (size_t k = 0; k <= splits.size(); k++) {
+            outputs.emplace_back(new SegmentOutput);
+            outputs[k]->begin = k ? splits[k - 1] : AV_NOPTS_VALUE;
+            outputs[k]->finish = k < splits.size() ? splits[k] : AV_NOPTS_VALUE;
+            outputs[k]->key_pts = key_pts;
+         }
+         info << "Segmented decode: " << outputs.size() << " segments\n";
+
+         std::vector<std::thread> workers;
+         for (size_t k = 0; k < outputs.size(); k++)
+            workers.emplace_back(&FFmpegDemuxSeeker::decodeSegment, this, std::ref(*outputs[k]));
+
+         // replay in file order as soon as the earliest unfinished range has reports
+         for (size_t k = 0; k < outputs.size(); k++) {
+            SegmentOutput& out = *outputs[k];
+            for (;;) {
+               std::unique_lock<std::mutex> lock(out.mutex);
+               out.cv.wait(lock, [&out] { return out.done || !out.reports.empty(); });
+               if (out.reports.empty())
+                  break;
+               std::deque<FrameReport> batch;
+               batch.swap(out.reports);
+               lock.unlock();
+               for (size_t i = 0; i < batch.size(); i++)
+                  printFrameReport(batch[i]);
+            }
+            logRangeError(out);
+         }
+         for (size_t k = 0; k < workers.size(); k++)
+            workers[k].join();
+
+         if (outputs.back()->reached_eof) {
+            run_stats.reached_eof = true;
+            logEvent(EV_EOF);
+         }
+      }
+
+      // Logs and counts the failure of a segment or sampled GOP; false if it had none.
+      bool logRangeError(const SegmentOutput& out) {
+         char errbuf[AV_ERROR_MAX_STRING_SIZE];
+         const char* text = nullptr;
+         if (!out.error.empty())
+            text = out.error.c_str();
+         else if (out.read_error)
+            text = av_make_error_string(errbuf, AV_ERROR_MAX_STRING_SIZE, out.read_error);
+         if (!text)
+            return false;
+         LogRecord record = makeRecord(EV_READ_ERROR);
+         setRecordText(record, text);
+         pushRecord(record);
+         run_stats.read_errors++;
+         metrics.count(CNT_READ_ERRORS);
+         return true;
+      }
+
+      // Every per-frame verdict a sampled GOP can add to.
+      uint64_t damageCount() const {
+         return run_stats.corrupt_frames + run_stats.visual_corruption + run_stats.read_errors +
+            run_stats.temporal_freezes + run_stats.temporal_flashes + run_stats.temporal_tears;
+      }
+
+      /* --sample: decodes only the chosen GOPs, on this thread with the main
+       * demuxer and decoder, one seek each. They are visited in file-offset
+       * order, so the reads move forward through the file like a sequential
+       * scan that skips ahead. A sampled GOP is damaged if any of its frames
+       * was flagged, it hit a read error, or it decoded nothing at all.
+       */
+      void runSampled() {
+         bool key_pts = false;
+         const std::vector<KeyframeEntry> keys = keyframeList("GOP sampling", key_pts);
+         if (keys.empty()) // a full decode instead would cost what sampling is meant to save
+            throw std::runtime_error("GOP sampling: no keyframe index to sample from");
+         const std::vector<size_t> picked = sampleGops(keys, sample_plan);
+         run_stats.total_gops = keys.size();
+         info << "Sampling " << picked.size() << " of " << keys.size() << " GOPs\n";
+
+         for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+            if (static_cast<int>(i) != video_stream_index)
+               fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+         }
+         const AVRational tb = fmt_ctx->streams[video_stream_index]->time_base;
+         AVPacket* pkt = av_packet_alloc();
+         AVFrame* frame = av_frame_alloc();
+         std::unique_ptr<FrameHasher> hasher;
+         if (enable_hash)
+            hasher.reset(new FrameHasher(hash_algo));
+
+         for (size_t k = 0; k < picked.size() && !quit_flag; k++) {
+            const size_t i = picked[k];
+            SegmentOutput out;
+            out.begin = keys[i].pts;
+            out.finish = i + 1 < keys.size() ? keys[i + 1].pts : AV_NOPTS_VALUE;
+            out.key_pts = key_pts;
+            const uint64_t damage_before = damageCount();
+            if (seekVideo(out.begin)) {
+               metrics.count(CNT_SEEKS);
+               LogRecord record = makeRecord(EV_SEEK);
+               record.timestamp = out.begin * av_q2d(tb);
+               pushRecord(record);
+               avcodec_flush_buffers(codec_ctx); // drained by the previous GOP
+               if (temporal)
+                  temporal->reset(); // GOPs are not contiguous
+               decodeRange(fmt_ctx, codec_ctx, out, temporal.get(), hasher.get(), pkt, frame);
+            } else {
+               out.error = "seek to sampled GOP failed";
+            }
+            if (quit_flag)
+               break; // a partial GOP is not a sample
+            for (size_t r = 0; r < out.reports.size(); r++)
+               printFrameReport(out.reports[r]);
+            if (!logRangeError(out) && out.reports.empty()) {
+               out.error = "sampled GOP decoded no frames";
+               logRangeError(out);
+            }
+            run_stats.sampled_gops++;
+            run_stats.damaged_gops += damageCount() > damage_before;
+         }
+         av_frame_free(&frame);
+         av_packet_free(&pkt);
+
+         if (!quit_flag) {
+            run_stats.reached_eof = true; // every sample visited
+            logEvent(EV_EOF);
+         }
+         printSampleSummary();
+      }
+
+      void printSampleSummary() {
+         const RateEstimate est = wilsonInterval(run_stats.damaged_gops, run_stats.sampled_gops);
+         char line[160];
+         snprintf(line, sizeof(line), "Sample: %llu of %llu GOPs decoded, %llu damaged | rate %.2f%% (95%% CI %.2f-%.2f%%)\n",
+               static_cast<unsigned long long>(run_stats.sampled_gops),
+               static_cast<unsigned long long>(run_stats.total_gops),
+               static_cast<unsigned long long>(run_stats.damaged_gops),
+               est.rate * 100, est.low * 100, est.high * 100);
+         info << line;
+      }
+
+      /* --scan packets: reads the whole file on this thread without a
+       * decoder, at disk speed. Records the keyframe index on the way when
+       * there is no sidecar yet.
+       */
+      void runPacketScan() {
+         PacketScanner scanner(fmt_ctx, scan_streams);
+         std::vector<int64_t> ordinals(fmt_ctx->nb_streams, 0);
+         AVPacket* packet = av_packet_alloc();
+         int ret = 0;
+         while (!quit_flag) {
+            const uint64_t read_start = StageMetrics::now();
+            ret = av_read_frame(fmt_ctx, packet);
+            metrics.record(STAGE_READ, read_start);
+            if (ret < 0)
+               break;
+            const uint32_t anomalies = scanner.check(packet);
+            if (packet->stream_index == video_stream_index) {
+               metrics.count(CNT_PACKETS);
+               if (index_recording && (packet->flags & AV_PKT_FLAG_KEY))
+                  kf_index.add(packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts, packet->pos);
+            }
+            if (anomalies) {
+               LogRecord record = makeRecord(EV_PACKET_ANOMALY);
+               record.stream = static_cast<uint8_t>(std::min(packet->stream_index, 255));
+               record.flags = anomalies;
+               record.frame_number = ordinals[packet->stream_index];
+               record.pts = packet->pts;
+               record.dts = packet->dts;
+               record.timestamp = packet->dts != AV_NOPTS_VALUE
+                  ? packet->dts * av_q2d(fmt_ctx->streams[packet->stream_index]->time_base) : -1;
+               std::string names;
+               for (uint32_t bit = 1; bit <= anomalies; bit <<= 1) {
+                  if (anomalies & bit)
+                     names += (names.empty() ? "" : ", ") + std::string(packetAnomalyName(bit));
+               }
+               names += " | " + std::to_string(packet->size) + " B";
+               setRecordText(record, names.c_str());
+               pushRecord(record);
+            }
+            ordinals[packet->stream_index]++;
+            av_packet_unref(packet);
+         }
+         av_packet_free(&packet);
+
+         if (ret == AVERROR_EOF) {
+            run_stats.reached_eof = true;
+            logEvent(EV_EOF);
+            if (index_recording) {
+               index_complete = true;
+               kf_index.save(KeyframeIndex::sidecarPath(input_path), media_id, video_stream_index);
+            }
+         } else if (ret < 0) {
+            char errbuf[AV_ERROR_MAX_STRING_SIZE];
+            run_stats.read_errors++;
+            metrics.count(CNT_READ_ERRORS);
+            LogRecord record = makeRecord(EV_READ_ERROR);
+            setRecordText(record, av_make_error_string(errbuf, AV_ERROR_MAX_STRING_SIZE, ret));
+            pushRecord(record);
+         }
+         run_stats.packet_scan = scanner.stats();
+         printPacketScanSummary();
+      }
+
+      void printPacketScanSummary() {
+         for (size_t k = 0; k < run_stats.packet_scan.size(); k++) {
+            const PacketScanStats& st = run_stats.packet_scan[k];
+            info << "Packets #" << st.index << " (" << st.type << "): " << st.packets << " packets, "
+               << (st.bytes >> 10) << " KiB, " << st.keyframes << " keyframes";
+            if (st.missing_ts)
+               info << ", " << st.missing_ts << " without timestamps";
+            info << " | corrupt " << st.corrupt << " | empty " << st.empty << " | non-monotonic DTS "
+               << st.non_monotonic << " | PTS<DTS " << st.pts_before_dts << " | gaps " << st.gaps
+               << " | oversized " << st.oversized << "\n";
+         }
+         info << (run_stats.damaged() ? "Scan: SUSPICIOUS, run a full decode\n" : "Scan: clean\n");
+      }
+
+      // Reads packets and handles seeks; never touches the decoder.
+      void demuxLoop() {
+         AVPacket* packet = av_packet_alloc();
+
+         while (!quit_flag) {
+            if (seek_requested) {
+               std::lock_guard<std::mutex> lock(seek_mutex);
+               int64_t new_pos = seek_absolute != AV_NOPTS_VALUE ? seek_absolute : current_pos + seek_offset;
+               seek_absolute = AV_NOPTS_VALUE;
+               if (new_pos < 0) new_pos = 0;
+               if (new_pos > duration) new_pos = duration;
+               current_pos = new_pos;
+
+               int64_t ts = av_rescale_q(new_pos, AV_TIME_BASE_Q,
+                     fmt_ctx->streams[video_stream_index]->time_base);
+               index_recording = false; // the recorded index now has a gap
+
+               // a cached GOP is replayed by the decoder, so demuxing
+               // continues at the keyframe that follows it
+               GopRef gop;
+               if (gop_cache)
+                  gop = gop_cache->find(ts);
+               bool seeked = gop && seekVideo(gop->end);
+               if (!seeked) {
+                  gop.reset();
+                  seeked = seekVideo(ts);
+               }
+
+               if (!seeked) {
+                  logEvent(EV_SEEK_FAILED);
+                  if (hold_at_eof)
+                     traceSeekFailed();
+               } else {
+                  metrics.count(CNT_SEEKS);
+                  // the decoder flushes when it reaches this token; anything
+                  // queued before it belongs to the old position and is dropped
+                  int serial = ++seek_serial;
+                  if (hold_at_eof)
+                     traceSeek(serial, ts, gop);
+                  packet_queue.push(PacketItem{PacketItem::FLUSH, nullptr, serial, ts, gop});
+                  for (size_t k = 0; k < stream_decoders.size(); k++)
+                     stream_decoders[k]->flush(serial);
+                  LogRecord record = makeRecord(EV_SEEK);
+                  record.timestamp = static_cast<double>(new_pos) / AV_TIME_BASE;
+                  record.flags = (gop ? LOGF_SEEK_CACHED : 0) |
+                     (seek_mode == SEEK_EXACT ? LOGF_SEEK_EXACT : 0);
+                  pushRecord(record);
+               }
+
+               seek_requested = false;
+            }
+
+            const uint64_t read_start = StageMetrics::now();
+            int ret = av_read_frame(fmt_ctx, packet);
+            metrics.record(STAGE_READ, read_start);
+            if (ret < 0) {
+               if (ret == AVERROR_EOF) {
+                  run_stats.reached_eof = true;
+                  logEvent(EV_EOF);
+                  if (index_recording) {
+                     index_complete = true;
+                     kf_index.save(KeyframeIndex::sidecarPath(input_path), media_id, video_stream_index);
+                  }
+                  packet_queue.push(PacketItem{PacketItem::END, nullptr, seek_serial, AV_NOPTS_VALUE, GopRef()});
+                  for (size_t k = 0; k < stream_decoders.size(); k++)
+                     stream_decoders[k]->finish(seek_serial);
+                  if (hold_at_eof && waitForSeek())
+                     continue; // the next seek rewinds us
+               } else {
+                  char errbuf[AV_ERROR_MAX_STRING_SIZE];
+                  run_stats.read_errors++;
+                  metrics.count(CNT_READ_ERRORS);
+                  LogRecord record = makeRecord(EV_READ_ERROR);
+                  setRecordText(record, av_make_error_string(errbuf, AV_ERROR_MAX_STRING_SIZE, ret));
+                  pushRecord(record);
+               }
+               break;
+            }
+
+            if (packet->stream_index != video_stream_index) {
+               StreamDecoder* route = static_cast<size_t>(packet->stream_index) < stream_routes.size()
+                  ? stream_routes[packet->stream_index] : nullptr;
+               if (route && route->push(packet, seek_serial))
+                  continue;
+               av_packet_unref(packet);
+               continue;
+            }
+            metrics.count(CNT_PACKETS);
+            if (index_recording && (packet->flags & AV_PKT_FLAG_KEY))
+               kf_index.add(packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts, packet->pos);
+
+            // backpressure: wait for the decoder to free budget before queueing more
+            const uint64_t bytes = packetBytes(packet);
+            if (!budget.acquire(BUDGET_PACKETS, bytes)) {
+               av_packet_unref(packet);
+               break;
+            }
+            AVPacket* queued;
+            if (!free_packets.tryPop(queued)) {
+               queued = av_packet_alloc();
+               packet_allocs.fetch_add(1, std::memory_order_relaxed);
+            }
+            av_packet_move_ref(queued, packet);
+            if (!packet_queue.push(PacketItem{PacketItem::PACKET, queued, seek_serial, AV_NOPTS_VALUE, GopRef()})) {
+               budget.release(BUDGET_PACKETS, bytes);
+               av_packet_free(&queued);
+               break;
+            }
+         }
+
+         packet_queue.close();
+         for (size_t k = 0; k < stream_decoders.size(); k++)
+            stream_decoders[k]->close();
+         av_packet_free(&packet);
+      }
+
+      // Owns codec_ctx: decodes queued packets and reports every frame.
+      void decodeLoop() {
+         AVFrame* frame = av_frame_alloc();
+         PacketItem item;
+
+         while (!quit_flag && packet_queue.pop(item)) {
+            if (item.kind == PacketItem::FLUSH) {
+               avcodec_flush_buffers(codec_ctx);
+               active_serial = item.serial;
+               pacer.reset(); // new timeline from the first frame after the seek
+               recording_gop.reset(); // partial GOP
+               if (temporal)
+                  temporal->reset(); // the jump is not a flash or a tear
+               discard_before = (seek_mode == SEEK_EXACT) ? item.target : AV_NOPTS_VALUE;
+               if (item.gop)
+                  replayGop(*item.gop);
+            } else if (item.kind == PacketItem::END) {
+               decodePacket(nullptr, frame); // drain delayed frames
+               recording_gop.reset(); // no following keyframe, never cached
+               if (hold_at_eof)
+                  traceEnded(); // the stress driver decides when we are done
+               else
+                  quit_flag = true;
+            } else {
+               if (item.serial == seek_serial) {
+                  if (!checkpoint_path.empty() && (item.pkt->flags & AV_PKT_FLAG_KEY))
+                     recent_keys[recent_key_count++ % 8] = KeyframeEntry{item.pkt->pts, item.pkt->pos};
+                  decodePacket(item.pkt, frame);
+               }
+               budget.release(BUDGET_PACKETS, packetBytes(item.pkt));
+               // hand the shell back to the demux thread instead of freeing it
+               av_packet_unref(item.pkt);
+               if (!free_packets.tryPush(item.pkt))
+                  av_packet_free(&item.pkt);
+            }
+         }
+
+         packet_queue.close(); // unblocks the demux thread if we stopped early
+         budget.close();
+         if (hash_pool)
+            hash_pool->flush();
+         av_frame_free(&frame);
+      }
+
+      // packet == nullptr enters draining mode
+      void decodePacket(AVPacket* packet, AVFrame* frame) {
+         const uint64_t send_start = StageMetrics::now();
+         int ret = avcodec_send_packet(codec_ctx, packet);
+         metrics.record(STAGE_SEND, send_start);
+         if (ret == AVERROR(EAGAIN))
+            metrics.count(CNT_EAGAIN_SEND);
+         if (ret != 0)
+            return;
+
+         for (;;) {
+            const uint64_t receive_start = StageMetrics::now();
+            ret = avcodec_receive_frame(codec_ctx, frame);
+            metrics.record(STAGE_RECEIVE, receive_start);
+            if (ret == AVERROR(EAGAIN))
+               metrics.count(CNT_EAGAIN_RECEIVE);
+            if (ret < 0)
+               break;
+            if (hold_at_eof)
+               traceFrame(frame);
+            if (gop_cache)
+               recordGopFrame(frame);
+            // exact seek: decoded for reference only
+            if (discard_before == AV_NOPTS_VALUE || frame->pts == AV_NOPTS_VALUE ||
+                  frame->pts >= discard_before)
+               outputFrame(frame, packet);
+            av_frame_unref(frame);
+         }
+      }
+
+      void outputFrame(const AVFrame* frame, const AVPacket* packet) {
+         waitWhilePaused();
+         pacer.wait(frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp,
+               fmt_ctx->streams[video_stream_index]->time_base);
+         if (frame_sink) {
+            // a new reference to the decoder's buffers, owned by the sink
+            AVFrame* ref = av_frame_alloc();
+            if (ref && av_frame_ref(ref, frame) == 0)
+               frame_sink(ref);
+            else
+               av_frame_free(&ref);
+         }
+
+         // Update the current_pos here
+         if (frame->pts != AV_NOPTS_VALUE) {
+            current_pos = av_rescale_q(frame->pts,
+                  fmt_ctx->streams[video_stream_index]->time_base,
+                  AV_TIME_BASE_Q);
+         }
+
+         FrameReport report = makeFrameReport(frame, packet, temporal.get());
+         if (hash_pool) {
+            // the pool keeps a reference until hashed: charged so slow hashing throttles decoding
+            report.budget_bytes = frameBytes(frame);
+            if (!budget.acquire(BUDGET_FRAMES, report.budget_bytes))
+               report.budget_bytes = 0;
+            hash_pool->submit(frame, report); // printed in order once hashed
+         }
+         else
+            printFrameReport(report);
+      }
+
+      // Outputs a cached GOP in place of decoding it again. Demuxing resumed
+      // at gop.end, so anything the decoder produces before that is a repeat.
+      void replayGop(const CachedGop& gop) {
+         for (size_t i = 0; i < gop.frames.size() && !quit_flag; i++) {
+            const AVFrame* cached = gop.frames[i];
+            if (hold_at_eof)
+               traceFrame(cached);
+            if (discard_before == AV_NOPTS_VALUE || cached->pts >= discard_before)
+               outputFrame(cached, nullptr);
+         }
+         discard_before = gop.end;
+      }
+
+      // Collects decoded frames per GOP; a GOP goes into the cache once the
+      // next keyframe closes it.
+      void recordGopFrame(const AVFrame* frame) {
+         if (frame->pts == AV_NOPTS_VALUE) {
+            recording_gop.reset(); // can't be looked up by time
+            return;
+         }
+         if (isKeyFrame(frame)) {
+            if (recording_gop) {
+               recording_gop->end = frame->pts;
+               gop_cache->insert(std::move(recording_gop));
+            }
+            recording_gop.reset(new CachedGop(frame->pts));
+         }
+         if (recording_gop && !gop_cache->append(*recording_gop, frame, decoder_type == HARDWARE))
+            recording_gop.reset();
+      }
+
+      FrameReport makeFrameReport(const AVFrame* frame, const AVPacket* packet, TemporalDetector* temporal_detector) {
+         FrameReport report;
+         report.pts = frame->pts;
+         report.dts = frame->pkt_dts;
+         report.pkt_pts = packet ? packet->pts : -1;
+         report.timestamp = (frame->pts != AV_NOPTS_VALUE)
+            ? frame->pts * av_q2d(fmt_ctx->streams[video_stream_index]->time_base)
+            : -1;
+         report.width = frame->width;
+         report.height = frame->height;
+         report.format = frame->format;
+         report.pict_type = av_get_picture_type_char(frame->pict_type);
+         report.key = frame->flags & AV_FRAME_FLAG_KEY;
+         report.decode_error_flags = frame->decode_error_flags;
+         if (report.key && !checkpoint_path.empty() && segments <= 1) {
+            for (unsigned i = 0; i < std::min(recent_key_count, 8u); i++) {
+               if (recent_keys[i].pts == frame->pts)
+                  report.key_pos = recent_keys[i].pos;
+            }
+         }
+         report.corrupt = (frame->flags & AV_FRAME_FLAG_CORRUPT) ||
+            frame->decode_error_flags ||
+            (packet && (packet->flags & AV_PKT_FLAG_CORRUPT));
+         const uint64_t detect_start = StageMetrics::now();
+         report.detect = detector.analyze(frame);
+         if (temporal_detector)
+            report.temporal = temporal_detector->analyze(frame);
+         metrics.record(STAGE_DETECT, detect_start);
+         return report;
+      }
+
+      // Decode thread, before a frame goes out: holds it while paused unless a step releases it.
+      void waitWhilePaused() {
+         std::unique_lock<std::mutex> lock(pause_mutex);
+         if (!paused)
+            return;
+         pause_cv.wait(lock, [this] { return !paused || step_frames > 0 || quit_flag; });
+         if (paused && step_frames > 0)
+            step_frames--;
+         pacer.reset(); // don't rush to catch up with the time spent paused
+      }
+
+      // Demux thread at EOF during a stress run: false once we should stop.
+      bool waitForSeek() {
+         std::unique_lock<std::mutex> lock(seek_mutex);
+         seek_cv.wait(lock, [this] { return seek_requested || quit_flag; });
+         return !quit_flag;
+      }
+
+      /* Seek stress driver, replaces the keyboard thread. Runs the plan one
+       * seek at a time: each seek is requested, then we wait until the
+       * decoder produced a frame at/after the target (or gave up) before
+       * the next one, so latencies don't overlap.
+       */
+      void seekStressLoop() {
+         const int timeout_ms = 10000;
+         // opening and the first decode are not part of any seek
+         auto wait_start = std::chrono::steady_clock::now();
+         while (!quit_flag && metrics.counter(CNT_FRAMES) == 0 &&
+               std::chrono::steady_clock::now() - wait_start < std::chrono::milliseconds(timeout_ms))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+         const AVStream* st = fmt_ctx->streams[video_stream_index];
+         const int64_t start_ts = st->start_time != AV_NOPTS_VALUE ? st->start_time : 0;
+         const int64_t start_us = av_rescale_q(start_ts, st->time_base, AV_TIME_BASE_Q);
+         const std::vector<SeekStep> steps = seekSteps(seek_plan, static_cast<double>(duration) / AV_TIME_BASE);
+         auto toSeconds = [&](int64_t ts) {
+            return ts == AV_NOPTS_VALUE ? -1.0 : (ts - start_ts) * av_q2d(st->time_base);
+         };
+
+         auto wall_start = std::chrono::steady_clock::now();
+         for (size_t i = 0; i < steps.size() && !quit_flag; i++) {
+            int64_t pos = static_cast<int64_t>(steps[i].seconds * AV_TIME_BASE) +
+               (steps[i].relative ? current_pos.load() : start_us);
+            {
+               std::lock_guard<std::mutex> lock(trace.mutex);
+               trace.active = true;
+               trace.serial = 0;
+               trace.target = trace.expected_key = trace.landed_key = AV_NOPTS_VALUE;
+               trace.cached = trace.failed = trace.ended = false;
+               trace.first_ms = trace.target_ms = -1;
+               trace.requested = std::chrono::steady_clock::now();
+            }
+            requestSeekTo(std::max<int64_t>(0, pos));
+
+            SeekSample sample;
+            std::unique_lock<std::mutex> lock(trace.mutex);
+            bool finished = trace.cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] {
+                  return trace.target_ms >= 0 || trace.failed || trace.ended || quit_flag; });
+            trace.active = false;
+            sample.target = toSeconds(trace.target);
+            sample.cached = trace.cached;
+            sample.first_ms = trace.first_ms;
+            sample.target_ms = trace.target_ms;
+            sample.landed = toSeconds(trace.landed_key);
+            sample.expected = toSeconds(trace.expected_key);
+            if (trace.failed)
+               sample.outcome = SEEK_FAILED;
+            else if (!finished || quit_flag)
+               sample.outcome = SEEK_TIMEOUT;
+            else if (trace.target_ms < 0)
+               sample.outcome = SEEK_NO_FRAME;
+            else if (trace.landed_key != AV_NOPTS_VALUE && (trace.landed_key > trace.target ||
+                     (trace.expected_key != AV_NOPTS_VALUE && trace.landed_key != trace.expected_key)))
+               sample.outcome = SEEK_BAD_PTS;
+            else
+               sample.outcome = SEEK_OK;
+            lock.unlock();
+            seek_samples.push_back(sample);
+         }
+         seek_wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+         std::lock_guard<std::mutex> lock(seek_mutex);
+         quit_flag = true;
+         seek_cv.notify_all();
+      }
+
+      // Demux thread, before the FLUSH is queued.
+      void traceSeek(int serial, int64_t ts, const GopRef& gop) {
+         int64_t expected = AV_NOPTS_VALUE;
+         if (gop)
+            expected = gop->start; // replayed from its keyframe
+         else if (!kf_index.empty() && (index_complete || ts < kf_index.at(kf_index.size() - 1).pts)) {
+            const KeyframeEntry* key = kf_index.find(ts);
+            if (key)
+               expected = key->pts;
+         }
+         std::lock_guard<std::mutex> lock(trace.mutex);
+         if (!trace.active)
+            return;
+         trace.serial = serial;
+         trace.target = ts;
+         trace.expected_key = expected;
+         trace.cached = static_cast<bool>(gop);
+      }
+
+      void traceSeekFailed() {
+         std::lock_guard<std::mutex> lock(trace.mutex);
+         if (trace.active) {
+            trace.failed = true;
+            trace.cv.notify_all();
+         }
+      }
+
+      // Decode thread: every frame after a traced seek until the target is reached.
+      void traceFrame(const AVFrame* frame) {
+         std::lock_guard<std::mutex> lock(trace.mutex);
+         if (!trace.active || trace.serial != active_serial || trace.target_ms >= 0)
+            return;
+         double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - trace.requested).count();
+         if (trace.first_ms < 0)
+            trace.first_ms = ms;
+         if (trace.landed_key == AV_NOPTS_VALUE && isKeyFrame(frame))
+            trace.landed_key = frame->pts;
+         if (frame->pts != AV_NOPTS_VALUE && frame->pts >= trace.target) {
+            trace.target_ms = ms;
+            trace.cv.notify_all();
+         }
+      }
+
+      void traceEnded() {
+         std::lock_guard<std::mutex> lock(trace.mutex);
+         if (trace.active && trace.serial == active_serial) {
+            trace.ended = true;
+            trace.cv.notify_all();
+         }
+      }
+
+      // Called in frame order, either from the decode thread or from the hash pool.
+      // Only fills fixed-size records; formatting happens on the log writer thread.
+      void printFrameReport(const FrameReport& report) {
+         const uint64_t output_start = StageMetrics::now();
+         // resume point: a clean keyframe, before it is counted
+         if (!checkpoint_path.empty() && report.key && !report.corrupt && !report.detect.corrupt() &&
+               report.pts != AV_NOPTS_VALUE &&
+               (!last_checkpoint_ns || output_start - last_checkpoint_ns >= checkpoint_interval_ns))
+            saveCheckpoint(report, output_start);
+         LogRecord record = makeRecord(EV_FRAME);
+         record.frame_number = frame_number++;
+         record.pict_type = report.pict_type;
+         record.pts = report.pts;
+         record.dts = report.dts;
+         record.pkt_pts = report.pkt_pts;
+         record.timestamp = report.timestamp;
+         record.width = report.width;
+         record.height = report.height;
+         record.format = report.format;
+         record.decode_error_flags = report.decode_error_flags;
+         if (report.corrupt)
+            record.flags |= LOGF_CORRUPT;
+         if (report.pts == AV_NOPTS_VALUE)
+            record.flags |= LOGF_MISSING_PTS;
+         run_stats.frames++;
+         const uint64_t frames_here = run_stats.frames - resumed_frames;
+         if (frames_here == WARMUP_FRAMES) {
+            warm_heap = allocSnapshot();
+            warm_buffers = frame_pool ? frame_pool->allocated() : 0;
+            warm_packets = packet_allocs;
+         } else if (frames_here > WARMUP_FRAMES) {
+            run_stats.warm_frames = frames_here - WARMUP_FRAMES;
+            run_stats.warm_heap_allocs = allocSnapshot().allocs - warm_heap.allocs;
+            run_stats.heap_counted = warm_heap.counting;
+            run_stats.warm_buffer_allocs = (frame_pool ? frame_pool->allocated() : 0) - warm_buffers;
+            run_stats.warm_packet_allocs = packet_allocs - warm_packets;
+         }
+         run_stats.corrupt_frames += report.corrupt;
+         run_stats.missing_pts += report.pts == AV_NOPTS_VALUE;
+         run_stats.visual_corruption += report.detect.corrupt();
+         if (enable_hash) {
+            setRecordText(record, hashAlgoName(hash_algo));
+            record.digest_len = report.digest.len;
+            memcpy(record.digest, report.digest.bytes, report.digest.len);
+         }
+         pushRecord(record);
+         if (hash_db || golden)
+            checkHashRecord(report, record);
+
+         const DetectorResult& detect = report.detect;
+         if (detect.corrupt()) {
+            record.type = EV_VISUAL_CORRUPTION;
+            record.flags = (decoder_type == HARDWARE ? LOGF_HW_DECODER : 0) |
+               (detect.solid_luma ? LOGF_DETECT_SOLID : 0) |
+               (detect.flat_chroma ? LOGF_DETECT_FLAT_UV : 0) |
+               (detect.partial ? LOGF_DETECT_PARTIAL : 0);
+            setRecordText(record, detect.nb_regions ? detect.describe().c_str() : "");
+            pushRecord(record);
+         }
+         const TemporalResult& temporal_hit = report.temporal;
+         if (temporal_hit.corrupt()) {
+            run_stats.temporal_freezes += temporal_hit.freeze;
+            run_stats.temporal_flashes += temporal_hit.flash;
+            run_stats.temporal_tears += temporal_hit.tear;
+            record.type = EV_TEMPORAL;
+            record.flags = (temporal_hit.freeze ? LOGF_TEMPORAL_FREEZE : 0) |
+               (temporal_hit.flash ? LOGF_TEMPORAL_FLASH : 0) |
+               (temporal_hit.tear ? LOGF_TEMPORAL_TEAR : 0);
+            if (temporal_hit.flash && !temporal_hit.freeze && !temporal_hit.tear) {
+               record.pts = temporal_hit.flash_pts; // the spike itself, one frame back
+               record.frame_number--;
+            }
+            setRecordText(record, temporal_hit.describe().c_str());
+            pushRecord(record);
+         }
+         metrics.count(CNT_FRAMES);
+         metrics.count(CNT_CORRUPT_FRAMES, report.corrupt);
+         metrics.count(CNT_VISUAL_CORRUPTION, report.detect.corrupt());
+         metrics.record(STAGE_OUTPUT, output_start);
+      }
+
+      // Output thread: stores the digest and/or checks it against the golden run.
+      void checkHashRecord(const FrameReport& report, const LogRecord& frame_record) {
+         HashRecord entry;
+         memset(&entry, 0, sizeof(entry));
+         entry.pts = report.pts;
+         entry.flags = (report.corrupt ? HASHF_CORRUPT : 0) | (report.key ? HASHF_KEY : 0) |
+            (report.detect.corrupt() ? HASHF_VISUAL : 0);
+         entry.pict_type = report.pict_type;
+         entry.digest_len = report.digest.len;
+         memcpy(entry.digest, report.digest.bytes, report.digest.len);
+         if (hash_db)
+            hash_db->add(entry);
+         if (!golden)
+            return;
+
+         const int64_t index = golden->find(report.pts, frame_record.frame_number);
+         if (index < 0) {
+            run_stats.hash_unknown++;
+            return;
+         }
+         if (!golden_seen[index]) {
+            golden_seen[index] = true;
+            golden_seen_count++;
+         }
+         const HashRecord& expected = golden->at(index);
+         if (expected.digest_len == entry.digest_len &&
+               memcmp(expected.digest, entry.digest, entry.digest_len) == 0) {
+            run_stats.hash_matches++;
+            return;
+         }
+         run_stats.hash_mismatches++;
+         FrameDigest golden_digest;
+         golden_digest.len = std::min<int>(expected.digest_len, sizeof(golden_digest.bytes));
+         memcpy(golden_digest.bytes, expected.digest, golden_digest.len);
+         LogRecord record = frame_record;
+         record.type = EV_HASH_MISMATCH;
+         setRecordText(record, golden_digest.hex().c_str());
+         pushRecord(record);
+         if (stop_on_mismatch && !quit_flag) {
+            std::cerr << "[Hash] Stopping at the first mismatch (frame #" << frame_record.frame_number
+               << ", PTS " << report.pts << ")\n";
+            quit(); // also releases a paused or stepping decode thread
+         }
+      }
+
+      void finishHashDb() {
+         if (hash_db) {
+            const uint64_t records = hash_db->count();
+            if (!hash_db->close())
+               std::cerr << "[Hash] Failed to write the hash database\n";
+            info << "Hash database: " << records << " frames\n";
+            hash_db.reset();
+         }
+         if (golden) {
+            std::cout << "Hash compare: " << run_stats.hash_matches << " match | "
+               << run_stats.hash_mismatches << " mismatch | " << run_stats.hash_unknown << " not in golden | "
+               << (golden->size() - golden_seen_count) << " of " << golden->size()
+               << " golden frames not decoded\n";
+            golden.reset();
+         }
+      }
+
+      /* --checkpoint / --resume. A checkpoint is only valid for the file it
+       * was taken on: size, mtime and fingerprint have to match, like the
+       * keyframe index sidecar.
+       */
+      void setupCheckpoint(const SeekerOptions& options) {
+         if (segments > 1)
+            throw std::runtime_error("--checkpoint needs a sequential run, not --segments");
+         // their state (golden frames seen, per-stream totals) is not part of the checkpoint
+         if (!options.compare_db.empty() || options.streams.all || !options.streams.specs.empty())
+            throw std::runtime_error("--checkpoint does not combine with --compare or --streams");
+         if (!media_id.size && !MediaIdentity::of(input_path, media_id))
+            throw std::runtime_error("--checkpoint needs a local file");
+         const AVStream* st = fmt_ctx->streams[video_stream_index];
+         checkpoint_path = options.checkpoint;
+         checkpoint_interval_ns = static_cast<uint64_t>(std::max(0.0, options.checkpoint_interval) * 1e9);
+         initCheckpoint(checkpoint);
+         checkpoint.identity = media_id;
+         checkpoint.stream_index = video_stream_index;
+         checkpoint.tb_num = st->time_base.num;
+         checkpoint.tb_den = st->time_base.den;
+
+         if (options.resume) {
+            std::string error;
+            if (!readCheckpoint(checkpoint_path, resume_state, error))
+               throw std::runtime_error("Cannot resume: " + error);
+            if (!(resume_state.identity == media_id) || resume_state.stream_index != video_stream_index ||
+                  resume_state.tb_num != st->time_base.num || resume_state.tb_den != st->time_base.den)
+               throw std::runtime_error("Cannot resume: " + checkpoint_path + " was written for another file");
+            if (resume_state.complete)
+               info << "Checkpoint: the previous run completed, starting from the beginning\n";
+            else
+               resuming = resume_state.keyframe_pts != AV_NOPTS_VALUE;
+         }
+         info << "Checkpoint: " << checkpoint_path << " every " << options.checkpoint_interval << "s\n";
+         if (resuming)
+            info << "Resuming at frame #" << resume_state.frame_number << " (keyframe PTS "
+               << resume_state.keyframe_pts << ", " << resume_state.keyframe_pts * av_q2d(st->time_base) << "s)\n";
+      }
+
+      // --resume: the log cut back to the checkpoint, like the hash database, so
+      // the frames after it are not logged twice. Appended to if the crashed
+      // run had no log file.
+      static FILE* reopenLog(const std::string& path, int64_t keep) {
+         if (keep < 0)
+            return fopen(path.c_str(), "a");
+         FILE* log = fopen(path.c_str(), "r+");
+         if (!log)
+            return nullptr;
+         struct stat st;
+         if (fstat(fileno(log), &st) != 0 || st.st_size < keep) {
+            fclose(log);
+            throw std::runtime_error("Cannot resume: " + path + " is shorter than the checkpoint's log");
+         }
+         if (ftruncate(fileno(log), keep) != 0 || fseeko(log, keep, SEEK_SET) != 0) {
+            fclose(log);
+            throw std::runtime_error("Failed to truncate log file " + path);
+         }
+         return log;
+      }
+
+      // Before the threads start: lands on the checkpoint keyframe and restores the totals.
+      void resumeFromCheckpoint() {
+         const CheckpointState& cp = resume_state;
+         const bool seeked = (byte_seek && cp.keyframe_pos >= 0 &&
+               av_seek_frame(fmt_ctx, video_stream_index, cp.keyframe_pos, AVSEEK_FLAG_BYTE) >= 0) ||
+            av_seek_frame(fmt_ctx, video_stream_index, cp.keyframe_pts, AVSEEK_FLAG_BACKWARD) >= 0;
+         if (!seeked) // the hash database was already cut back to the checkpoint
+            throw std::runtime_error("Cannot resume: seek to the checkpoint keyframe failed");
+         index_recording = false; // the recorded index would start at the keyframe
+         discard_before = cp.keyframe_pts; // leading pictures were reported before the crash
+         current_pos = av_rescale_q(cp.keyframe_pts, fmt_ctx->streams[video_stream_index]->time_base,
+               AV_TIME_BASE_Q);
+         frame_number = cp.frame_number;
+         resumed_frames = cp.frame_number;
+         run_stats.frames = cp.frame_number;
+         run_stats.corrupt_frames = cp.corrupt_frames;
+         run_stats.visual_corruption = cp.visual_corruption;
+         run_stats.missing_pts = cp.missing_pts;
+         run_stats.read_errors = cp.read_errors;
+         run_stats.temporal_freezes = cp.temporal_freezes;
+         run_stats.temporal_flashes = cp.temporal_flashes;
+         run_stats.temporal_tears = cp.temporal_tears;
+      }
+
+      void fillCheckpoint(int64_t keyframe_pts, int64_t keyframe_pos) {
+         checkpoint.keyframe_pts = keyframe_pts;
+         checkpoint.keyframe_pos = keyframe_pos;
+         checkpoint.frame_number = frame_number;
+         checkpoint.corrupt_frames = run_stats.corrupt_frames;
+         checkpoint.visual_corruption = run_stats.visual_corruption;
+         checkpoint.missing_pts = run_stats.missing_pts;
+         checkpoint.read_errors = run_stats.read_errors;
+         checkpoint.temporal_freezes = run_stats.temporal_freezes;
+         checkpoint.temporal_flashes = run_stats.temporal_flashes;
+         checkpoint.temporal_tears = run_stats.temporal_tears;
+      }
+
+      // Output thread. The hash database and the log file are synced first so
+      // the checkpoint never refers to records that are still in a buffer.
+      void saveCheckpoint(const FrameReport& report, uint64_t now) {
+         last_checkpoint_ns = now;
+         if (hash_db && !hash_db->sync())
+            return;
+         int64_t log_bytes = -1;
+         if (log_out && log_out != stdout && !event_log->sync(log_bytes))
+            return;
+         fillCheckpoint(report.pts, report.key_pos);
+         checkpoint.log_bytes = log_bytes;
+         if (!writeCheckpoint(checkpoint_path, checkpoint) && !checkpoint_failed) {
+            checkpoint_failed = true;
+            std::cerr << "[Checkpoint] Failed to write " << checkpoint_path << "\n";
+         }
+      }
+
+      LogRecord makeRecord(LogEventType type) const {
+         LogRecord record;
+         memset(&record, 0, sizeof(record));
+         record.type = type;
+         record.pts = AV_NOPTS_VALUE;
+         return record;
+      }
+
+      void logEvent(LogEventType type) {
+         pushRecord(makeRecord(type));
+      }
+
+      void pushRecord(const LogRecord& record) {
+         if (event_log)
+            event_log->push(record);
+      }
+      };
+
+FFSeeker::FFSeeker(const std::string& path, DecoderType decoder, const std::string& codec, bool enable_hash,
+      const SeekerOptions& options)
+: impl(new FFmpegDemuxSeeker(path, decoder, codec, enable_hash, options))
+{
+}
+
+FFSeeker::~FFSeeker() {
+}
+
+const SeekerStats& FFSeeker::run() {
+   impl->run();
+   return impl->stats();
+}
+
+void FFSeeker::seek(double seconds) {
+   impl->requestSeek(static_cast<int64_t>(seconds * AV_TIME_BASE));
+}
+
+void FFSeeker::seekTo(double seconds) {
+   impl->requestSeekTo(static_cast<int64_t>(seconds * AV_TIME_BASE));
+}
+
+void FFSeeker::setPaused(bool paused) {
+   impl->setPaused(paused);
+}
+
+void FFSeeker::step(int frames) {
+   impl->step(frames);
+}
+
+void FFSeeker::quit() {
+   impl->quit();
+}
+
+SeekerProgress FFSeeker::progress() const {
+   return impl->progress();
+}
+
+const SeekerStats& FFSeeker::stats() const {
+   return impl->stats();
+}
+
+size_t FFSeeker::seekStressFailures() const {
+   return impl->seekStressFailures();
+}
@@ -0,0 +1,186 @@
+#ifndef FFSEEKER_H
+#define FFSEEKER_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ffseeker_types.h"
+
+struct AVFrame; // libavutil/frame.h, for frame sinks
+
+/* libffseeker: the demux / decode / validate pipeline behind ffmpeg_seeker,
+ * usable from other programs. Open a source by constructing an FFSeeker with
+ * SeekerOptions, register sinks in the options, then run() it; seek, pause
+ * and quit from any other thread meanwhile. The library never reads the
+ * terminal; with `interactive` off it prints nothing either.
+ */
+
+enum DecoderType {
+   SOFTWARE,
+   HARDWARE
+};
+
+enum IndexMode {
+   INDEX_OFF,   // plain container seeks
+   INDEX_AUTO,  // use the sidecar if valid, else record it during a full linear pass
+   INDEX_BUILD  // run a packet-only indexing pass up front when there is no valid sidecar
+};
+
+enum SeekMode {
+   SEEK_KEY,  // start output at the keyframe before the target
+   SEEK_EXACT // decode from that keyframe but output from the target on
+};
+
+/* Receives every output frame of the primary stream on the decode thread,
+ * as a new reference (av_frame_ref: the decoder's buffers, no pixel copy).
+ * The sink owns it and releases it with av_frame_free, on any thread and at
+ * any time, also after the seeker is gone. Blocking here throttles decoding.
+ * Segmented (segments > 1) and sampled runs decode on worker ranges and do
+ * not output frames: the constructor rejects a frame sink with either.
+ */
+typedef std::function<void(AVFrame* frame)> FrameSink;
+
+/* Receives every event log record (frames with digests and corruption
+ * flags, seeks, errors) in order, on the log writer thread.
+ */
+typedef std::function<void(const LogRecord& record)> EventSink;
+
+// Tunables that are not part of the basic decoder selection.
+struct SeekerOptions {
+   PaceMode pace_mode = PACE_REALTIME;
+   double pace_fps = 0; // PACE_FPS only
+   HashAlgo hash_algo = HASH_MD5;
+   int hash_threads = 0; // 0: half the cores
+   int detect_stride = 8;  // CorruptionDetector row sampling
+   std::string detect_kernel = "auto";
+   bool temporal = false;  // TemporalDetector: frozen frames, flashes, tears (not with segments)
+   int freeze_frames = 5;  // identical frames after steady motion that count as a freeze
+   LogFormat log_format = LOG_TEXT;
+   std::string log_file; // empty: stdout
+   IndexMode index_mode = INDEX_AUTO;
+   SeekMode seek_mode = SEEK_KEY;
+   int gop_cache_mb = -1; // -1: 256 with SEEK_EXACT (at most half of mem_budget), off with SEEK_KEY
+   uint64_t mem_budget = 0; // bytes of queued packets and frames waiting for hashing, 0: unlimited
+   int decoder_threads = 0; // codec thread_count, 0: libavcodec default
+   int thread_type = 0;     // FF_THREAD_FRAME / FF_THREAD_SLICE, 0: libavcodec default
+   TuneGoal autotune = TUNE_OFF; // probe thread configurations before opening the decoder
+   int autotune_packets = 200;
+   bool interactive = true; // stream info banner and summaries on stdout; embedders turn it off
+   std::string log_level;   // interactive: libav log level, trace / debug / info (default)
+   bool log_events = true;  // false: per-frame records are only counted
+   int segments = 1;        // >1: parallel decode of keyframe-aligned ranges, headless
+   bool frame_pool = true;  // pooled get_buffer2 for SW decoders
+   double stats_interval = 0;   // seconds between [Stats] lines, 0: off
+   std::string prometheus_file; // Prometheus text file, refreshed every interval (5 s if 0)
+   IoMode io_mode = IO_DEFAULT; // demuxer I/O layer
+   int io_buffer_mb = 32;       // IO_READAHEAD window
+   SeekPlan seek_plan;          // seek stress run instead of keyboard control
+   StreamSelection streams;     // --streams: extra video/audio streams decoded alongside
+   std::string hash_db;         // per-frame digests written here (needs hashing)
+   std::string compare_db;      // golden database every digest is checked against
+   bool stop_on_mismatch = false;
+   ScanLevel scan = SCAN_FULL;  // --scan: full decode, keyframes only, or packets only
+   SamplePlan sample;           // --sample: decode only some GOPs, headless
+   std::string checkpoint;      // resume state, rewritten at a clean keyframe every checkpoint_interval
+   double checkpoint_interval = 30; // seconds
+   bool resume = false;         // continue from `checkpoint`: its keyframe, frame number and totals
+   FrameSink frame_sink;        // every output frame of the primary stream, see FrameSink (not with segments / sample)
+   EventSink event_sink;        // every event log record, even with log_events off
+};
+
+// Per-run totals, readable once run() has returned.
+struct SeekerStats {
+   uint64_t frames = 0;
+   uint64_t corrupt_frames = 0;    // decoder or packet flagged corruption
+   uint64_t visual_corruption = 0; // CorruptionDetector hits
+   uint64_t temporal_freezes = 0;  // TemporalDetector hits (--temporal)
+   uint64_t temporal_flashes = 0;
+   uint64_t temporal_tears = 0;
+   uint64_t missing_pts = 0;
+   uint64_t read_errors = 0;
+   bool reached_eof = false;
+   // allocations once WARMUP_FRAMES frames were out, for a steady-state check
+   uint64_t warm_frames = 0;
+   uint64_t warm_heap_allocs = 0;   // C++ operator new calls, if heap_counted
+   uint64_t warm_buffer_allocs = 0; // FrameBufferPool misses
+   uint64_t warm_packet_allocs = 0; // AVPacket shells not recycled
+   bool heap_counted = false;       // the executable links the counting operator new (alloc_stats.h)
+   std::vector<StreamStats> streams; // secondary streams (--streams), in file order
+   uint64_t hash_matches = 0;    // --compare
+   uint64_t hash_mismatches = 0;
+   uint64_t hash_unknown = 0;    // PTS not in the golden database
+   std::vector<PacketScanStats> packet_scan; // --scan packets, primary stream first
+   uint64_t peak_queued[BUDGET_STAGE_COUNT] = {}; // bytes, by BudgetStage
+   uint64_t budget_waits = 0;    // times a stage blocked on mem_budget
+   uint64_t peak_rss = 0;        // process high-water mark at the end of the run
+   uint64_t total_gops = 0;      // --sample: keyframes in the file
+   uint64_t sampled_gops = 0;    // GOPs decoded
+   uint64_t damaged_gops = 0;    // of those, with a flagged frame, a read error or no frames
+
+   bool damaged() const {
+      if (corrupt_frames || visual_corruption || read_errors ||
+            temporal_freezes || temporal_flashes || temporal_tears)
+         return true;
+      for (size_t i = 0; i < streams.size(); i++) {
+         if (streams[i].damaged())
+            return true;
+      }
+      for (size_t i = 0; i < packet_scan.size(); i++) {
+         if (packet_scan[i].anomalies())
+            return true;
+      }
+      return false;
+   }
+};
+
+// Live counters for a controller; any thread, while run() is going.
+struct SeekerProgress {
+   double position = 0; // seconds, last frame out
+   uint64_t frames = 0;
+   uint64_t packets = 0;
+   uint64_t corrupt_frames = 0;
+   uint64_t visual_corruption = 0;
+   uint64_t seeks = 0;
+   bool paused = false;
+};
+
+class FFmpegDemuxSeeker;
+
+/* One source. The constructor opens it and the decoder (throws
+ * std::runtime_error), run() blocks until the end of input or quit(); with
+ * a seek plan in the options it runs the seek stress instead. A sample plan
+ * on a file without keyframe index makes run() throw std::runtime_error.
+ * Segmented and sampled runs are headless: seek, pause and step have no
+ * effect there, only quit(). The destructor prints the run summaries when
+ * `interactive` is set.
+ */
+class FFSeeker {
+   public:
+      FFSeeker(const std::string& path, DecoderType decoder = SOFTWARE, const std::string& codec = "auto",
+            bool enable_hash = false, const SeekerOptions& options = SeekerOptions());
+      ~FFSeeker();
+
+      FFSeeker(const FFSeeker&) = delete;
+      FFSeeker& operator=(const FFSeeker&) = delete;
+
+      const SeekerStats& run();
+
+      // Controls, any thread.
+      void seek(double seconds);   // relative to the current position
+      void seekTo(double seconds); // absolute
+      void setPaused(bool paused);
+      void step(int frames = 1);   // pauses, then lets `frames` frames out
+      void quit();
+      SeekerProgress progress() const;
+
+      const SeekerStats& stats() const;
+      size_t seekStressFailures() const; // failed, timed out or wrong-PTS seeks of a stress run
+
+   private:
+      std::unique_ptr<FFmpegDemuxSeeker> impl;
+};
+
+#endif // FFSEEKER_H
@@ -0,0 +1,193 @@
+#ifndef FFSEEKER_TYPES_H
+#define FFSEEKER_TYPES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* The plain option and result types of the libffseeker API (ffseeker.h).
+ * Standard library only: the pipeline headers that implement these
+ * include this file, embedders never need them.
+ */
+
+enum PaceMode {
+   PACE_NONE,     // as fast as the decoder goes
+   PACE_REALTIME, // follow frame PTS against a monotonic clock
+   PACE_FPS       // fixed output rate
+};
+
+enum HashAlgo {
+   HASH_MD5,
+   HASH_CRC32,
+   HASH_XXH64 // fast non-cryptographic 64-bit hash
+};
+
+enum TuneGoal {
+   TUNE_OFF,
+   TUNE_FPS,     // highest decode throughput (batch scans)
+   TUNE_LATENCY  // earliest first frame (interactive seeking)
+};
+
+enum IoMode {
+   IO_DEFAULT,   // libavformat's own file protocol
+   IO_MMAP,      // read straight from a mapping of the whole file
+   IO_READAHEAD, // large window of chunks filled by a prefetch thread
+   IO_STREAM     // big sequential reads, pages behind the reader are dropped
+};
+
+/* --scan: how much of the file is decoded.
+ *   full       every frame (default)
+ *   keyframes  the decoder skips everything but keyframes (AVDISCARD_NONKEY)
+ *   packets    no decoder at all: container-level integrity checks only
+ */
+enum ScanLevel {
+   SCAN_FULL,
+   SCAN_KEYFRAMES,
+   SCAN_PACKETS
+};
+
+// Where budgeted bytes are held between two pipeline stages.
+enum BudgetStage {
+   BUDGET_PACKETS, // demux -> video decoder queue
+   BUDGET_FRAMES,  // decoded frames waiting for a hash worker
+   BUDGET_STREAMS, // demux -> secondary stream decoder queues (--streams)
+   BUDGET_STAGE_COUNT
+};
+
+// Seek stress run instead of keyboard control (seek_stress.h).
+enum SeekPlanKind {
+   PLAN_NONE,
+   PLAN_SCRIPT,     // --seek-script FILE
+   PLAN_RANDOM,     // --seek-random N
+   PLAN_SEQUENTIAL  // --seek-seq N
+};
+
+// One seek: seconds from the stream start, or an offset from the current position.
+struct SeekStep {
+   double seconds;
+   bool relative;
+};
+
+struct SeekPlan {
+   SeekPlanKind kind = PLAN_NONE;
+   int count = 0;      // PLAN_RANDOM / PLAN_SEQUENTIAL
+   uint64_t seed = 1;  // PLAN_RANDOM
+   std::vector<SeekStep> script;
+};
+
+// --streams selection, see parseStreamSelection (stream_decoder.h).
+struct StreamSpec {
+   char type; // 'v' or 'a'
+   int index;
+};
+
+struct StreamSelection {
+   bool all = false;
+   std::vector<StreamSpec> specs; // empty and !all: the first video stream only
+};
+
+// --sample: every Nth GOP or K GOPs spread over the duration (gop_sample.h).
+enum SampleKind {
+   SAMPLE_OFF,
+   SAMPLE_EVERY,
+   SAMPLE_SPREAD
+};
+
+struct SamplePlan {
+   SampleKind kind = SAMPLE_OFF;
+   int count = 0; // N for SAMPLE_EVERY, K for SAMPLE_SPREAD
+};
+
+// Validation totals of one secondary stream.
+struct StreamStats {
+   int index = -1;        // in the container
+   char type = '?';       // 'v' / 'a'
+   std::string codec;
+   uint64_t packets = 0;
+   uint64_t frames = 0;
+   uint64_t samples = 0;           // audio
+   uint64_t corrupt_frames = 0;    // decoder or packet flagged corruption
+   uint64_t decode_errors = 0;     // packets the decoder rejected
+   uint64_t visual_corruption = 0; // video: CorruptionDetector hits
+
+   bool damaged() const { return corrupt_frames || decode_errors || visual_corruption; }
+};
+
+struct PacketScanStats {
+   int index = -1; // in the container
+   char type = '?';
+   uint64_t packets = 0;
+   uint64_t bytes = 0;
+   uint64_t keyframes = 0;
+   uint64_t missing_ts = 0; // neither PTS nor DTS; common in raw streams, not an anomaly
+   uint64_t corrupt = 0;
+   uint64_t empty = 0;
+   uint64_t non_monotonic = 0;
+   uint64_t pts_before_dts = 0;
+   uint64_t gaps = 0;
+   uint64_t oversized = 0;
+
+   uint64_t anomalies() const {
+      return corrupt + empty + non_monotonic + pts_before_dts + gaps + oversized;
+   }
+};
+
+enum LogFormat {
+   LOG_TEXT,   // the classic console lines
+   LOG_JSON,   // one JSON object per line
+   LOG_BINARY  // LogRecord structs behind a small header
+};
+
+enum LogEventType : uint8_t {
+   EV_FRAME,
+   EV_VISUAL_CORRUPTION, // corruption detector verdict for the previous frame
+   EV_SEEK,
+   EV_SEEK_FAILED,
+   EV_EOF,
+   EV_READ_ERROR,
+   EV_QUIT,
+   EV_STREAM_ERROR,      // secondary stream (--streams): decode error or corruption
+   EV_HASH_MISMATCH,     // --compare: digest differs from the golden run (text: expected digest)
+   EV_PACKET_ANOMALY,    // --scan packets: flags are PKT_* bits, text names them
+   EV_TEMPORAL           // --temporal: freeze / flash / tear, flags are LOGF_TEMPORAL_* bits
+};
+
+// EV_FRAME / EV_VISUAL_CORRUPTION / EV_SEEK flags
+enum {
+   LOGF_CORRUPT          = 1 << 0, // decoder or packet flagged corruption
+   LOGF_MISSING_PTS      = 1 << 1,
+   LOGF_HW_DECODER       = 1 << 2,
+   LOGF_DETECT_SOLID     = 1 << 3,
+   LOGF_DETECT_FLAT_UV   = 1 << 4,
+   LOGF_DETECT_PARTIAL   = 1 << 5,
+   LOGF_SEEK_CACHED      = 1 << 6, // EV_SEEK served from the GOP cache
+   LOGF_SEEK_EXACT       = 1 << 7, // EV_SEEK discards frames before the target
+   LOGF_TEMPORAL_FREEZE  = 1 << 8,
+   LOGF_TEMPORAL_FLASH   = 1 << 9,
+   LOGF_TEMPORAL_TEAR    = 1 << 10
+};
+
+/* One fixed-size, trivially copyable log entry (128 bytes). Producers fill
+ * it on the hot path; all string formatting happens on the writer thread.
+ */
+struct LogRecord {
+   uint8_t type;
+   char pict_type;
+   uint8_t digest_len;
+   uint8_t stream;     // EV_STREAM_ERROR: container stream index
+   uint32_t flags;
+   int32_t decode_error_flags;
+   int32_t format;     // AVPixelFormat
+   int64_t frame_number;
+   int64_t pts;
+   int64_t dts;
+   int64_t pkt_pts;
+   double timestamp;   // seconds; seek target for EV_SEEK
+   int32_t width;
+   int32_t height;
+   uint8_t digest[16];
+   char text[48];      // short message: digest label, error string, flat regions
+};
+static_assert(sizeof(LogRecord) == 128, "LogRecord layout is part of the binary log format");
+
+#endif // FFSEEKER_TYPES_H
@@ -0,0 +1,81 @@
+#ifndef FRAME_COMPARE_H
+#define FRAME_COMPARE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "frame_hasher.h"
+
+inline bool sameDigest(const FrameDigest& a, const FrameDigest& b) {
+   return a.len == b.len && memcmp(a.bytes, b.bytes, a.len) == 0;
+}
+
+// Per-component PSNR of two decoded pictures of the same size.
+struct FramePsnr {
+   bool comparable = false; // same size, both readable software formats
+   int components = 0;      // Y, U, V (and alpha when both have it)
+   double db[4] = {0, 0, 0, 0}; // +inf when identical
+
+   double min() const {
+      double lowest = std::numeric_limits<double>::infinity();
+      for (int c = 0; c < components; c++)
+         lowest = std::min(lowest, db[c]);
+      return lowest;
+   }
+};
+
+/* Compares two frames component by component. The pixel formats may differ
+ * (yuv420p against nv12, 8 against 10 bit): samples are read through the
+ * pixel format descriptors and scaled to 16 bits before the squared error is
+ * taken, so the result is independent of the memory layout. Chroma
+ * subsampling has to match; anything else is not comparable.
+ */
+inline FramePsnr framePsnr(const AVFrame* a, const AVFrame* b) {
+   FramePsnr result;
+   const AVPixFmtDescriptor* da = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(a->format));
+   const AVPixFmtDescriptor* db = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(b->format));
+   const uint64_t unsupported = AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM;
+   if (!da || !db || (da->flags & unsupported) || (db->flags & unsupported) ||
+         a->width != b->width || a->height != b->height ||
+         da->log2_chroma_w != db->log2_chroma_w || da->log2_chroma_h != db->log2_chroma_h ||
+         (da->flags & AV_PIX_FMT_FLAG_RGB) != (db->flags & AV_PIX_FMT_FLAG_RGB))
+      return result;
+
+   const uint8_t** data_a = const_cast<const uint8_t**>(a->data);
+   const uint8_t** data_b = const_cast<const uint8_t**>(b->data);
+   result.components = std::min(da->nb_components, db->nb_components);
+   std::vector<uint16_t> row_a(a->width), row_b(a->width);
+   for (int c = 0; c < result.components; c++) {
+      const bool chroma = (c == 1 || c == 2) && !(da->flags & AV_PIX_FMT_FLAG_RGB);
+      const int w = chroma ? AV_CEIL_RSHIFT(a->width, da->log2_chroma_w) : a->width;
+      const int h = chroma ? AV_CEIL_RSHIFT(a->height, da->log2_chroma_h) : a->height;
+      const int shift_a = 16 - da->comp[c].depth;
+      const int shift_b = 16 - db->comp[c].depth;
+      double sse = 0;
+      for (int y = 0; y < h; y++) {
+         av_read_image_line(row_a.data(), data_a, a->linesize, da, 0, y, c, w, 0);
+         av_read_image_line(row_b.data(), data_b, b->linesize, db, 0, y, c, w, 0);
+         int64_t row_sse = 0;
+         for (int x = 0; x < w; x++) {
+            const int64_t d = static_cast<int64_t>(row_a[x] << shift_a) - (row_b[x] << shift_b);
+            row_sse += d * d;
+         }
+         sse += row_sse;
+      }
+      const double mse = sse / (static_cast<double>(w) * h);
+      result.db[c] = mse > 0 ? 10.0 * log10(65535.0 * 65535.0 / mse) : std::numeric_limits<double>::infinity();
+   }
+   result.comparable = result.components > 0;
+   return result;
+}
+
+#endif // FRAME_COMPARE_H
@@ -0,0 +1,256 @@
+#ifndef FRAME_HASHER_H
+#define FRAME_HASHER_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+extern "C" {
+#include <libavutil/crc.h>
+#include <libavutil/md5.h>
+#include <libavutil/mem.h>
+}
+
+#include "frame_planes.h"
+#include "ffseeker_types.h"
+
+inline const char* hashAlgoName(HashAlgo algo) {
+   switch (algo) {
+      case HASH_CRC32: return "CRC32";
+      case HASH_XXH64: return "XXH64";
+      default:         return "MD5";
+   }
+}
+
+inline bool parseHashAlgo(const std::string& name, HashAlgo& algo) {
+   if (name == "md5" || name == "true") {
+      algo = HASH_MD5;
+   } else if (name == "crc32") {
+      algo = HASH_CRC32;
+   } else if (name == "xxh64") {
+      algo = HASH_XXH64;
+   } else {
+      return false;
+   }
+   return true;
+}
+
+struct FrameDigest {
+   uint8_t bytes[16];
+   int len = 0; // 0: nothing hashed (hwaccel surface)
+
+   std::string hex() const {
+      if (!len)
+         return "n/a";
+      static const char digits[] = "0123456789abcdef";
+      std::string out(len * 2, '0');
+      for (int i = 0; i < len; i++) {
+         out[i * 2] = digits[bytes[i] >> 4];
+         out[i * 2 + 1] = digits[bytes[i] & 0xf];
+      }
+      return out;
+   }
+};
+
+/* Streaming XXH64 (seed 0). Reads are little-endian; all supported targets
+ * (x86, aarch64) are little-endian hosts.
+ */
+class Xxh64 {
+   public:
+      Xxh64() { reset(); }
+
+      void reset() {
+         v[0] = P1 + P2;
+         v[1] = P2;
+         v[2] = 0;
+         v[3] = 0 - P1;
+         total = 0;
+         buffered = 0;
+      }
+
+      void update(const uint8_t* p, size_t len) {
+         total += len;
+         if (buffered) {
+            size_t take = 32 - buffered;
+            if (take > len)
+               take = len;
+            memcpy(buf + buffered, p, take);
+            buffered += take;
+            p += take;
+            len -= take;
+            if (buffered < 32)
+               return;
+            consume(buf);
+            buffered = 0;
+         }
+         for (; len >= 32; p += 32, len -= 32)
+            consume(p);
+         if (len) {
+            memcpy(buf, p, len);
+            buffered = len;
+         }
+      }
+
+      uint64_t digest() const {
+         uint64_t h;
+         if (total >= 32) {
+            h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+            for (int i = 0; i < 4; i++) {
+               h ^= round(0, v[i]);
+               h = h * P1 + P4;
+            }
+         } else {
+            h = P5;
+         }
+         h += total;
+
+         const uint8_t* p = buf;
+         size_t len = buffered;
+         for (; len >= 8; p += 8, len -= 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * P1 + P4;
+         }
+         if (len >= 4) {
+            h ^= static_cast<uint64_t>(read32(p)) * P1;
+            h = rotl(h, 23) * P2 + P3;
+            p += 4;
+            len -= 4;
+         }
+         for (; len; p++, len--) {
+            h ^= (*p) * P5;
+            h = rotl(h, 11) * P1;
+         }
+
+         h ^= h >> 33;
+         h *= P2;
+         h ^= h >> 29;
+         h *= P3;
+         h ^= h >> 32;
+         return h;
+      }
+
+   private:
+      static const uint64_t P1 = 11400714785074694791ULL;
+      static const uint64_t P2 = 14029467366897019727ULL;
+      static const uint64_t P3 = 1609587929392839161ULL;
+      static const uint64_t P4 = 9650029242287828579ULL;
+      static const uint64_t P5 = 2870177450012600261ULL;
+
+      uint64_t v[4];
+      uint64_t total;
+      uint8_t buf[32];
+      size_t buffered;
+
+      static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+      static uint64_t read64(const uint8_t* p) { uint64_t x; memcpy(&x, p, 8); return x; }
+      static uint32_t read32(const uint8_t* p) { uint32_t x; memcpy(&x, p, 4); return x; }
+
+      static uint64_t round(uint64_t acc, uint64_t input) {
+         acc += input * P2;
+         acc = rotl(acc, 31);
+         return acc * P1;
+      }
+
+      void consume(const uint8_t* p) {
+         for (int i = 0; i < 4; i++)
+            v[i] = round(v[i], read64(p + i * 8));
+      }
+};
+
+/* Hashes the visible pixels of a frame. One instance per thread; the MD5
+ * context and CRC table are set up once and reused for every frame.
+ */
+class FrameHasher {
+   public:
+      explicit FrameHasher(HashAlgo algo)
+      : algo(algo),
+        md5(algo == HASH_MD5 ? av_md5_alloc() : nullptr),
+        crc_table(av_crc_get_table(AV_CRC_32_IEEE_LE))
+      {
+      }
+
+      ~FrameHasher() { av_free(md5); }
+
+      FrameHasher(const FrameHasher&) = delete;
+      FrameHasher& operator=(const FrameHasher&) = delete;
+
+      FrameDigest hash(const AVFrame* frame) {
+         FrameDigest digest;
+         PlaneSpan planes[4];
+         int nb_planes = framePlanes(frame, planes);
+         if (!nb_planes)
+            return digest;
+
+         begin();
+         for (int p = 0; p < nb_planes; p++) {
+            const PlaneSpan& span = planes[p];
+            // contiguous planes (no padding) hash in one call
+            if (span.linesize == span.row_bytes) {
+               update(span.data, static_cast<size_t>(span.row_bytes) * span.rows);
+               continue;
+            }
+            for (int y = 0; y < span.rows; y++)
+               update(span.data + static_cast<ptrdiff_t>(y) * span.linesize, span.row_bytes);
+         }
+         finish(digest);
+         return digest;
+      }
+
+      // One digest per plane, for telling which plane two frames differ in.
+      int hashPlanes(const AVFrame* frame, FrameDigest digests[4]) {
+         PlaneSpan planes[4];
+         int nb_planes = framePlanes(frame, planes);
+         for (int p = 0; p < nb_planes; p++) {
+            const PlaneSpan& span = planes[p];
+            begin();
+            for (int y = 0; y < span.rows; y++)
+               update(span.data + static_cast<ptrdiff_t>(y) * span.linesize, span.row_bytes);
+            finish(digests[p]);
+         }
+         return nb_planes;
+      }
+
+   private:
+      HashAlgo algo;
+      struct AVMD5* md5;
+      const AVCRC* crc_table;
+      uint32_t crc;
+      Xxh64 xxh;
+
+      void begin() {
+         if (algo == HASH_MD5)
+            av_md5_init(md5);
+         else if (algo == HASH_CRC32)
+            crc = UINT32_MAX;
+         else
+            xxh.reset();
+      }
+
+      void update(const uint8_t* data, size_t len) {
+         if (algo == HASH_MD5)
+            av_md5_update(md5, data, len);
+         else if (algo == HASH_CRC32)
+            crc = av_crc(crc_table, crc, data, len);
+         else
+            xxh.update(data, len);
+      }
+
+      void finish(FrameDigest& digest) {
+         if (algo == HASH_MD5) {
+            av_md5_final(md5, digest.bytes);
+            digest.len = 16;
+         } else if (algo == HASH_CRC32) {
+            uint32_t value = crc ^ UINT32_MAX;
+            for (int i = 0; i < 4; i++)
+               digest.bytes[i] = value >> (24 - 8 * i);
+            digest.len = 4;
+         } else {
+            uint64_t value = xxh.digest();
+            for (int i = 0; i < 8; i++)
+               digest.bytes[i] = value >> (56 - 8 * i);
+            digest.len = 8;
+         }
+      }
+};
+
+#endif // FRAME_HASHER_H
@@ -0,0 +1,58 @@
+#ifndef FRAME_PLANES_H
+#define FRAME_PLANES_H
+
+#include <cstdint>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+// Visible part of one image plane: `rows` rows of `row_bytes` bytes, `linesize` apart.
+struct PlaneSpan {
+   const uint8_t* data;
+   int linesize;
+   int row_bytes;
+   int rows;
+};
+
+/* Fills `planes` with the visible geometry of every plane of a video frame and
+ * returns the plane count (0 for hwaccel surfaces or unknown formats).
+ * Width in bytes comes from av_image_fill_linesizes() and chroma height from
+ * the pixel-format descriptor, so 4:2:2, 4:4:4, semi-planar and >8-bit
+ * formats are covered and linesize padding is excluded.
+ */
+inline int framePlanes(const AVFrame* frame, PlaneSpan planes[4]) {
+   const AVPixelFormat fmt = static_cast<AVPixelFormat>(frame->format);
+   const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(fmt);
+   if (!desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+      return 0;
+
+   int row_bytes[4] = {0, 0, 0, 0};
+   if (av_image_fill_linesizes(row_bytes, fmt, frame->width) < 0)
+      return 0;
+
+   int count = 0;
+   for (int p = 0; p < 4 && frame->data[p]; p++) {
+      PlaneSpan& span = planes[count];
+      span.data = frame->data[p];
+      span.linesize = frame->linesize[p];
+      span.row_bytes = row_bytes[p];
+      span.rows = frame->height;
+      if (desc->flags & AV_PIX_FMT_FLAG_PAL) {
+         if (p == 1) { // palette
+            span.row_bytes = 256 * 4;
+            span.rows = 1;
+         }
+      } else if ((p == 1 || p == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB)) {
+         span.rows = AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h);
+      }
+      if (span.row_bytes <= 0 || span.rows <= 0)
+         break;
+      count++;
+   }
+   return count;
+}
+
+#endif // FRAME_PLANES_H
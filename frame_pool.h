@@ -0,0 +1,144 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/version.h>
+}
+
+/* get_buffer2 replacement for software decoders (AV_CODEC_CAP_DR1).
+ *
+ * Each frame is a single buffer holding all planes, taken from an
+ * AVBufferPool bucket keyed by the frame's byte size, so after the first
+ * few frames every picture is served from memory the decoder already used
+ * and nothing hits the allocator (or faults in fresh pages) per frame.
+ * Buckets live as long as the decoder: frame threads may still be pulling
+ * from an old size while a new one appears, and resolution changes are rare.
+ */
+class FrameBufferPool {
+   public:
+      FrameBufferPool()
+      : buffers_allocated(0),
+        bytes_allocated(0),
+        buffers_served(0)
+      {
+      }
+
+      ~FrameBufferPool() {
+         for (auto it = buckets.begin(); it != buckets.end(); ++it)
+            av_buffer_pool_uninit(&it->second);
+      }
+
+      FrameBufferPool(const FrameBufferPool&) = delete;
+      FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+      // Call before avcodec_open2. Returns false (and changes nothing) for
+      // decoders that cannot take caller-provided buffers.
+      bool install(AVCodecContext* ctx) {
+         if (!ctx->codec || !(ctx->codec->capabilities & AV_CODEC_CAP_DR1))
+            return false;
+         ctx->opaque = this;
+         ctx->get_buffer2 = &FrameBufferPool::getBuffer2;
+         return true;
+      }
+
+      uint64_t allocated() const { return buffers_allocated.load(std::memory_order_relaxed); }
+      uint64_t allocatedBytes() const { return bytes_allocated.load(std::memory_order_relaxed); }
+      uint64_t served() const { return buffers_served.load(std::memory_order_relaxed); }
+
+   private:
+      static const int PADDING = 16 + 64; // AV_INPUT_BUFFER_PADDING-style tail plus base alignment
+
+      std::mutex mutex; // buckets; called from frame-threading workers
+      std::map<size_t, AVBufferPool*> buckets;
+      std::atomic<uint64_t> buffers_allocated;
+      std::atomic<uint64_t> bytes_allocated;
+      std::atomic<uint64_t> buffers_served;
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+      typedef size_t PoolSize;
+#else
+      typedef int PoolSize;
+#endif
+
+      static AVBufferRef* allocBuffer(void* opaque, PoolSize size) {
+         FrameBufferPool* self = static_cast<FrameBufferPool*>(opaque);
+         self->buffers_allocated.fetch_add(1, std::memory_order_relaxed);
+         self->bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+         return av_buffer_alloc(size);
+      }
+
+      AVBufferPool* bucket(size_t size) {
+         std::lock_guard<std::mutex> lock(mutex);
+         auto it = buckets.find(size);
+         if (it != buckets.end())
+            return it->second;
+         AVBufferPool* pool = av_buffer_pool_init2(size, this, &FrameBufferPool::allocBuffer, nullptr);
+         if (pool)
+            buckets[size] = pool;
+         return pool;
+      }
+
+      static int getBuffer2(AVCodecContext* s, AVFrame* frame, int flags) {
+         FrameBufferPool* self = static_cast<FrameBufferPool*>(s->opaque);
+         const AVPixelFormat fmt = static_cast<AVPixelFormat>(frame->format);
+         const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(fmt);
+         if (!self || !desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) || s->codec_type != AVMEDIA_TYPE_VIDEO)
+            return avcodec_default_get_buffer2(s, frame, flags);
+
+         // same geometry rules as libavcodec's own pool
+         int w = frame->width, h = frame->height;
+         int stride_align[AV_NUM_DATA_POINTERS];
+         avcodec_align_dimensions2(s, &w, &h, stride_align);
+         int linesizes[4];
+         int unaligned;
+         do {
+            if (av_image_fill_linesizes(linesizes, fmt, w) < 0)
+               return avcodec_default_get_buffer2(s, frame, flags);
+            w += w & ~(w - 1);
+            unaligned = 0;
+            for (int i = 0; i < 4; i++)
+               unaligned |= linesizes[i] % stride_align[i];
+         } while (unaligned);
+
+         size_t plane_sizes[4];
+         ptrdiff_t plane_linesizes[4];
+         for (int i = 0; i < 4; i++)
+            plane_linesizes[i] = linesizes[i];
+         if (av_image_fill_plane_sizes(plane_sizes, fmt, h, plane_linesizes) < 0)
+            return avcodec_default_get_buffer2(s, frame, flags);
+         size_t total = 0;
+         for (int i = 0; i < 4; i++)
+            total += plane_sizes[i];
+
+         AVBufferPool* pool = self->bucket(total + PADDING);
+         AVBufferRef* buf = pool ? av_buffer_pool_get(pool) : nullptr;
+         if (!buf)
+            return AVERROR(ENOMEM);
+         self->buffers_served.fetch_add(1, std::memory_order_relaxed);
+
+         uint8_t* base = buf->data + ((64 - (reinterpret_cast<uintptr_t>(buf->data) & 63)) & 63);
+         frame->buf[0] = buf;
+         for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+            frame->data[i] = nullptr;
+            frame->linesize[i] = 0;
+         }
+         for (int i = 0; i < 4 && plane_sizes[i]; i++) {
+            frame->data[i] = base;
+            frame->linesize[i] = linesizes[i];
+            base += plane_sizes[i];
+         }
+         frame->extended_data = frame->data;
+         return 0;
+      }
+};
+
+#endif // FRAME_POOL_H
@@ -0,0 +1,181 @@
+#ifndef GOP_CACHE_H
+#define GOP_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+}
+
+/* Decoded frames of one GOP in output order, from the keyframe at `start`
+ * up to (not including) the next keyframe at `end` (stream time base).
+ * Frames are owned references; the GOP is immutable once in the cache.
+ */
+struct CachedGop {
+   int64_t start;
+   int64_t end;
+   size_t bytes;
+   std::vector<AVFrame*> frames;
+
+   CachedGop(int64_t start) : start(start), end(AV_NOPTS_VALUE), bytes(0) {}
+
+   ~CachedGop() {
+      for (size_t i = 0; i < frames.size(); i++)
+         av_frame_free(&frames[i]);
+   }
+
+   CachedGop(const CachedGop&) = delete;
+   CachedGop& operator=(const CachedGop&) = delete;
+};
+
+typedef std::shared_ptr<const CachedGop> GopRef;
+
+inline bool isKeyFrame(const AVFrame* frame) {
+#ifdef AV_FRAME_FLAG_KEY
+   return frame->flags & AV_FRAME_FLAG_KEY;
+#else
+   return frame->key_frame;
+#endif
+}
+
+/* LRU cache of decoded GOPs with a byte budget.
+ *
+ * The decode thread records frames into a GOP while decoding linearly and
+ * inserts it once the next keyframe closes it; the demux thread looks up
+ * seek targets. Lookups hand out shared references, so an evicted GOP stays
+ * alive until the replay that is using it has finished.
+ */
+class GopCache {
+   public:
+      explicit GopCache(size_t budget_bytes)
+      : budget(budget_bytes),
+        used(0),
+        hit_count(0),
+        miss_count(0)
+      {
+      }
+
+      GopCache(const GopCache&) = delete;
+      GopCache& operator=(const GopCache&) = delete;
+
+      size_t budgetBytes() const { return budget; }
+
+      /* Adds one decoded frame to the GOP being recorded. Software frames are
+       * referenced; hwaccel surfaces are downloaded and frames of a hardware
+       * decoder (`deep_copy`) are copied, since holding on to those would
+       * starve the decoder's fixed buffer pool. Returns false when the frame
+       * could not be kept or the GOP outgrew the whole budget.
+       */
+      bool append(CachedGop& gop, const AVFrame* frame, bool deep_copy) const {
+         AVFrame* kept = av_frame_alloc();
+         if (!kept)
+            return false;
+         int ret;
+         const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+         if (desc && (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            ret = av_hwframe_transfer_data(kept, frame, 0);
+            if (ret >= 0)
+               ret = av_frame_copy_props(kept, frame);
+         } else if (deep_copy) {
+            kept->format = frame->format;
+            kept->width = frame->width;
+            kept->height = frame->height;
+            ret = av_frame_get_buffer(kept, 0);
+            if (ret >= 0)
+               ret = av_frame_copy(kept, frame);
+            if (ret >= 0)
+               ret = av_frame_copy_props(kept, frame);
+         } else {
+            ret = av_frame_ref(kept, frame);
+         }
+         if (ret < 0) {
+            av_frame_free(&kept);
+            return false;
+         }
+         gop.bytes += frameBytes(kept);
+         gop.frames.push_back(kept);
+         return gop.bytes <= budget;
+      }
+
+      // Takes a closed GOP (end set) and evicts least recently used ones to fit.
+      void insert(std::unique_ptr<CachedGop> gop) {
+         if (!gop || gop->end == AV_NOPTS_VALUE || gop->bytes > budget)
+            return;
+         std::lock_guard<std::mutex> lock(mutex);
+         auto found = gops.find(gop->start);
+         if (found != gops.end())
+            remove(found);
+         const int64_t start = gop->start;
+         lru.push_front(start);
+         Slot slot;
+         slot.gop = GopRef(gop.release());
+         slot.lru_pos = lru.begin();
+         used += slot.gop->bytes;
+         gops.insert(std::make_pair(start, slot));
+         while (used > budget && !lru.empty())
+            remove(gops.find(lru.back()));
+      }
+
+      // GOP whose [start, end) range covers `ts`, or null.
+      GopRef find(int64_t ts) {
+         std::lock_guard<std::mutex> lock(mutex);
+         auto it = gops.upper_bound(ts);
+         if (it == gops.begin()) {
+            miss_count++;
+            return GopRef();
+         }
+         --it;
+         if (ts >= it->second.gop->end) {
+            miss_count++;
+            return GopRef();
+         }
+         lru.splice(lru.begin(), lru, it->second.lru_pos);
+         hit_count++;
+         return it->second.gop;
+      }
+
+      uint64_t hits() const {
+         std::lock_guard<std::mutex> lock(mutex);
+         return hit_count;
+      }
+      uint64_t misses() const {
+         std::lock_guard<std::mutex> lock(mutex);
+         return miss_count;
+      }
+
+   private:
+      struct Slot {
+         GopRef gop;
+         std::list<int64_t>::iterator lru_pos;
+      };
+
+      const size_t budget;
+      mutable std::mutex mutex; // everything below
+      std::map<int64_t, Slot> gops; // by keyframe pts
+      std::list<int64_t> lru;       // most recently used first
+      size_t used;
+      uint64_t hit_count;
+      uint64_t miss_count;
+
+      void remove(std::map<int64_t, Slot>::iterator it) {
+         used -= it->second.gop->bytes;
+         lru.erase(it->second.lru_pos);
+         gops.erase(it);
+      }
+
+      static size_t frameBytes(const AVFrame* frame) {
+         size_t bytes = 0;
+         for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++)
+            bytes += frame->buf[i]->size;
+         return bytes;
+      }
+};
+
+#endif // GOP_CACHE_H
@@ -0,0 +1,109 @@
+#ifndef GOP_SAMPLE_H
+#define GOP_SAMPLE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "keyframe_index.h" // KeyframeEntry
+#include "ffseeker_types.h"
+
+/* --sample: decode a subset of the GOPs of a file and estimate how many of
+ * them are damaged, instead of decoding everything.
+ *   every=N  systematic: the first GOP and every Nth after it
+ *   gops=K   time-stratified: the duration cut into K equal slices, one GOP
+ *            from the middle of each
+ */
+
+// "every=N" or "gops=K", N and K positive
+inline bool parseSamplePlan(const std::string& arg, SamplePlan& plan) {
+   SampleKind kind;
+   size_t skip;
+   if (arg.compare(0, 6, "every=") == 0) {
+      kind = SAMPLE_EVERY;
+      skip = 6;
+   } else if (arg.compare(0, 5, "gops=") == 0) {
+      kind = SAMPLE_SPREAD;
+      skip = 5;
+   } else {
+      return false;
+   }
+   char* end = nullptr;
+   const long count = strtol(arg.c_str() + skip, &end, 10);
+   if (end == arg.c_str() + skip || *end != '\0' || count <= 0 || count > 1 << 30)
+      return false;
+   plan.kind = kind;
+   plan.count = static_cast<int>(count);
+   return true;
+}
+
+/* Indices into `keys` (sorted by PTS, one per GOP) of the GOPs to decode,
+ * in the order to visit them: by byte offset, so consecutive seeks move
+ * forward through the file and the reads stay sequential. PTS order is
+ * kept when some keyframe has no known offset.
+ */
+inline std::vector<size_t> sampleGops(const std::vector<KeyframeEntry>& keys, const SamplePlan& plan) {
+   std::vector<size_t> picked;
+   if (keys.empty() || plan.count <= 0)
+      return picked;
+   if (plan.kind == SAMPLE_EVERY) {
+      for (size_t i = 0; i < keys.size(); i += plan.count)
+         picked.push_back(i);
+   } else if (static_cast<size_t>(plan.count) >= keys.size()) {
+      for (size_t i = 0; i < keys.size(); i++)
+         picked.push_back(i);
+   } else {
+      // the GOP covering the middle of each slice; long GOPs may cover two
+      const double first = static_cast<double>(keys.front().pts);
+      const double span = static_cast<double>(keys.back().pts) - first;
+      for (int k = 0; k < plan.count; k++) {
+         const int64_t mid = static_cast<int64_t>(first + span * (2 * k + 1) / (2.0 * plan.count));
+         size_t i = std::upper_bound(keys.begin(), keys.end(), mid,
+               [](int64_t ts, const KeyframeEntry& e) { return ts < e.pts; }) - keys.begin();
+         i = i ? i - 1 : 0;
+         if (picked.empty() || picked.back() != i)
+            picked.push_back(i);
+      }
+   }
+
+   bool all_pos = true;
+   for (size_t k = 0; k < picked.size() && all_pos; k++)
+      all_pos = keys[picked[k]].pos >= 0;
+   if (all_pos)
+      std::stable_sort(picked.begin(), picked.end(),
+            [&keys](size_t a, size_t b) { return keys[a].pos < keys[b].pos; });
+   return picked;
+}
+
+// Observed rate with its Wilson score interval.
+struct RateEstimate {
+   double rate = 0;
+   double low = 0;
+   double high = 1;
+};
+
+/* Wilson score interval for `hits` out of `n` (z = 1.96: 95 %). Unlike the
+ * normal approximation it stays inside [0, 1] and gives a useful upper bound
+ * when nothing was found, which is the common case for a healthy archive.
+ * The sampled GOPs are treated as independent draws; with most of a file
+ * sampled the true interval is narrower than this.
+ */
+inline RateEstimate wilsonInterval(uint64_t hits, uint64_t n, double z = 1.96) {
+   RateEstimate est;
+   if (!n)
+      return est;
+   const double p = static_cast<double>(hits) / n;
+   const double z2 = z * z;
+   const double denom = 1 + z2 / n;
+   const double center = (p + z2 / (2.0 * n)) / denom;
+   const double half = z * std::sqrt(p * (1 - p) / n + z2 / (4.0 * n * n)) / denom;
+   est.rate = p;
+   est.low = std::max(0.0, center - half);
+   est.high = std::min(1.0, center + half);
+   return est;
+}
+
+#endif // GOP_SAMPLE_H
@@ -0,0 +1,243 @@
+#ifndef HASH_DB_H
+#define HASH_DB_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#include "frame_hasher.h"
+
+/* Per-frame hash database (--hash-db / --compare).
+ *
+ * A 32-byte header followed by one 32-byte HashRecord per output frame, in
+ * output order, host byte order like the binary event log. There is no
+ * record count: it follows from the file size, so a run that was killed
+ * still leaves a usable database.
+ */
+struct HashDbHeader {
+   char magic[8];          // "FFSKHDB1"
+   uint32_t version;       // 1
+   uint32_t record_size;   // sizeof(HashRecord)
+   uint8_t algo;           // HashAlgo of every digest
+   uint8_t reserved[3];
+   int32_t time_base_num;  // of the PTS values
+   int32_t time_base_den;
+   uint32_t reserved2;
+};
+static_assert(sizeof(HashDbHeader) == 32, "HashDbHeader layout is part of the file format");
+
+enum {
+   HASHF_CORRUPT = 1 << 0, // decoder or packet flagged corruption
+   HASHF_KEY     = 1 << 1,
+   HASHF_VISUAL  = 1 << 2  // CorruptionDetector hit
+};
+
+struct HashRecord {
+   int64_t pts;          // AV_NOPTS_VALUE when the frame had none
+   uint32_t flags;       // HASHF_*
+   char pict_type;
+   uint8_t digest_len;
+   uint16_t reserved;
+   uint8_t digest[16];
+};
+static_assert(sizeof(HashRecord) == 32, "HashRecord layout is part of the file format");
+
+/* Appends records through a large stdio buffer; one fwrite per frame.
+ * With `keep_records` >= 0 an existing database is continued instead: cut
+ * back to its first `keep_records` records (a resumed run reports the rest
+ * again) and appended to.
+ */
+class HashDbWriter {
+   public:
+      HashDbWriter(const std::string& path, HashAlgo algo, AVRational time_base, int64_t keep_records = -1)
+      : out(nullptr),
+        records(0)
+      {
+         if (keep_records >= 0) {
+            reopen(path, algo, keep_records);
+            return;
+         }
+         out = fopen(path.c_str(), "wb");
+         if (!out)
+            throw std::runtime_error("Failed to create hash database " + path);
+         setvbuf(out, nullptr, _IOFBF, 1 << 20);
+         HashDbHeader header;
+         memset(&header, 0, sizeof(header));
+         memcpy(header.magic, "FFSKHDB1", sizeof(header.magic));
+         header.version = 1;
+         header.record_size = sizeof(HashRecord);
+         header.algo = static_cast<uint8_t>(algo);
+         header.time_base_num = time_base.num;
+         header.time_base_den = time_base.den;
+         fwrite(&header, sizeof(header), 1, out);
+      }
+
+      ~HashDbWriter() { close(); }
+
+      HashDbWriter(const HashDbWriter&) = delete;
+      HashDbWriter& operator=(const HashDbWriter&) = delete;
+
+      void add(const HashRecord& record) {
+         if (out && fwrite(&record, sizeof(record), 1, out) == 1)
+            records++;
+      }
+
+      // False if anything failed to reach the file.
+      bool close() {
+         if (!out)
+            return true;
+         bool ok = !ferror(out);
+         ok = fclose(out) == 0 && ok;
+         out = nullptr;
+         return ok;
+      }
+
+      uint64_t count() const { return records; }
+
+      // Everything added so far on disk, e.g. before a checkpoint refers to it.
+      bool sync() {
+         return out && fflush(out) == 0 && fsync(fileno(out)) == 0;
+      }
+
+   private:
+      FILE* out;
+      uint64_t records;
+
+      void reopen(const std::string& path, HashAlgo algo, int64_t keep_records) {
+         out = fopen(path.c_str(), "r+b");
+         if (!out)
+            throw std::runtime_error("Cannot reopen hash database " + path);
+         HashDbHeader header;
+         struct stat st;
+         const off_t keep = sizeof(HashDbHeader) + keep_records * static_cast<off_t>(sizeof(HashRecord));
+         if (fread(&header, sizeof(header), 1, out) != 1 || memcmp(header.magic, "FFSKHDB1", sizeof(header.magic)) != 0 ||
+               header.record_size != sizeof(HashRecord) || header.algo != algo ||
+               fstat(fileno(out), &st) != 0 || st.st_size < keep) {
+            fclose(out);
+            out = nullptr;
+            throw std::runtime_error(path + " does not match the checkpoint (other algorithm or too few records)");
+         }
+         if (ftruncate(fileno(out), keep) != 0 || fseeko(out, keep, SEEK_SET) != 0) {
+            fclose(out);
+            out = nullptr;
+            throw std::runtime_error("Failed to truncate hash database " + path);
+         }
+         records = keep_records;
+      }
+};
+
+/* Read-only, memory-mapped golden database with O(1) lookup by PTS: an
+ * open-addressing table of record indexes, sized to twice the record count.
+ * With repeated PTS values (seeks during the golden run) the first record
+ * wins. Frames without a PTS are looked up by their output position.
+ */
+class GoldenHashDb {
+   public:
+      explicit GoldenHashDb(const std::string& path)
+      : map(nullptr),
+        map_size(0),
+        records(nullptr),
+        count(0)
+      {
+         int fd = open(path.c_str(), O_RDONLY);
+         if (fd < 0)
+            throw std::runtime_error("Cannot open hash database " + path);
+         struct stat st;
+         if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(HashDbHeader))) {
+            ::close(fd);
+            throw std::runtime_error(path + " is not a hash database");
+         }
+         map_size = st.st_size;
+         map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+         ::close(fd);
+         if (map == MAP_FAILED) {
+            map = nullptr;
+            throw std::runtime_error("Cannot map hash database " + path);
+         }
+         memcpy(&header, map, sizeof(header));
+         if (memcmp(header.magic, "FFSKHDB1", sizeof(header.magic)) != 0 || header.version != 1 ||
+               header.record_size != sizeof(HashRecord)) {
+            munmap(map, map_size);
+            throw std::runtime_error(path + " is not a version 1 hash database");
+         }
+         records = reinterpret_cast<const HashRecord*>(static_cast<const uint8_t*>(map) + sizeof(HashDbHeader));
+         count = (map_size - sizeof(HashDbHeader)) / sizeof(HashRecord);
+         if (count >= UINT32_MAX / 2) {
+            munmap(map, map_size);
+            throw std::runtime_error(path + " is too large");
+         }
+         madvise(map, map_size, MADV_WILLNEED);
+         buildIndex();
+      }
+
+      ~GoldenHashDb() {
+         if (map)
+            munmap(map, map_size);
+      }
+
+      GoldenHashDb(const GoldenHashDb&) = delete;
+      GoldenHashDb& operator=(const GoldenHashDb&) = delete;
+
+      HashAlgo algo() const { return static_cast<HashAlgo>(header.algo); }
+      size_t size() const { return count; }
+
+      // Index of the record for `pts` (or for output position `ordinal` when
+      // there is no PTS), -1 if the golden run has none.
+      int64_t find(int64_t pts, int64_t ordinal) const {
+         if (pts == AV_NOPTS_VALUE)
+            return ordinal >= 0 && static_cast<uint64_t>(ordinal) < count &&
+               records[ordinal].pts == AV_NOPTS_VALUE ? ordinal : -1;
+         for (size_t slot = hashPts(pts); ; slot = (slot + 1) & mask) {
+            const uint32_t entry = table[slot];
+            if (!entry)
+               return -1;
+            if (records[entry - 1].pts == pts)
+               return entry - 1;
+         }
+      }
+
+      const HashRecord& at(int64_t index) const { return records[index]; }
+
+   private:
+      void* map;
+      size_t map_size;
+      HashDbHeader header;
+      const HashRecord* records;
+      uint64_t count;
+      std::vector<uint32_t> table; // record index + 1, 0: empty
+      size_t mask = 0;
+
+      size_t hashPts(int64_t pts) const {
+         return static_cast<size_t>((static_cast<uint64_t>(pts) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+      }
+
+      void buildIndex() {
+         size_t capacity = 16;
+         while (capacity < count * 2)
+            capacity <<= 1;
+         table.assign(capacity, 0);
+         mask = capacity - 1;
+         for (uint64_t i = 0; i < count; i++) {
+            if (records[i].pts == AV_NOPTS_VALUE)
+               continue;
+            size_t slot = hashPts(records[i].pts);
+            while (table[slot] && records[table[slot] - 1].pts != records[i].pts)
+               slot = (slot + 1) & mask;
+            if (!table[slot])
+               table[slot] = static_cast<uint32_t>(i + 1);
+         }
+      }
+};
+
+#endif // HASH_DB_H
@@ -0,0 +1,168 @@
+#ifndef HASH_POOL_H
+#define HASH_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include "frame_hasher.h"
+#include "stage_metrics.h"
+
+/* Hashes frames on a pool of worker threads and hands results back in
+ * submission order.
+ *
+ * submit() takes a new reference to the frame (no pixel copy) together with
+ * a caller payload. Workers hash in any order; the sink is called for the
+ * next expected sequence number only, so it sees payloads exactly in
+ * submit() order and never concurrently. At most `max_pending` frames are
+ * in flight (submit() blocks beyond that, which also bounds how many decoder
+ * buffers we hold), so every job lives in a fixed slot `seq % max_pending`:
+ * the AVFrame shells and the reorder state are allocated once, up front.
+ * An optional histogram receives the duration of every hash.
+ */
+template <typename Payload>
+class OrderedHashPool {
+   public:
+      typedef std::function<void(Payload&, const FrameDigest&)> Sink;
+
+      OrderedHashPool(HashAlgo algo, int threads, Sink sink, LatencyHistogram* latency = nullptr)
+      : sink(sink),
+        latency(latency),
+        max_pending(std::max(threads, 1) * 2 + 2),
+        slots(max_pending),
+        next_seq(0),
+        next_take(0),
+        stopping(false),
+        next_emit(0)
+      {
+         if (threads < 1)
+            threads = 1;
+         for (size_t i = 0; i < slots.size(); i++) {
+            slots[i].frame = av_frame_alloc();
+            if (!slots[i].frame) {
+               for (size_t k = 0; k < i; k++)
+                  av_frame_free(&slots[k].frame);
+               throw std::runtime_error("Failed to allocate hash pool frames");
+            }
+         }
+         for (int i = 0; i < threads; i++)
+            workers.emplace_back(&OrderedHashPool::workerLoop, this, algo);
+      }
+
+      ~OrderedHashPool() {
+         stop();
+         for (size_t i = 0; i < slots.size(); i++)
+            av_frame_free(&slots[i].frame);
+      }
+
+      OrderedHashPool(const OrderedHashPool&) = delete;
+      OrderedHashPool& operator=(const OrderedHashPool&) = delete;
+
+      void submit(const AVFrame* frame, const Payload& payload) {
+         std::unique_lock<std::mutex> lock(job_mutex);
+         space_cv.wait(lock, [this] { return next_seq - emitted() < max_pending; });
+         Slot& slot = slots[next_seq % max_pending]; // emitted, so free
+         if (av_frame_ref(slot.frame, frame) < 0)
+            av_frame_unref(slot.frame); // hashed as "n/a" rather than stalling the order
+         slot.payload = payload;
+         next_seq++;
+         job_cv.notify_one();
+      }
+
+      // Waits until everything submitted so far has reached the sink.
+      void flush() {
+         std::unique_lock<std::mutex> lock(job_mutex);
+         space_cv.wait(lock, [this] { return emitted() == next_seq; });
+      }
+
+      // Finishes outstanding jobs and joins the workers.
+      void stop() {
+         {
+            std::lock_guard<std::mutex> lock(job_mutex);
+            if (stopping)
+               return;
+            stopping = true;
+         }
+         job_cv.notify_all();
+         for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+      }
+
+   private:
+      struct Slot {
+         AVFrame* frame = nullptr;
+         Payload payload;
+         FrameDigest digest;
+         bool ready = false; // hashed, waiting for its turn at the sink
+      };
+
+      Sink sink;
+      LatencyHistogram* latency;
+      const uint64_t max_pending;
+      std::vector<Slot> slots;
+      std::vector<std::thread> workers;
+
+      std::mutex job_mutex; // next_seq, next_take, stopping
+      std::condition_variable job_cv;
+      std::condition_variable space_cv;
+      uint64_t next_seq;  // next slot to fill
+      uint64_t next_take; // next slot to hash
+      bool stopping;
+
+      std::mutex emit_mutex; // slot.ready, next_emit; held while calling the sink
+      std::atomic<uint64_t> next_emit;
+
+      uint64_t emitted() const { return next_emit.load(std::memory_order_acquire); }
+
+      void workerLoop(HashAlgo algo) {
+         FrameHasher hasher(algo);
+         for (;;) {
+            uint64_t seq;
+            {
+               std::unique_lock<std::mutex> lock(job_mutex);
+               job_cv.wait(lock, [this] { return stopping || next_take != next_seq; });
+               if (next_take == next_seq)
+                  return; // stopping and drained
+               seq = next_take++;
+            }
+
+            Slot& slot = slots[seq % max_pending];
+            const uint64_t start = latency ? StageMetrics::now() : 0;
+            slot.digest = slot.frame->data[0] ? hasher.hash(slot.frame) : FrameDigest();
+            if (latency)
+               latency->record(StageMetrics::now() - start);
+            av_frame_unref(slot.frame);
+
+            {
+               std::lock_guard<std::mutex> lock(emit_mutex);
+               slot.ready = true;
+               for (;;) {
+                  Slot& next = slots[next_emit % max_pending];
+                  if (!next.ready)
+                     break;
+                  sink(next.payload, next.digest);
+                  next.ready = false;
+                  next_emit.fetch_add(1, std::memory_order_release);
+               }
+            }
+            {
+               // wake submit()/flush() waiting on emitted()
+               std::lock_guard<std::mutex> lock(job_mutex);
+               space_cv.notify_all();
+            }
+         }
+      }
+};
+
+#endif // HASH_POOL_H
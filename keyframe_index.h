@@ -0,0 +1,256 @@
+#ifndef KEYFRAME_INDEX_H
+#define KEYFRAME_INDEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "frame_hasher.h" // Xxh64
+
+// One keyframe of the indexed stream: PTS in stream time base and the byte
+// offset of its packet (-1 if the demuxer did not report one).
+struct KeyframeEntry {
+   int64_t pts;
+   int64_t pos;
+};
+
+// What the sidecar is keyed on. The fingerprint hashes the first and last
+// 64 KiB so a rewritten file with the same size and mtime is still caught.
+struct MediaIdentity {
+   uint64_t size;
+   int64_t mtime_ns;
+   uint64_t fingerprint;
+
+   bool operator==(const MediaIdentity& o) const {
+      return size == o.size && mtime_ns == o.mtime_ns && fingerprint == o.fingerprint;
+   }
+
+   static bool of(const std::string& path, MediaIdentity& id) {
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0)
+         return false;
+      id.size = st.st_size;
+      id.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+      FILE* f = fopen(path.c_str(), "rb");
+      if (!f)
+         return false;
+      const size_t CHUNK = 64 * 1024;
+      std::vector<uint8_t> buf(CHUNK);
+      Xxh64 xxh;
+      size_t n = fread(buf.data(), 1, CHUNK, f);
+      xxh.update(buf.data(), n);
+      if (id.size > CHUNK && fseeko(f, -static_cast<off_t>(std::min<uint64_t>(CHUNK, id.size - CHUNK)), SEEK_END) == 0) {
+         n = fread(buf.data(), 1, CHUNK, f);
+         xxh.update(buf.data(), n);
+      }
+      xxh.update(reinterpret_cast<const uint8_t*>(&id.size), sizeof(id.size));
+      fclose(f);
+      id.fingerprint = xxh.digest();
+      return true;
+   }
+};
+
+/* Sorted keyframe table of one stream, persisted as a memory-mappable
+ * sidecar (<media>.kfidx):
+ *
+ *   64 byte header | count x KeyframeEntry (16 bytes, host byte order)
+ *
+ * A loaded index is used straight from the mapping; lookups are a binary
+ * search over the entries.
+ */
+class KeyframeIndex {
+   public:
+      KeyframeIndex()
+      : map_base(nullptr),
+        map_size(0),
+        entries(nullptr),
+        count(0),
+        time_base(AVRational{0, 1})
+      {
+      }
+
+      ~KeyframeIndex() { unmap(); }
+
+      KeyframeIndex(const KeyframeIndex&) = delete;
+      KeyframeIndex& operator=(const KeyframeIndex&) = delete;
+
+      static std::string sidecarPath(const std::string& media) { return media + ".kfidx"; }
+
+      size_t size() const { return count; }
+      bool empty() const { return count == 0; }
+      const KeyframeEntry& at(size_t i) const { return entries[i]; }
+      const KeyframeEntry* begin() const { return entries; }
+      const KeyframeEntry* end() const { return entries + count; }
+      AVRational timeBase() const { return time_base; }
+
+      // Last keyframe with pts <= target, or nullptr if target precedes all.
+      const KeyframeEntry* find(int64_t target) const {
+         const KeyframeEntry* it = std::upper_bound(entries, entries + count, target,
+               [](int64_t ts, const KeyframeEntry& e) { return ts < e.pts; });
+         return it == entries ? nullptr : it - 1;
+      }
+
+      // Appends while recording a linear pass; out-of-order keys are ignored.
+      void add(int64_t pts, int64_t pos) {
+         if (map_base || pts == AV_NOPTS_VALUE)
+            return;
+         if (!building.empty() && pts <= building.back().pts)
+            return;
+         building.push_back(KeyframeEntry{pts, pos});
+         entries = building.data();
+         count = building.size();
+      }
+
+      void setTimeBase(AVRational tb) { time_base = tb; }
+
+      bool load(const std::string& path, const MediaIdentity& id, int stream_index) {
+         unmap();
+         int fd = open(path.c_str(), O_RDONLY);
+         if (fd < 0)
+            return false;
+         struct stat st;
+         void* base = MAP_FAILED;
+         if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Header)))
+            base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+         close(fd);
+         if (base == MAP_FAILED)
+            return false;
+
+         const Header* h = static_cast<const Header*>(base);
+         // count comes from disk: bound it first, the product could wrap around to st_size
+         const uint64_t room = (static_cast<uint64_t>(st.st_size) - sizeof(Header)) / sizeof(KeyframeEntry);
+         if (memcmp(h->magic, magic(), sizeof(h->magic)) != 0 || h->version != VERSION ||
+               h->stream_index != static_cast<uint32_t>(stream_index) ||
+               !(h->identity == id) || h->count > room ||
+               sizeof(Header) + h->count * sizeof(KeyframeEntry) != static_cast<uint64_t>(st.st_size)) {
+            munmap(base, st.st_size);
+            return false;
+         }
+
+         map_base = base;
+         map_size = st.st_size;
+         entries = reinterpret_cast<const KeyframeEntry*>(static_cast<const char*>(base) + sizeof(Header));
+         count = h->count;
+         time_base = AVRational{h->tb_num, h->tb_den};
+         building.clear();
+         return true;
+      }
+
+      // Written to a temp file and renamed so readers never see a partial index.
+      bool save(const std::string& path, const MediaIdentity& id, int stream_index) const {
+         Header h;
+         memset(&h, 0, sizeof(h));
+         memcpy(h.magic, magic(), sizeof(h.magic));
+         h.version = VERSION;
+         h.stream_index = stream_index;
+         h.tb_num = time_base.num;
+         h.tb_den = time_base.den;
+         h.identity = id;
+         h.count = count;
+
+         std::string tmp = path + ".tmp";
+         FILE* f = fopen(tmp.c_str(), "wb");
+         if (!f)
+            return false;
+         bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+            fwrite(entries, sizeof(KeyframeEntry), count, f) == count;
+         ok = (fclose(f) == 0) && ok;
+         if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            unlink(tmp.c_str());
+            return false;
+         }
+         return true;
+      }
+
+      /* Dedicated indexing pass: demux only (no decoder), on a private
+       * AVFormatContext so it can run before or alongside playback.
+       */
+      bool build(const std::string& filename, int stream_index, const std::atomic<bool>* abort = nullptr) {
+         unmap();
+         building.clear();
+         count = 0;
+
+         AVFormatContext* ctx = nullptr;
+         if (avformat_open_input(&ctx, filename.c_str(), nullptr, nullptr) < 0)
+            return false;
+         // streams of headerless formats (TS) only exist once probed
+         if (avformat_find_stream_info(ctx, nullptr) < 0 ||
+               stream_index < 0 || stream_index >= static_cast<int>(ctx->nb_streams)) {
+            avformat_close_input(&ctx);
+            return false;
+         }
+         for (unsigned i = 0; i < ctx->nb_streams; i++) {
+            if (static_cast<int>(i) != stream_index)
+               ctx->streams[i]->discard = AVDISCARD_ALL;
+         }
+         time_base = ctx->streams[stream_index]->time_base;
+
+         std::vector<KeyframeEntry> keys;
+         AVPacket* pkt = av_packet_alloc();
+         while (!(abort && *abort) && av_read_frame(ctx, pkt) >= 0) {
+            if (pkt->stream_index == stream_index && (pkt->flags & AV_PKT_FLAG_KEY)) {
+               int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+               if (pts != AV_NOPTS_VALUE)
+                  keys.push_back(KeyframeEntry{pts, pkt->pos});
+            }
+            av_packet_unref(pkt);
+         }
+         av_packet_free(&pkt);
+         avformat_close_input(&ctx);
+
+         std::sort(keys.begin(), keys.end(),
+               [](const KeyframeEntry& a, const KeyframeEntry& b) { return a.pts < b.pts; });
+         for (size_t i = 0; i < keys.size(); i++)
+            add(keys[i].pts, keys[i].pos);
+         return !(abort && *abort);
+      }
+
+   private:
+      static const char* magic() { return "FFSKIDX1"; }
+      static const uint32_t VERSION = 1;
+
+      struct Header {
+         char magic[8];
+         uint32_t version;
+         uint32_t stream_index;
+         int32_t tb_num;
+         int32_t tb_den;
+         MediaIdentity identity; // 24 bytes
+         uint64_t count;
+         uint8_t reserved[8];
+      };
+      static_assert(sizeof(Header) == 64, "sidecar header must stay 64 bytes");
+
+      void* map_base;
+      size_t map_size;
+      const KeyframeEntry* entries;
+      size_t count;
+      AVRational time_base;
+      std::vector<KeyframeEntry> building;
+
+      void unmap() {
+         if (map_base) {
+            munmap(map_base, map_size);
+            map_base = nullptr;
+            map_size = 0;
+            entries = nullptr;
+            count = 0;
+         }
+      }
+};
+
+#endif // KEYFRAME_INDEX_H
@@ -0,0 +1,564 @@
+#ifndef LOCKSTEP_DIFF_H
+#define LOCKSTEP_DIFF_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "packet_queue.h"
+#include "frame_hasher.h"
+#include "frame_compare.h"
+#include "media_io.h"
+#include "stage_metrics.h"
+
+struct DiffOptions {
+   std::string codec;          // decoder B by name (h264_v4l2m2m, ...); A is the default SW decoder
+   int window = 8;             // frames per side waiting for their partner
+   double psnr_threshold = 40; // dB; frames in different pixel formats below this diverge
+   HashAlgo hash_algo = HASH_MD5;
+   int decoder_threads = 0;    // decoder A, 0: libavcodec default
+   IoMode io_mode = IO_DEFAULT;
+   size_t io_window = 32 << 20;
+};
+
+struct DiffStats {
+   uint64_t frames[2] = {0, 0};
+   uint64_t decode_errors[2] = {0, 0}; // packets the decoder rejected
+   double busy_seconds[2] = {0, 0};    // time inside send/receive
+   uint64_t compared = 0;
+   uint64_t identical = 0;        // every plane hash equal
+   uint64_t pixel_mismatch = 0;   // same pixel format, some plane differs
+   uint64_t converted = 0;        // different pixel formats, compared by PSNR
+   uint64_t below_threshold = 0;  // ... and below --diff-psnr
+   uint64_t incomparable = 0;     // size or chroma subsampling differ
+   uint64_t unmatched[2] = {0, 0}; // no frame with that PTS from the other decoder
+   double min_psnr = std::numeric_limits<double>::infinity();
+   double wall_seconds = 0;
+   bool read_error = false;
+   std::string first_divergence;
+
+   bool diverged() const {
+      return pixel_mismatch || below_threshold || incomparable || unmatched[0] || unmatched[1];
+   }
+};
+
+/* Lockstep differential decode: one demuxer feeds the same packets to two
+ * decoders running on their own threads, and the calling thread pairs their
+ * output by PTS and compares it.
+ *
+ * Every queue is bounded: the demuxer blocks on the slower decoder's packet
+ * queue, and each side keeps at most `window` frames waiting for a partner;
+ * when that is full its decoder blocks until the other side catches up.
+ * A frame is reported as unmatched once the other decoder has moved past
+ * it. Wall time therefore tracks the slower decoder. Frames of the same pixel format are compared by
+ * per-plane hashes (PSNR is added for a mismatch to size it), frames in
+ * different formats by per-component PSNR against the threshold.
+ */
+class LockstepDiff {
+   public:
+      LockstepDiff(const std::string& path, const DiffOptions& options)
+      : options(options),
+        fmt_ctx(nullptr),
+        video_stream_index(-1)
+      {
+         // a throw from here on skips the destructor: release what is open so far
+         struct CloseOnThrow {
+            LockstepDiff* diff;
+            ~CloseOnThrow() {
+               if (diff)
+                  diff->closeAll();
+            }
+         } close_on_throw = {this};
+
+         if (openMediaInput(&fmt_ctx, path, options.io_mode, options.io_window, media_io) < 0)
+            throw std::runtime_error("Failed to open file");
+         if (avformat_find_stream_info(fmt_ctx, nullptr) < 0)
+            throw std::runtime_error("Failed to find stream info");
+         for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+            if (video_stream_index == -1 && fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+               video_stream_index = i;
+            else
+               fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+         }
+         if (video_stream_index == -1)
+            throw std::runtime_error("No video stream found");
+
+         const AVStream* st = fmt_ctx->streams[video_stream_index];
+         const AVCodec* sw = avcodec_find_decoder(st->codecpar->codec_id);
+         const AVCodec* other = avcodec_find_decoder_by_name(options.codec.c_str());
+         if (!sw)
+            throw std::runtime_error("Unsupported codec");
+         if (!other)
+            throw std::runtime_error("Decoder " + options.codec + " not found");
+         if (other->id != st->codecpar->codec_id)
+            throw std::runtime_error("Decoder " + options.codec + " does not decode this stream");
+         openLane(0, openLaneDecoder(sw, st, options.decoder_threads), false);
+         // frames of a hardware decoder are copied out: holding its surfaces in
+         // the reorder window would starve its fixed buffer pool
+         openLane(1, openLaneDecoder(other, st, 0), true);
+         close_on_throw.diff = nullptr;
+      }
+
+      ~LockstepDiff() {
+         closeAll();
+      }
+
+      LockstepDiff(const LockstepDiff&) = delete;
+      LockstepDiff& operator=(const LockstepDiff&) = delete;
+
+      const char* decoderName(int side) const { return lanes[side]->dec->codec->name; }
+
+      const DiffStats& run() {
+         const auto start = std::chrono::steady_clock::now();
+         std::thread workers[2];
+         for (int side = 0; side < 2; side++)
+            workers[side] = std::thread(&LockstepDiff::laneLoop, this, std::ref(*lanes[side]));
+         std::thread demux(&LockstepDiff::demuxLoop, this);
+
+         compareLoop();
+
+         demux.join();
+         for (int side = 0; side < 2; side++) {
+            workers[side].join();
+            stats.frames[side] = lanes[side]->decoded;
+            stats.decode_errors[side] = lanes[side]->errors;
+            stats.busy_seconds[side] = lanes[side]->busy_ns / 1e9;
+         }
+         stats.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+         return stats;
+      }
+
+      void printSummary(std::ostream& out) const {
+         char line[256];
+         out << "\n=== Decoder diff ===\n";
+         for (int side = 0; side < 2; side++) {
+            snprintf(line, sizeof(line), "%c: %-16s %llu frames | %llu decode errors | busy %.2fs (%.1f fps)\n",
+                  'A' + side, decoderName(side), static_cast<unsigned long long>(stats.frames[side]),
+                  static_cast<unsigned long long>(stats.decode_errors[side]), stats.busy_seconds[side],
+                  stats.busy_seconds[side] > 0 ? stats.frames[side] / stats.busy_seconds[side] : 0.0);
+            out << line;
+         }
+         snprintf(line, sizeof(line), "Compared: %llu | identical %llu | pixel mismatch %llu | "
+               "other pixel format %llu (below %.1f dB: %llu) | incomparable %llu\n",
+               static_cast<unsigned long long>(stats.compared), static_cast<unsigned long long>(stats.identical),
+               static_cast<unsigned long long>(stats.pixel_mismatch), static_cast<unsigned long long>(stats.converted),
+               options.psnr_threshold, static_cast<unsigned long long>(stats.below_threshold),
+               static_cast<unsigned long long>(stats.incomparable));
+         out << line;
+         snprintf(line, sizeof(line), "Unmatched: A %llu | B %llu | window %d\n",
+               static_cast<unsigned long long>(stats.unmatched[0]), static_cast<unsigned long long>(stats.unmatched[1]),
+               std::max(1, options.window));
+         out << line;
+         if (stats.min_psnr < std::numeric_limits<double>::infinity()) {
+            snprintf(line, sizeof(line), "Lowest PSNR: %.2f dB\n", stats.min_psnr);
+            out << line;
+         }
+         snprintf(line, sizeof(line), "Wall time: %.2fs%s\n", stats.wall_seconds,
+               stats.read_error ? " | stopped by a read error" : "");
+         out << line;
+         out << (stats.diverged() ? "First divergence: " + stats.first_divergence : "No divergence") << "\n";
+      }
+
+   private:
+      // One decoded picture waiting for its partner.
+      struct DiffFrame {
+         AVFrame* frame;
+         int64_t key;  // PTS, else output order
+         char pict_type;
+         bool corrupt;
+         int nb_planes;
+         FrameDigest planes[4];
+
+         DiffFrame() : frame(av_frame_alloc()), key(0), pict_type('?'), corrupt(false), nb_planes(0) {}
+         ~DiffFrame() { av_frame_free(&frame); }
+      };
+
+      struct Lane {
+         Lane(AVCodecContext* dec, bool deep_copy, int window, HashAlgo algo)
+         : dec(dec),
+           deep_copy(deep_copy),
+           packets(64),
+           frames(window),
+           hasher(algo)
+         {
+         }
+
+         AVCodecContext* dec;
+         bool deep_copy;
+         SpscQueue<AVPacket*> packets; // demux -> decoder, nullptr ends the stream
+         SpscQueue<DiffFrame*> frames; // decoder -> comparison
+         FrameHasher hasher;
+         std::atomic<bool> finished{false}; // nothing more will be pushed to `frames`
+         uint64_t decoded = 0;
+         uint64_t errors = 0;
+         uint64_t busy_ns = 0;
+         int64_t sequence = 0; // key for frames without a PTS
+      };
+
+      DiffOptions options;
+      AVFormatContext* fmt_ctx;
+      std::unique_ptr<MediaIO> media_io;
+      int video_stream_index;
+      std::unique_ptr<Lane> lanes[2];
+      std::map<int64_t, DiffFrame*> pending[2]; // comparison thread: waiting for a partner
+      std::deque<int64_t> recent[2];            // comparison thread: last `window` keys per side
+      std::mutex ready_mutex;
+      std::condition_variable ready_cv; // a decoder pushed a frame or finished
+      DiffStats stats;
+
+      // Same error handling on both sides so only the decoders differ.
+      // Takes over `dec`, also when the lane cannot be built.
+      void openLane(int side, AVCodecContext* dec, bool deep_copy) {
+         try {
+            lanes[side].reset(new Lane(dec, deep_copy, std::max(1, options.window), options.hash_algo));
+         } catch (...) {
+            avcodec_free_context(&dec);
+            throw;
+         }
+      }
+
+      // Destructor, or a constructor that throws: frees queued packets and
+      // frames, the lane decoders and the demuxer.
+      void closeAll() {
+         for (int side = 0; side < 2; side++) {
+            if (!lanes[side])
+               continue;
+            AVPacket* pkt;
+            while (lanes[side]->packets.tryPop(pkt))
+               av_packet_free(&pkt);
+            DiffFrame* frame;
+            while (lanes[side]->frames.tryPop(frame))
+               delete frame;
+            for (auto it = pending[side].begin(); it != pending[side].end(); ++it)
+               delete it->second;
+            avcodec_free_context(&lanes[side]->dec);
+         }
+         if (fmt_ctx)
+            avformat_close_input(&fmt_ctx);
+         media_io.reset();
+      }
+
+      static AVCodecContext* openLaneDecoder(const AVCodec* codec, const AVStream* st, int threads) {
+         AVCodecContext* ctx = avcodec_alloc_context3(codec);
+         if (!ctx)
+            throw std::runtime_error("Failed to allocate codec context");
+         avcodec_parameters_to_context(ctx, st->codecpar);
+         ctx->pkt_timebase = st->time_base;
+         ctx->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT;
+         ctx->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
+         // no AV_EF_EXPLODE: concealed frames are what we want to compare
+         ctx->err_recognition = AV_EF_CAREFUL | AV_EF_CRCCHECK | AV_EF_BITSTREAM | AV_EF_BUFFER;
+         if (threads > 0)
+            ctx->thread_count = threads;
+         if (avcodec_open2(ctx, codec, nullptr) < 0) {
+            avcodec_free_context(&ctx);
+            throw std::runtime_error(std::string("Failed to open decoder ") + codec->name);
+         }
+         return ctx;
+      }
+
+      void demuxLoop() {
+         AVPacket* packet = av_packet_alloc();
+         int ret;
+         while ((ret = av_read_frame(fmt_ctx, packet)) >= 0) {
+            if (packet->stream_index != video_stream_index) {
+               av_packet_unref(packet);
+               continue;
+            }
+            // both decoders read the same refcounted payload
+            AVPacket* copy = av_packet_clone(packet);
+            AVPacket* queued = av_packet_alloc();
+            av_packet_move_ref(queued, packet);
+            if (!lanes[0]->packets.push(queued))
+               av_packet_free(&queued);
+            if (!copy || !lanes[1]->packets.push(copy))
+               av_packet_free(&copy);
+         }
+         stats.read_error = ret != AVERROR_EOF; // read by run() after join
+         lanes[0]->packets.push(nullptr);
+         lanes[1]->packets.push(nullptr);
+         av_packet_free(&packet);
+      }
+
+      void laneLoop(Lane& lane) {
+         AVFrame* frame = av_frame_alloc();
+         AVPacket* packet;
+         bool ended = false;
+         while (!ended && lane.packets.pop(packet)) {
+            ended = !packet;
+            uint64_t start = StageMetrics::now();
+            int ret = avcodec_send_packet(lane.dec, packet);
+            lane.busy_ns += StageMetrics::now() - start;
+            // output side full: collect frames, then hand the packet in again
+            for (int retry = 0; ret == AVERROR(EAGAIN) && retry < 1000; retry++) {
+               if (!receiveFrames(lane, frame))
+                  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+               start = StageMetrics::now();
+               ret = avcodec_send_packet(lane.dec, packet);
+               lane.busy_ns += StageMetrics::now() - start;
+            }
+            if (ret < 0 && ret != AVERROR_EOF)
+               lane.errors++;
+            receiveFrames(lane, frame);
+            av_packet_free(&packet);
+         }
+         av_frame_free(&frame);
+         lane.finished = true;
+         std::lock_guard<std::mutex> lock(ready_mutex);
+         ready_cv.notify_one();
+      }
+
+      // Moves every frame the decoder has ready to the comparison; returns how many.
+      int receiveFrames(Lane& lane, AVFrame* frame) {
+         int received = 0;
+         for (;;) {
+            const uint64_t start = StageMetrics::now();
+            int ret = avcodec_receive_frame(lane.dec, frame);
+            lane.busy_ns += StageMetrics::now() - start;
+            if (ret < 0)
+               return received;
+            received++;
+            DiffFrame* out = new DiffFrame;
+            const int64_t pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : frame->best_effort_timestamp;
+            out->key = pts != AV_NOPTS_VALUE ? pts : lane.sequence;
+            lane.sequence++;
+            out->pict_type = av_get_picture_type_char(frame->pict_type);
+            out->corrupt = (frame->flags & AV_FRAME_FLAG_CORRUPT) || frame->decode_error_flags;
+            if (!keepFrame(out->frame, frame, lane.deep_copy)) {
+               lane.errors++;
+               delete out;
+               av_frame_unref(frame);
+               continue;
+            }
+            av_frame_unref(frame);
+            out->nb_planes = lane.hasher.hashPlanes(out->frame, out->planes);
+            lane.decoded++;
+            if (!lane.frames.push(out)) {
+               delete out;
+               continue;
+            }
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            ready_cv.notify_one();
+         }
+      }
+
+      // Takes a software copy of `frame` that does not pin the decoder's buffers
+      // when `deep_copy` is set; hwaccel surfaces are always downloaded.
+      static bool keepFrame(AVFrame* kept, AVFrame* frame, bool deep_copy) {
+         const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+         int ret;
+         if (desc && (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            ret = av_hwframe_transfer_data(kept, frame, 0);
+            if (ret >= 0)
+               ret = av_frame_copy_props(kept, frame);
+         } else if (deep_copy) {
+            kept->format = frame->format;
+            kept->width = frame->width;
+            kept->height = frame->height;
+            ret = av_frame_get_buffer(kept, 0);
+            if (ret >= 0)
+               ret = av_frame_copy(kept, frame);
+            if (ret >= 0)
+               ret = av_frame_copy_props(kept, frame);
+         } else {
+            av_frame_move_ref(kept, frame);
+            ret = 0;
+         }
+         return ret >= 0;
+      }
+
+      void compareLoop() {
+         const size_t window = static_cast<size_t>(std::max(1, options.window));
+         int stalls = 0;
+         for (;;) {
+            // read before popping: a lane that was finished and is empty stays empty
+            const bool finished[2] = {lanes[0]->finished, lanes[1]->finished};
+            bool any = false;
+            for (int side = 0; side < 2; side++) {
+               // a full window waits for the other side: the decoder blocks instead of memory growing
+               DiffFrame* frame;
+               while (pending[side].size() < window && lanes[side]->frames.tryPop(frame)) {
+                  match(side, frame);
+                  any = true;
+               }
+            }
+            bool drained[2];
+            for (int side = 0; side < 2; side++)
+               drained[side] = finished[side] && lanes[side]->frames.size() == 0;
+            // nothing more comes from a drained side, so whatever waits for it is unmatched
+            for (int side = 0; side < 2; side++) {
+               while (drained[1 - side] && !pending[side].empty()) {
+                  evictOldest(side);
+                  any = true;
+               }
+            }
+            if (drained[0] && drained[1])
+               break;
+            if (any) {
+               stalls = 0;
+               continue;
+            }
+            std::unique_lock<std::mutex> lock(ready_mutex);
+            ready_cv.wait_for(lock, std::chrono::milliseconds(10));
+            lock.unlock();
+            // a decoder holding more frames than the window would otherwise
+            // never release them; give up on the oldest after ~1 s
+            if (++stalls >= 100) {
+               stalls = 0;
+               for (int side = 0; side < 2; side++) {
+                  if (pending[side].size() >= window)
+                     evictOldest(side);
+               }
+            }
+         }
+         for (int side = 0; side < 2; side++) {
+            while (!pending[side].empty())
+               evictOldest(side);
+         }
+      }
+
+      void match(int side, DiffFrame* frame) {
+         const int other = 1 - side;
+         recent[side].push_back(frame->key);
+         if (recent[side].size() > static_cast<size_t>(std::max(1, options.window)))
+            recent[side].pop_front();
+
+         auto partner = pending[other].find(frame->key);
+         if (partner != pending[other].end()) {
+            if (side == 0)
+               compare(*frame, *partner->second);
+            else
+               compare(*partner->second, *frame);
+            delete partner->second;
+            pending[other].erase(partner);
+            delete frame;
+         } else {
+            auto duplicate = pending[side].find(frame->key);
+            if (duplicate != pending[side].end()) {
+               unmatched(side, *duplicate->second);
+               delete duplicate->second;
+               pending[side].erase(duplicate);
+            }
+            pending[side][frame->key] = frame;
+         }
+         expire(other);
+      }
+
+      /* Decoders output in presentation order, so a frame the other side has
+       * moved past `window` times over (every one of its last `window` frames
+       * is later) was skipped there. The window absorbs small reorderings of
+       * broken timestamps.
+       */
+      void expire(int side) {
+         const std::deque<int64_t>& seen = recent[1 - side];
+         if (seen.size() < static_cast<size_t>(std::max(1, options.window)))
+            return;
+         const int64_t lowest = *std::min_element(seen.begin(), seen.end());
+         while (!pending[side].empty() && pending[side].begin()->first < lowest)
+            evictOldest(side);
+      }
+
+      void evictOldest(int side) {
+         auto oldest = pending[side].begin();
+         unmatched(side, *oldest->second);
+         delete oldest->second;
+         pending[side].erase(oldest);
+      }
+
+      void unmatched(int side, const DiffFrame& frame) {
+         stats.unmatched[side]++;
+         if (stats.first_divergence.empty()) {
+            char text[160];
+            snprintf(text, sizeof(text), "PTS %lld (%.3fs): only decoded by %c (%s)",
+                  static_cast<long long>(frame.key), seconds(frame.key), 'A' + side, decoderName(side));
+            diverge(text);
+         }
+      }
+
+      void compare(const DiffFrame& a, const DiffFrame& b) {
+         stats.compared++;
+         FramePsnr psnr;
+         std::string reason;
+         if (a.frame->format == b.frame->format && a.nb_planes == b.nb_planes && a.nb_planes &&
+               a.frame->width == b.frame->width && a.frame->height == b.frame->height) {
+            for (int p = 0; p < a.nb_planes; p++) {
+               if (!sameDigest(a.planes[p], b.planes[p]))
+                  reason += (reason.empty() ? "plane " : ",") + std::to_string(p);
+            }
+            if (reason.empty()) {
+               stats.identical++;
+               return;
+            }
+            stats.pixel_mismatch++;
+            reason += " differ";
+            psnr = framePsnr(a.frame, b.frame);
+         } else {
+            psnr = framePsnr(a.frame, b.frame);
+            if (!psnr.comparable) {
+               stats.incomparable++;
+               reason = "size or chroma layout differs";
+            } else {
+               stats.converted++;
+               if (psnr.min() >= options.psnr_threshold)
+                  return;
+               stats.below_threshold++;
+               reason = "PSNR below threshold";
+            }
+         }
+         if (psnr.comparable)
+            stats.min_psnr = std::min(stats.min_psnr, psnr.min());
+         if (!stats.first_divergence.empty())
+            return;
+
+         char text[512];
+         int len = snprintf(text, sizeof(text), "PTS %lld (%.3fs): %s", static_cast<long long>(a.key),
+               seconds(a.key), reason.c_str());
+         const DiffFrame* sides[2] = {&a, &b};
+         for (int side = 0; side < 2 && len < static_cast<int>(sizeof(text)); side++) {
+            const AVFrame* f = sides[side]->frame;
+            const char* fmt = av_get_pix_fmt_name(static_cast<AVPixelFormat>(f->format));
+            len += snprintf(text + len, sizeof(text) - len, "\n  %c %-16s %c %dx%d %s%s", 'A' + side,
+                  decoderName(side), sides[side]->pict_type, f->width, f->height, fmt ? fmt : "unknown",
+                  sides[side]->corrupt ? " corrupt" : "");
+            for (int p = 0; p < sides[side]->nb_planes && len < static_cast<int>(sizeof(text)); p++)
+               len += snprintf(text + len, sizeof(text) - len, " | p%d %s", p, sides[side]->planes[p].hex().c_str());
+         }
+         if (psnr.comparable && len < static_cast<int>(sizeof(text))) {
+            len += snprintf(text + len, sizeof(text) - len, "\n  PSNR (dB):");
+            for (int c = 0; c < psnr.components && len < static_cast<int>(sizeof(text)); c++)
+               len += snprintf(text + len, sizeof(text) - len, " %c %.2f", "YUVA"[c], psnr.db[c]);
+         }
+         diverge(text);
+      }
+
+      // Kept for the summary and printed as soon as it happens.
+      void diverge(const std::string& text) {
+         stats.first_divergence = text;
+         std::cout << "[Diff] First divergence at " << text << std::endl;
+      }
+
+      double seconds(int64_t pts) const {
+         return pts * av_q2d(fmt_ctx->streams[video_stream_index]->time_base);
+      }
+};
+
+#endif // LOCKSTEP_DIFF_H
@@ -0,0 +1,382 @@
+#ifndef MEDIA_IO_H
+#define MEDIA_IO_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#include "ffseeker_types.h"
+
+inline bool parseIoMode(const std::string& name, IoMode& mode) {
+   if (name == "default")
+      mode = IO_DEFAULT;
+   else if (name == "mmap")
+      mode = IO_MMAP;
+   else if (name == "readahead")
+      mode = IO_READAHEAD;
+   else if (name == "stream")
+      mode = IO_STREAM;
+   else
+      return false;
+   return true;
+}
+
+inline const char* ioModeName(IoMode mode) {
+   switch (mode) {
+      case IO_MMAP:      return "mmap";
+      case IO_READAHEAD: return "readahead";
+      case IO_STREAM:    return "stream";
+      default:           return "default";
+   }
+}
+
+struct IoStats {
+   uint64_t bytes = 0;      // handed to the demuxer
+   uint64_t reads = 0;      // read callbacks
+   uint64_t seeks = 0;      // position changes requested by the demuxer
+   uint64_t wait_ns = 0;    // time the demuxer spent blocked on data
+   uint64_t prefetched = 0; // IO_READAHEAD: bytes read by the prefetch thread
+};
+
+/* Custom AVIOContext over a local (or NFS) file.
+ *
+ * Attach it with attach() before avformat_open_input(); the context must be
+ * closed before the MediaIO is destroyed, since libavformat does not free
+ * caller-provided I/O. All callbacks run on the thread that owns the
+ * AVFormatContext, only the read-ahead prefetcher has a thread of its own.
+ */
+class MediaIO {
+   public:
+      static const size_t AVIO_BUFFER = 256 * 1024;  // demuxer-side buffer
+      static const size_t CHUNK = 1 << 20;           // IO_READAHEAD unit
+      static const size_t STREAM_BLOCK = 4 << 20;    // IO_STREAM read size
+
+      MediaIO(const std::string& path, IoMode mode, size_t window_bytes = 32 << 20)
+      : mode(mode),
+        fd(-1),
+        file_size(0),
+        pos(0),
+        avio(nullptr),
+        map_base(nullptr),
+        window_chunks(std::max<size_t>(2, window_bytes / CHUNK)),
+        want_chunk(0),
+        stopping(false),
+        stream_start(0),
+        stream_len(0),
+        dropped_until(0)
+      {
+         fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+         if (fd < 0)
+            throw std::runtime_error("Failed to open file");
+         struct stat st;
+         if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            close(fd);
+            throw std::runtime_error("Failed to stat file");
+         }
+         file_size = st.st_size;
+
+         if (mode == IO_MMAP) {
+            map_base = static_cast<const uint8_t*>(mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0));
+            if (map_base == MAP_FAILED) {
+               close(fd);
+               throw std::runtime_error("Failed to mmap file");
+            }
+            madvise(const_cast<uint8_t*>(map_base), file_size, MADV_SEQUENTIAL);
+         } else if (mode == IO_READAHEAD) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            chunks.resize(window_chunks);
+            for (size_t i = 0; i < chunks.size(); i++)
+               chunks[i].data.resize(CHUNK);
+            prefetcher = std::thread(&MediaIO::prefetchLoop, this);
+         } else if (mode == IO_STREAM) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            stream_buf.resize(STREAM_BLOCK);
+         }
+
+         uint8_t* buffer = static_cast<uint8_t*>(av_malloc(AVIO_BUFFER));
+         avio = buffer ? avio_alloc_context(buffer, AVIO_BUFFER, 0, this, &MediaIO::readPacket, nullptr,
+               &MediaIO::seekPacket) : nullptr;
+         if (!avio) {
+            av_free(buffer);
+            shutdown();
+            throw std::runtime_error("Failed to allocate I/O context");
+         }
+      }
+
+      ~MediaIO() {
+         if (avio) {
+            av_freep(&avio->buffer);
+            avio_context_free(&avio);
+         }
+         shutdown();
+      }
+
+      MediaIO(const MediaIO&) = delete;
+      MediaIO& operator=(const MediaIO&) = delete;
+
+      // Makes `ctx` (fresh from avformat_alloc_context) read through us.
+      void attach(AVFormatContext* ctx) {
+         ctx->pb = avio;
+         ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+      }
+
+      IoMode ioMode() const { return mode; }
+
+      IoStats stats() const {
+         std::lock_guard<std::mutex> lock(stats_mutex);
+         return io_stats;
+      }
+
+   private:
+      struct Chunk {
+         enum State { EMPTY, LOADING, READY };
+         int64_t index = -1;
+         State state = EMPTY;
+         size_t len = 0;
+         std::vector<uint8_t> data;
+      };
+
+      const IoMode mode;
+      int fd;
+      int64_t file_size;
+      int64_t pos; // demuxer's read position
+      AVIOContext* avio;
+
+      mutable std::mutex stats_mutex; // io_stats; stats() may be called from any thread
+      IoStats io_stats;
+
+      // IO_MMAP
+      const uint8_t* map_base;
+
+      // IO_READAHEAD
+      const size_t window_chunks;
+      std::mutex chunk_mutex; // chunks, want_chunk, stopping
+      std::condition_variable chunk_cv;
+      std::vector<Chunk> chunks; // chunk i lives in slot i % window_chunks
+      int64_t want_chunk;        // window is [want_chunk, want_chunk + window_chunks)
+      bool stopping;
+      std::thread prefetcher;
+
+      // IO_STREAM
+      std::vector<uint8_t> stream_buf;
+      int64_t stream_start; // file offset of stream_buf[0]
+      size_t stream_len;
+      int64_t dropped_until; // pages before this were released
+
+      static uint64_t nowNs() {
+         return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+      }
+
+      void shutdown() {
+         if (prefetcher.joinable()) {
+            {
+               std::lock_guard<std::mutex> lock(chunk_mutex);
+               stopping = true;
+            }
+            chunk_cv.notify_all();
+            prefetcher.join();
+         }
+         if (map_base && map_base != MAP_FAILED)
+            munmap(const_cast<uint8_t*>(map_base), file_size);
+         map_base = nullptr;
+         if (fd >= 0)
+            close(fd);
+         fd = -1;
+      }
+
+      static int readPacket(void* opaque, uint8_t* buf, int size) {
+         MediaIO* self = static_cast<MediaIO*>(opaque);
+         if (self->pos >= self->file_size)
+            return AVERROR_EOF;
+         const uint64_t start = nowNs();
+         int n;
+         switch (self->mode) {
+            case IO_MMAP:      n = self->readMapped(buf, size); break;
+            case IO_READAHEAD: n = self->readWindow(buf, size); break;
+            default:           n = self->readStream(buf, size); break;
+         }
+         const uint64_t waited = nowNs() - start;
+         std::lock_guard<std::mutex> lock(self->stats_mutex);
+         self->io_stats.reads++;
+         self->io_stats.wait_ns += waited;
+         if (n > 0)
+            self->io_stats.bytes += n;
+         return n;
+      }
+
+      static int64_t seekPacket(void* opaque, int64_t offset, int whence) {
+         MediaIO* self = static_cast<MediaIO*>(opaque);
+         whence &= ~AVSEEK_FORCE;
+         int64_t target;
+         if (whence == AVSEEK_SIZE)
+            return self->file_size;
+         else if (whence == SEEK_SET)
+            target = offset;
+         else if (whence == SEEK_CUR)
+            target = self->pos + offset;
+         else if (whence == SEEK_END)
+            target = self->file_size + offset;
+         else
+            return AVERROR(EINVAL);
+         if (target < 0)
+            return AVERROR(EINVAL);
+         if (target != self->pos) {
+            std::lock_guard<std::mutex> lock(self->stats_mutex);
+            self->io_stats.seeks++;
+         }
+         self->pos = target;
+         if (self->mode == IO_MMAP && target < self->file_size) {
+            // the landing area is read next: fault it in ahead of the copy
+            int64_t page = target & ~static_cast<int64_t>(4095);
+            madvise(const_cast<uint8_t*>(self->map_base) + page,
+                  std::min(static_cast<int64_t>(CHUNK), self->file_size - page), MADV_WILLNEED);
+         }
+         return target;
+      }
+
+      // Copying out of the mapping is where page faults (and NFS waits) happen.
+      int readMapped(uint8_t* buf, int size) {
+         size_t n = std::min<int64_t>(size, file_size - pos);
+         memcpy(buf, map_base + pos, n);
+         pos += n;
+         return n;
+      }
+
+      int readWindow(uint8_t* buf, int size) {
+         const int64_t chunk = pos / CHUNK;
+         std::unique_lock<std::mutex> lock(chunk_mutex);
+         if (chunk != want_chunk) {
+            want_chunk = chunk; // slides forward, or jumps after a seek
+            chunk_cv.notify_all();
+         }
+         Chunk& slot = chunks[chunk % window_chunks];
+         chunk_cv.wait(lock, [&] { return slot.index == chunk && slot.state == Chunk::READY; });
+         const size_t offset = pos - chunk * CHUNK;
+         if (offset >= slot.len)
+            return AVERROR_EOF; // short chunk: file shrank under us
+         size_t n = std::min<size_t>(size, slot.len - offset);
+         memcpy(buf, slot.data.data() + offset, n);
+         pos += n;
+         return n;
+      }
+
+      // Keeps the window ahead of the reader loaded, nearest chunk first.
+      void prefetchLoop() {
+         const int64_t last_chunk = (file_size - 1) / CHUNK;
+         std::unique_lock<std::mutex> lock(chunk_mutex);
+         for (;;) {
+            if (stopping)
+               return;
+            int64_t next = -1;
+            for (int64_t c = want_chunk; c < want_chunk + static_cast<int64_t>(window_chunks) && c <= last_chunk; c++) {
+               Chunk& slot = chunks[c % window_chunks];
+               if (slot.index == c || slot.state == Chunk::LOADING)
+                  continue;
+               next = c;
+               break;
+            }
+            if (next < 0) {
+               chunk_cv.wait(lock);
+               continue;
+            }
+            Chunk& slot = chunks[next % window_chunks];
+            slot.index = next;
+            slot.state = Chunk::LOADING;
+            const int64_t window_end = (want_chunk + static_cast<int64_t>(window_chunks)) * static_cast<int64_t>(CHUNK);
+            lock.unlock();
+
+            // let the kernel start on the chunk after the window meanwhile
+            if (window_end < file_size)
+               posix_fadvise(fd, window_end, CHUNK, POSIX_FADV_WILLNEED);
+            size_t len = 0;
+            while (len < CHUNK) {
+               ssize_t r = pread(fd, slot.data.data() + len, CHUNK - len, static_cast<off_t>(next * CHUNK + len));
+               if (r < 0 && errno == EINTR)
+                  continue;
+               if (r <= 0)
+                  break;
+               len += r;
+            }
+
+            lock.lock();
+            slot.len = len;
+            slot.state = Chunk::READY;
+            {
+               std::lock_guard<std::mutex> stats_lock(stats_mutex);
+               io_stats.prefetched += len;
+            }
+            chunk_cv.notify_all();
+         }
+      }
+
+      // Large sequential reads; consumed pages are dropped from the page
+      // cache so a long scan does not evict everything else on the box.
+      int readStream(uint8_t* buf, int size) {
+         if (pos < stream_start || pos >= stream_start + static_cast<int64_t>(stream_len)) {
+            ssize_t r;
+            do {
+               r = pread(fd, stream_buf.data(), STREAM_BLOCK, pos);
+            } while (r < 0 && errno == EINTR);
+            if (r < 0)
+               return AVERROR(errno);
+            if (r == 0)
+               return AVERROR_EOF;
+            stream_start = pos;
+            stream_len = r;
+            // everything before this block has been consumed (or skipped by a seek)
+            if (stream_start > dropped_until + static_cast<int64_t>(STREAM_BLOCK)) {
+               posix_fadvise(fd, 0, stream_start, POSIX_FADV_DONTNEED);
+               dropped_until = stream_start;
+            }
+            posix_fadvise(fd, stream_start + r, STREAM_BLOCK, POSIX_FADV_WILLNEED);
+         }
+         size_t offset = pos - stream_start;
+         size_t n = std::min<size_t>(size, stream_len - offset);
+         memcpy(buf, stream_buf.data() + offset, n);
+         pos += n;
+         return n;
+      }
+};
+
+/* avformat_open_input() through a MediaIO for every mode but IO_DEFAULT.
+ * `io` receives the I/O object and must outlive the context.
+ */
+inline int openMediaInput(AVFormatContext** ctx, const std::string& path, IoMode mode, size_t window_bytes,
+      std::unique_ptr<MediaIO>& io) {
+   if (mode == IO_DEFAULT)
+      return avformat_open_input(ctx, path.c_str(), nullptr, nullptr);
+   try {
+      io.reset(new MediaIO(path, mode, window_bytes));
+   } catch (const std::exception&) {
+      return AVERROR(EIO);
+   }
+   *ctx = avformat_alloc_context();
+   if (!*ctx)
+      return AVERROR(ENOMEM);
+   io->attach(*ctx);
+   return avformat_open_input(ctx, path.c_str(), nullptr, nullptr); // frees *ctx on failure
+}
+
+#endif // MEDIA_IO_H
@@ -0,0 +1,173 @@
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+#include "stage_metrics.h"
+#include "ffseeker_types.h"
+
+inline const char* budgetStageName(int stage) {
+   static const char* names[BUDGET_STAGE_COUNT] = {"packets", "frames", "streams"};
+   return stage >= 0 && stage < BUDGET_STAGE_COUNT ? names[stage] : "?";
+}
+
+/* Byte budget for everything queued between the pipeline threads (--mem-budget).
+ *
+ * acquire() charges an item to a stage before it is queued and blocks while
+ * the total would exceed the limit; release() gives the bytes back when the
+ * consumer is done with it. A stage that holds nothing is always admitted,
+ * so a producer can never wait on bytes its own consumer needs to make
+ * progress: the worst case overshoot is one item per stage. Each stage has
+ * a single acquiring thread. With limit 0 nothing blocks and the counters
+ * only measure (peak bytes per stage, for the exit summary).
+ */
+class MemoryBudget {
+   public:
+      explicit MemoryBudget(uint64_t limit = 0)
+      : limit(limit),
+        used(0),
+        peak_used(0),
+        wait_count(0),
+        wait_ns(0),
+        waiting(0),
+        closed(false)
+      {
+         for (int s = 0; s < BUDGET_STAGE_COUNT; s++) {
+            held[s].store(0, std::memory_order_relaxed);
+            peak_held[s].store(0, std::memory_order_relaxed);
+         }
+      }
+
+      MemoryBudget(const MemoryBudget&) = delete;
+      MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+      // Returns false if the budget was closed while waiting; nothing is charged then.
+      bool acquire(BudgetStage stage, uint64_t bytes) {
+         if (tryCharge(stage, bytes))
+            return true;
+         const uint64_t start = StageMetrics::now();
+         wait_count.fetch_add(1, std::memory_order_relaxed);
+         bool charged = false;
+         {
+            std::unique_lock<std::mutex> lock(mutex);
+            waiting.fetch_add(1, std::memory_order_acq_rel);
+            // timed like SpscQueue's park: a missed notify costs one tick at most
+            while (!closed.load(std::memory_order_acquire) && !(charged = tryCharge(stage, bytes)))
+               cv.wait_for(lock, std::chrono::milliseconds(1));
+            waiting.fetch_sub(1, std::memory_order_acq_rel);
+         }
+         wait_ns.fetch_add(StageMetrics::now() - start, std::memory_order_relaxed);
+         return charged;
+      }
+
+      void release(BudgetStage stage, uint64_t bytes) {
+         held[stage].fetch_sub(bytes, std::memory_order_relaxed);
+         used.fetch_sub(bytes, std::memory_order_release);
+         if (waiting.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cv.notify_all();
+         }
+      }
+
+      // Wakes every waiter for good; later acquire() calls still succeed if they fit.
+      void close() {
+         closed.store(true, std::memory_order_release);
+         std::lock_guard<std::mutex> lock(mutex);
+         cv.notify_all();
+      }
+
+      uint64_t budget() const { return limit; }
+      uint64_t peak(BudgetStage stage) const { return peak_held[stage].load(std::memory_order_relaxed); }
+      uint64_t peakTotal() const { return peak_used.load(std::memory_order_relaxed); }
+      uint64_t waits() const { return wait_count.load(std::memory_order_relaxed); }
+      double waitSeconds() const { return wait_ns.load(std::memory_order_relaxed) / 1e9; }
+
+   private:
+      const uint64_t limit; // 0: unlimited
+      std::atomic<uint64_t> used;
+      std::atomic<uint64_t> peak_used;
+      std::atomic<uint64_t> held[BUDGET_STAGE_COUNT];
+      std::atomic<uint64_t> peak_held[BUDGET_STAGE_COUNT];
+      std::atomic<uint64_t> wait_count;
+      std::atomic<uint64_t> wait_ns;
+      std::atomic<int> waiting;
+      std::atomic<bool> closed;
+      std::mutex mutex;
+      std::condition_variable cv;
+
+      static void raise(std::atomic<uint64_t>& peak, uint64_t value) {
+         uint64_t seen = peak.load(std::memory_order_relaxed);
+         while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+         }
+      }
+
+      bool tryCharge(BudgetStage stage, uint64_t bytes) {
+         uint64_t current = used.load(std::memory_order_acquire);
+         do {
+            if (limit && current + bytes > limit && held[stage].load(std::memory_order_relaxed))
+               return false;
+         } while (!used.compare_exchange_weak(current, current + bytes, std::memory_order_acq_rel));
+         raise(peak_used, current + bytes);
+         raise(peak_held[stage], held[stage].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+         return true;
+      }
+};
+
+// Payload bytes a frame keeps alive: its buffers, whoever allocated them.
+inline uint64_t frameBytes(const AVFrame* frame) {
+   uint64_t bytes = 0;
+   for (int i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++)
+      bytes += frame->buf[i]->size;
+   for (int i = 0; i < frame->nb_extended_buf; i++)
+      bytes += frame->extended_buf[i]->size;
+   return bytes;
+}
+
+// Payload plus the AVPacket struct itself.
+inline uint64_t packetBytes(const AVPacket* packet) {
+   return static_cast<uint64_t>(packet->size) + sizeof(AVPacket);
+}
+
+// "512M", "2G", "64k" or plain bytes; false on anything else.
+inline bool parseByteSize(const std::string& text, uint64_t& bytes) {
+   char* end = nullptr;
+   const double value = strtod(text.c_str(), &end);
+   if (end == text.c_str() || value < 0)
+      return false;
+   double scale = 1;
+   switch (*end) {
+      case '\0': break;
+      case 'k': case 'K': scale = 1 << 10; end++; break;
+      case 'm': case 'M': scale = 1 << 20; end++; break;
+      case 'g': case 'G': scale = 1 << 30; end++; break;
+      default: return false;
+   }
+   if (*end == 'B' || *end == 'b')
+      end++;
+   if (*end)
+      return false;
+   bytes = static_cast<uint64_t>(value * scale);
+   return true;
+}
+
+// Process high-water mark of the resident set (Linux reports KiB).
+inline uint64_t peakRssBytes() {
+   struct rusage usage;
+   if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0;
+   return static_cast<uint64_t>(usage.ru_maxrss) << 10;
+}
+
+#endif // MEM_BUDGET_H
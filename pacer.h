@@ -0,0 +1,124 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#include "ffseeker_types.h"
+
+// "none", "realtime" or "fps=N"
+inline bool parsePaceMode(const std::string& arg, PaceMode& mode, double& fps) {
+   if (arg == "none") {
+      mode = PACE_NONE;
+      return true;
+   }
+   if (arg == "realtime") {
+      mode = PACE_REALTIME;
+      return true;
+   }
+   if (arg.compare(0, 4, "fps=") == 0) {
+      char* end = nullptr;
+      fps = strtod(arg.c_str() + 4, &end);
+      if (end && *end == '\0' && fps > 0) {
+         mode = PACE_FPS;
+         return true;
+      }
+   }
+   return false;
+}
+
+/* Paces video frame output on std::chrono::steady_clock.
+ *
+ * Realtime mode anchors the first frame's PTS to "now" and sleeps until
+ * anchor + (pts - anchor_pts). Sleeping against an absolute deadline instead
+ * of a per-frame delay means per-frame overhead does not accumulate as drift.
+ * reset() (called on seek) drops the anchor so the next frame starts a new
+ * timeline. Large PTS jumps, backward steps and falling far behind re-anchor
+ * the same way instead of sleeping for a long time or bursting.
+ */
+class FramePacer {
+   public:
+      FramePacer(PaceMode mode = PACE_NONE, double fps = 0)
+      : mode(mode),
+        interval(fps > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps))
+                         : Clock::duration::zero()),
+        anchored(false),
+        anchor_pts(AV_NOPTS_VALUE),
+        last_pts(AV_NOPTS_VALUE)
+      {
+      }
+
+      void reset() { anchored = false; }
+
+      // Blocks until the frame with `pts` is due.
+      void wait(int64_t pts, AVRational time_base) {
+         if (mode == PACE_NONE)
+            return;
+
+         const Clock::time_point now = Clock::now();
+         if (mode == PACE_FPS || pts == AV_NOPTS_VALUE) {
+            waitInterval(now);
+            return;
+         }
+
+         if (!anchored || discontinuity(pts, time_base))
+            anchor(now, pts);
+
+         Clock::time_point due = anchor_time + std::chrono::duration_cast<Clock::duration>(
+               std::chrono::duration<double>((pts - anchor_pts) * av_q2d(time_base)));
+         if (now - due > std::chrono::milliseconds(MAX_LATE_MS)) {
+            anchor(now, pts); // decoder stalled; don't burst to catch up
+            due = now;
+         }
+         last_pts = pts;
+         next_due = due + interval;
+         std::this_thread::sleep_until(due);
+      }
+
+   private:
+      typedef std::chrono::steady_clock Clock;
+      static constexpr int MAX_JUMP_SEC = 2;
+      enum { MAX_LATE_MS = 500 }; // enum: no out-of-class definition needed when bound to a reference
+
+      PaceMode mode;
+      Clock::duration interval;
+      bool anchored;
+      Clock::time_point anchor_time;
+      Clock::time_point next_due;
+      int64_t anchor_pts;
+      int64_t last_pts;
+
+      void anchor(Clock::time_point now, int64_t pts) {
+         anchored = true;
+         anchor_time = now;
+         anchor_pts = pts;
+         next_due = now;
+      }
+
+      bool discontinuity(int64_t pts, AVRational time_base) const {
+         if (last_pts == AV_NOPTS_VALUE)
+            return false;
+         double delta = (pts - last_pts) * av_q2d(time_base);
+         return delta < 0 || delta > MAX_JUMP_SEC;
+      }
+
+      // fps mode, or realtime frames without a PTS
+      void waitInterval(Clock::time_point now) {
+         if (!anchored || now - next_due > std::chrono::milliseconds(MAX_LATE_MS)) {
+            anchored = true;
+            anchor_time = now;
+            next_due = now;
+         }
+         Clock::time_point due = next_due;
+         next_due += interval;
+         std::this_thread::sleep_until(due);
+      }
+};
+
+#endif // PACER_H
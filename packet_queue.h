@@ -0,0 +1,141 @@
+#ifndef PACKET_QUEUE_H
+#define PACKET_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* Bounded single-producer / single-consumer ring.
+ *
+ * push/pop are lock-free: the producer only writes `tail`, the consumer only
+ * writes `head`. The mutex/condvar pair is used only to park a thread when the
+ * ring is full (producer) or empty (consumer), so the fast path never takes a
+ * lock. Capacity is rounded up to a power of two.
+ */
+template <typename T>
+class SpscQueue {
+   public:
+      explicit SpscQueue(size_t capacity)
+      : slots(roundUp(capacity)),
+        mask(slots.size() - 1),
+        head(0),
+        tail(0),
+        closed(false),
+        waiting(0)
+      {
+      }
+
+      // Non-blocking, returns false when full.
+      bool tryPush(const T& item) {
+         const size_t t = tail.load(std::memory_order_relaxed);
+         if (t - head.load(std::memory_order_acquire) > mask)
+            return false;
+         slots[t & mask] = item;
+         tail.store(t + 1, std::memory_order_release);
+         wakeWaiters();
+         return true;
+      }
+
+      // Non-blocking, returns false when empty.
+      bool tryPop(T& item) {
+         const size_t h = head.load(std::memory_order_relaxed);
+         if (h == tail.load(std::memory_order_acquire))
+            return false;
+         item = std::move(slots[h & mask]); // don't keep payload references alive in the ring
+         head.store(h + 1, std::memory_order_release);
+         wakeWaiters();
+         return true;
+      }
+
+      // Blocks while the ring is full. Returns false if the queue was closed.
+      bool push(const T& item) {
+         for (int spin = 0; ; ++spin) {
+            if (closed.load(std::memory_order_acquire))
+               return false;
+            if (tryPush(item))
+               return true;
+            backoff(spin, [this] { return !full(); });
+         }
+      }
+
+      // Blocks while the ring is empty. Returns false once the queue is
+      // closed and drained.
+      bool pop(T& item) {
+         for (int spin = 0; ; ++spin) {
+            if (tryPop(item))
+               return true;
+            if (closed.load(std::memory_order_acquire))
+               return false;
+            backoff(spin, [this] { return size() != 0; });
+         }
+      }
+
+      // Wakes both sides; pending items can still be popped.
+      void close() {
+         closed.store(true, std::memory_order_release);
+         std::lock_guard<std::mutex> lock(park_mutex);
+         park_cv.notify_all();
+      }
+
+      size_t size() const {
+         return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+      }
+
+      size_t capacity() const { return slots.size(); }
+
+   private:
+      std::vector<T> slots;
+      const size_t mask;
+      // padding instead of alignas: queues also live inside heap objects,
+      // and C++11 operator new ignores extended alignment
+      char pad_head[64];
+      std::atomic<size_t> head; // consumer owned
+      char pad_tail[64];
+      std::atomic<size_t> tail; // producer owned
+      char pad_end[64];
+      std::atomic<bool> closed;
+      std::atomic<int> waiting;
+      std::mutex park_mutex;
+      std::condition_variable park_cv;
+
+      static size_t roundUp(size_t n) {
+         size_t p = 2;
+         while (p < n)
+            p <<= 1;
+         return p;
+      }
+
+      bool full() const { return size() > mask; }
+
+      // spin briefly, then yield, then park on the condvar. The park uses a
+      // short timeout so a missed notify can only cost one tick.
+      template <typename Ready>
+      void backoff(int spin, Ready ready) {
+         if (spin < 64)
+            return;
+         if (spin < 128) {
+            std::this_thread::yield();
+            return;
+         }
+         std::unique_lock<std::mutex> lock(park_mutex);
+         waiting.fetch_add(1, std::memory_order_acq_rel);
+         park_cv.wait_for(lock, std::chrono::milliseconds(1), [&] {
+            return ready() || closed.load(std::memory_order_acquire);
+         });
+         waiting.fetch_sub(1, std::memory_order_acq_rel);
+      }
+
+      void wakeWaiters() {
+         if (waiting.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> lock(park_mutex);
+            park_cv.notify_all();
+         }
+      }
+};
+
+#endif // PACKET_QUEUE_H
@@ -0,0 +1,156 @@
+#ifndef PACKET_SCAN_H
+#define PACKET_SCAN_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include "ffseeker_types.h"
+
+inline bool parseScanLevel(const std::string& name, ScanLevel& level) {
+   if (name == "full")
+      level = SCAN_FULL;
+   else if (name == "keyframes")
+      level = SCAN_KEYFRAMES;
+   else if (name == "packets")
+      level = SCAN_PACKETS;
+   else
+      return false;
+   return true;
+}
+
+inline const char* scanLevelName(ScanLevel level) {
+   switch (level) {
+      case SCAN_KEYFRAMES: return "keyframes";
+      case SCAN_PACKETS:   return "packets";
+      default:             return "full";
+   }
+}
+
+// Packet anomalies, one bit each.
+enum {
+   PKT_CORRUPT        = 1 << 0, // AV_PKT_FLAG_CORRUPT from the demuxer
+   PKT_EMPTY          = 1 << 1, // zero-size payload
+   PKT_NON_MONOTONIC  = 1 << 2, // DTS not increasing
+   PKT_PTS_BEFORE_DTS = 1 << 3,
+   PKT_GAP            = 1 << 4, // DTS jumps far beyond the packet duration
+   PKT_OVERSIZED      = 1 << 5  // far above the running mean for its kind (key / non-key)
+};
+
+inline const char* packetAnomalyName(uint32_t bit) {
+   switch (bit) {
+      case PKT_CORRUPT:        return "corrupt flag";
+      case PKT_EMPTY:          return "empty packet";
+      case PKT_NON_MONOTONIC:  return "non-monotonic DTS";
+      case PKT_PTS_BEFORE_DTS: return "PTS before DTS";
+      case PKT_GAP:            return "timestamp gap";
+      default:                 return "oversized packet";
+   }
+}
+
+/* Demux-only health check. Timestamps are checked on DTS (PTS is reordered
+ * with B-frames); the expected step is the packet duration, or a running
+ * estimate of the DTS step when the container leaves it out. Packet sizes
+ * are compared against separate running means for key and non-key packets,
+ * since keyframes are legitimately many times larger.
+ */
+class PacketScanner {
+   public:
+      PacketScanner(const AVFormatContext* ctx, const std::vector<int>& streams)
+      : slots(ctx->nb_streams, -1)
+      {
+         for (size_t k = 0; k < streams.size(); k++) {
+            const AVStream* st = ctx->streams[streams[k]];
+            State state;
+            state.stats.index = streams[k];
+            state.stats.type = st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? 'v'
+               : st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO ? 'a' : 'd';
+            slots[streams[k]] = static_cast<int>(states.size());
+            states.push_back(state);
+         }
+      }
+
+      // Returns the PKT_* anomalies of `packet`; 0 for streams not scanned.
+      uint32_t check(const AVPacket* packet) {
+         if (packet->stream_index < 0 || static_cast<size_t>(packet->stream_index) >= slots.size() ||
+               slots[packet->stream_index] < 0)
+            return 0;
+         State& s = states[slots[packet->stream_index]];
+         PacketScanStats& st = s.stats;
+         const bool key = packet->flags & AV_PKT_FLAG_KEY;
+         uint32_t found = 0;
+         st.packets++;
+         st.bytes += packet->size;
+         st.keyframes += key;
+
+         if (packet->flags & AV_PKT_FLAG_CORRUPT)
+            found |= PKT_CORRUPT;
+         if (packet->size <= 0)
+            found |= PKT_EMPTY;
+         if (packet->pts == AV_NOPTS_VALUE && packet->dts == AV_NOPTS_VALUE)
+            st.missing_ts++;
+         if (packet->pts != AV_NOPTS_VALUE && packet->dts != AV_NOPTS_VALUE && packet->pts < packet->dts)
+            found |= PKT_PTS_BEFORE_DTS;
+
+         if (packet->dts != AV_NOPTS_VALUE) {
+            if (s.last_dts != AV_NOPTS_VALUE) {
+               const int64_t step = packet->dts - s.last_dts;
+               const int64_t expected = s.last_duration > 0 ? s.last_duration : static_cast<int64_t>(s.step_mean);
+               if (step <= 0)
+                  found |= PKT_NON_MONOTONIC;
+               else if (expected > 0 && step > 4 * expected)
+                  found |= PKT_GAP;
+               if (step > 0 && !(found & PKT_GAP))
+                  s.step_mean = s.step_mean > 0 ? s.step_mean * 0.9 + step * 0.1 : step;
+            }
+            s.last_dts = packet->dts;
+            s.last_duration = packet->duration;
+         }
+
+         if (packet->size > 0) {
+            double& mean = s.size_mean[key];
+            uint64_t& seen = s.size_count[key];
+            if (seen >= 16 && packet->size > 16 * mean)
+               found |= PKT_OVERSIZED;
+            else
+               mean = seen ? mean + (packet->size - mean) / std::min<uint64_t>(seen + 1, 256) : packet->size;
+            seen++;
+         }
+
+         st.corrupt += (found & PKT_CORRUPT) != 0;
+         st.empty += (found & PKT_EMPTY) != 0;
+         st.non_monotonic += (found & PKT_NON_MONOTONIC) != 0;
+         st.pts_before_dts += (found & PKT_PTS_BEFORE_DTS) != 0;
+         st.gaps += (found & PKT_GAP) != 0;
+         st.oversized += (found & PKT_OVERSIZED) != 0;
+         return found;
+      }
+
+      std::vector<PacketScanStats> stats() const {
+         std::vector<PacketScanStats> out;
+         for (size_t i = 0; i < states.size(); i++)
+            out.push_back(states[i].stats);
+         return out;
+      }
+
+   private:
+      struct State {
+         PacketScanStats stats;
+         int64_t last_dts = AV_NOPTS_VALUE;
+         int64_t last_duration = 0;
+         double step_mean = 0;
+         double size_mean[2] = {0, 0};   // non-key, key
+         uint64_t size_count[2] = {0, 0};
+      };
+
+      std::vector<int> slots; // stream index -> states, -1: not scanned
+      std::vector<State> states;
+};
+
+#endif // PACKET_SCAN_H
@@ -0,0 +1,151 @@
+#ifndef SEEK_STRESS_H
+#define SEEK_STRESS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ffseeker_types.h"
+
+/* Scripted seek stress: a list of seek targets is run back to back without
+ * a terminal, and every seek is timed from the request to the first decoded
+ * frame and to the first frame at or after the target.
+ */
+
+/* Script format: one seek per line, `#` starts a comment.
+ *   12.5     absolute, seconds from the stream start
+ *   +5 / -3  relative to the current position
+ */
+inline bool loadSeekScript(const std::string& path, std::vector<SeekStep>& steps, std::string& error) {
+   std::ifstream in(path.c_str());
+   if (!in) {
+      error = "cannot read " + path;
+      return false;
+   }
+   std::string line;
+   int line_no = 0;
+   while (std::getline(in, line)) {
+      line_no++;
+      line = line.substr(0, line.find('#'));
+      line.erase(0, line.find_first_not_of(" \t"));
+      line.erase(line.find_last_not_of(" \t\r") + 1);
+      if (line.empty())
+         continue;
+      char* end = nullptr;
+      SeekStep step;
+      step.relative = line[0] == '+' || line[0] == '-';
+      step.seconds = strtod(line.c_str(), &end);
+      if (*end != '\0' || (!step.relative && step.seconds < 0)) {
+         error = path + ":" + std::to_string(line_no) + ": expected seconds, +N or -N";
+         return false;
+      }
+      steps.push_back(step);
+   }
+   if (steps.empty()) {
+      error = path + " has no seeks";
+      return false;
+   }
+   return true;
+}
+
+// The concrete seeks of a plan for a stream of `duration` seconds.
+inline std::vector<SeekStep> seekSteps(const SeekPlan& plan, double duration) {
+   std::vector<SeekStep> steps;
+   if (plan.kind == PLAN_SCRIPT)
+      return plan.script;
+   // stay clear of the last GOP so every target has frames after it
+   const double span = std::max(0.0, duration * 0.95);
+   if (plan.kind == PLAN_RANDOM) {
+      std::mt19937_64 rng(plan.seed);
+      std::uniform_real_distribution<double> pick(0.0, span);
+      for (int i = 0; i < plan.count; i++)
+         steps.push_back(SeekStep{pick(rng), false});
+   } else if (plan.kind == PLAN_SEQUENTIAL) {
+      for (int i = 0; i < plan.count; i++)
+         steps.push_back(SeekStep{span * (i + 1) / (plan.count + 1), false});
+   }
+   return steps;
+}
+
+enum SeekOutcome {
+   SEEK_OK,
+   SEEK_BAD_PTS,  // landed on the wrong keyframe or after the target
+   SEEK_NO_FRAME, // stream ended before a frame at/after the target
+   SEEK_FAILED,   // container seek failed
+   SEEK_TIMEOUT
+};
+
+inline const char* seekOutcomeName(SeekOutcome outcome) {
+   switch (outcome) {
+      case SEEK_OK:       return "ok";
+      case SEEK_BAD_PTS:  return "bad pts";
+      case SEEK_NO_FRAME: return "no frame";
+      case SEEK_FAILED:   return "failed";
+      default:            return "timeout";
+   }
+}
+
+struct SeekSample {
+   double target;         // seconds from the stream start
+   SeekOutcome outcome;
+   bool cached;           // served from the GOP cache
+   double first_ms;       // request -> first decoded frame, -1 if none
+   double target_ms;      // request -> first frame at/after the target, -1 if none
+   double landed;         // seconds, keyframe the decoder started from (-1 unknown)
+   double expected;       // seconds, keyframe from the index (-1 without one)
+};
+
+inline double seekPercentile(std::vector<double> values, double p) {
+   if (values.empty())
+      return 0;
+   std::sort(values.begin(), values.end());
+   size_t i = static_cast<size_t>(p / 100.0 * (values.size() - 1) + 0.5);
+   return values[std::min(i, values.size() - 1)];
+}
+
+// Summary with latency percentiles; failed seeks are listed one per line.
+inline void printSeekStressSummary(std::ostream& out, const std::vector<SeekSample>& samples, double wall_seconds) {
+   std::vector<double> first, target;
+   int counts[SEEK_TIMEOUT + 1] = {0};
+   int cached = 0;
+   for (size_t i = 0; i < samples.size(); i++) {
+      const SeekSample& s = samples[i];
+      counts[s.outcome]++;
+      cached += s.cached;
+      if (s.first_ms >= 0)
+         first.push_back(s.first_ms);
+      if (s.target_ms >= 0)
+         target.push_back(s.target_ms);
+   }
+
+   char line[256];
+   out << "\n=== Seek stress ===\n";
+   snprintf(line, sizeof(line), "Seeks: %zu in %.2fs | ok %d | bad pts %d | no frame %d | failed %d | timeout %d | cached %d\n",
+         samples.size(), wall_seconds, counts[SEEK_OK], counts[SEEK_BAD_PTS], counts[SEEK_NO_FRAME],
+         counts[SEEK_FAILED], counts[SEEK_TIMEOUT], cached);
+   out << line;
+   const char* labels[2] = {"to first frame ", "to target frame"};
+   const std::vector<double>* series[2] = {&first, &target};
+   for (int k = 0; k < 2; k++) {
+      snprintf(line, sizeof(line), "Latency %s (ms): p50 %.2f | p90 %.2f | p99 %.2f | max %.2f  (%zu seeks)\n",
+            labels[k], seekPercentile(*series[k], 50), seekPercentile(*series[k], 90),
+            seekPercentile(*series[k], 99), seekPercentile(*series[k], 100), series[k]->size());
+      out << line;
+   }
+   for (size_t i = 0; i < samples.size(); i++) {
+      const SeekSample& s = samples[i];
+      if (s.outcome == SEEK_OK)
+         continue;
+      snprintf(line, sizeof(line), "  #%zu target %.3fs: %s (landed %.3fs, expected %.3fs)\n",
+            i, s.target, seekOutcomeName(s.outcome), s.landed, s.expected);
+      out << line;
+   }
+}
+
+#endif // SEEK_STRESS_H
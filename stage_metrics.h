@@ -0,0 +1,356 @@
+#ifndef STAGE_METRICS_H
+#define STAGE_METRICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/* Log-linear latency histogram in nanoseconds (HDR style): values below 16
+ * get their own bucket, larger ones are bucketed by power of two with 16
+ * linear sub-buckets, so a bucket is never wider than 1/16 of its value.
+ * Covers 1 ns to ~18 minutes; larger values land in the last bucket.
+ * record() is a couple of relaxed atomic adds and may be called from any
+ * thread; readers see a slightly torn but monotonic view, which is fine for
+ * statistics.
+ */
+class LatencyHistogram {
+   public:
+      static const int SUB_BITS = 4;
+      static const int SUB_COUNT = 1 << SUB_BITS;
+      static const int MAX_EXPONENT = 40; // 2^40 ns
+      static const int BUCKETS = SUB_COUNT + (MAX_EXPONENT - SUB_BITS) * SUB_COUNT;
+
+      LatencyHistogram() {
+         for (int i = 0; i < BUCKETS; i++)
+            buckets[i].store(0, std::memory_order_relaxed);
+         total_count.store(0, std::memory_order_relaxed);
+         total_ns.store(0, std::memory_order_relaxed);
+         max_ns.store(0, std::memory_order_relaxed);
+      }
+
+      LatencyHistogram(const LatencyHistogram&) = delete;
+      LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+      void record(uint64_t ns) {
+         buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+         total_count.fetch_add(1, std::memory_order_relaxed);
+         total_ns.fetch_add(ns, std::memory_order_relaxed);
+         uint64_t seen = max_ns.load(std::memory_order_relaxed);
+         while (ns > seen && !max_ns.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+         }
+      }
+
+      uint64_t count() const { return total_count.load(std::memory_order_relaxed); }
+      uint64_t sumNs() const { return total_ns.load(std::memory_order_relaxed); }
+      uint64_t maxNs() const { return max_ns.load(std::memory_order_relaxed); }
+      uint64_t bucket(int i) const { return buckets[i].load(std::memory_order_relaxed); }
+
+      static int bucketOf(uint64_t ns) {
+         if (ns < static_cast<uint64_t>(SUB_COUNT))
+            return static_cast<int>(ns);
+         int exponent = 63 - __builtin_clzll(ns);
+         if (exponent >= MAX_EXPONENT)
+            return BUCKETS - 1;
+         int sub = static_cast<int>((ns >> (exponent - SUB_BITS)) & (SUB_COUNT - 1));
+         return (exponent - SUB_BITS + 1) * SUB_COUNT + sub;
+      }
+
+      // Smallest value that falls into bucket `i + 1`, i.e. the exclusive upper bound of `i`.
+      static uint64_t bucketLimit(int i) {
+         if (i < SUB_COUNT)
+            return static_cast<uint64_t>(i) + 1;
+         int exponent = i / SUB_COUNT + SUB_BITS - 1;
+         uint64_t sub = i % SUB_COUNT;
+         return (static_cast<uint64_t>(SUB_COUNT) + sub + 1) << (exponent - SUB_BITS);
+      }
+
+   private:
+      std::atomic<uint64_t> buckets[BUCKETS];
+      std::atomic<uint64_t> total_count;
+      std::atomic<uint64_t> total_ns;
+      std::atomic<uint64_t> max_ns;
+};
+
+/* Plain copy of a histogram, so an interval can be computed as the
+ * difference of two snapshots without stopping the recorders.
+ */
+struct HistogramSnapshot {
+   uint64_t buckets[LatencyHistogram::BUCKETS];
+   uint64_t count;
+   uint64_t sum_ns;
+
+   void take(const LatencyHistogram& h) {
+      for (int i = 0; i < LatencyHistogram::BUCKETS; i++)
+         buckets[i] = h.bucket(i);
+      count = h.count();
+      sum_ns = h.sumNs();
+   }
+
+   void subtract(const HistogramSnapshot& earlier) {
+      for (int i = 0; i < LatencyHistogram::BUCKETS; i++)
+         buckets[i] -= earlier.buckets[i];
+      count -= earlier.count;
+      sum_ns -= earlier.sum_ns;
+   }
+
+   // Upper bound of the bucket holding the p-th percentile (0 < p <= 100).
+   uint64_t percentile(double p) const {
+      uint64_t total = 0;
+      for (int i = 0; i < LatencyHistogram::BUCKETS; i++)
+         total += buckets[i];
+      if (!total)
+         return 0;
+      uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+      rank = std::max<uint64_t>(1, std::min(rank, total));
+      uint64_t seen = 0;
+      for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+         seen += buckets[i];
+         if (seen >= rank)
+            return LatencyHistogram::bucketLimit(i) - 1;
+      }
+      return LatencyHistogram::bucketLimit(LatencyHistogram::BUCKETS - 1);
+   }
+};
+
+// Timed pipeline stages.
+enum Stage {
+   STAGE_READ,      // av_read_frame
+   STAGE_SEND,      // avcodec_send_packet
+   STAGE_RECEIVE,   // avcodec_receive_frame, including EAGAIN calls
+   STAGE_DETECT,    // CorruptionDetector::analyze
+   STAGE_HASH,      // FrameHasher::hash on a hash worker
+   STAGE_OUTPUT,    // frame report -> event log records
+   STAGE_LOG_WRITE, // event log writer: format + write of one batch
+   STAGE_COUNT
+};
+
+inline const char* stageName(int stage) {
+   static const char* names[STAGE_COUNT] = {"read", "send", "receive", "detect", "hash", "output", "log_write"};
+   return stage >= 0 && stage < STAGE_COUNT ? names[stage] : "?";
+}
+
+enum StageCounter {
+   CNT_PACKETS,
+   CNT_FRAMES,
+   CNT_CORRUPT_FRAMES,
+   CNT_VISUAL_CORRUPTION,
+   CNT_SEEKS,
+   CNT_EAGAIN_SEND,    // avcodec_send_packet: output must be drained first
+   CNT_EAGAIN_RECEIVE, // avcodec_receive_frame: decoder needs more input
+   CNT_READ_ERRORS,
+   CNT_COUNT
+};
+
+inline const char* counterName(int counter) {
+   static const char* names[CNT_COUNT] = {"packets", "frames", "corrupt_frames", "visual_corruption",
+      "seeks", "eagain_send", "eagain_receive", "read_errors"};
+   return counter >= 0 && counter < CNT_COUNT ? names[counter] : "?";
+}
+
+// Per-stage histograms and event counters of one seeker.
+class StageMetrics {
+   public:
+      StageMetrics() {
+         for (int i = 0; i < CNT_COUNT; i++)
+            counters[i].store(0, std::memory_order_relaxed);
+      }
+
+      StageMetrics(const StageMetrics&) = delete;
+      StageMetrics& operator=(const StageMetrics&) = delete;
+
+      static uint64_t now() {
+         return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+      }
+
+      // Records the time since `start` (from now()) for `stage`.
+      void record(Stage stage, uint64_t start) { stages[stage].record(now() - start); }
+
+      void count(StageCounter counter, uint64_t n = 1) {
+         counters[counter].fetch_add(n, std::memory_order_relaxed);
+      }
+
+      LatencyHistogram& stage(int stage) { return stages[stage]; }
+      const LatencyHistogram& stage(int stage) const { return stages[stage]; }
+      uint64_t counter(int counter) const { return counters[counter].load(std::memory_order_relaxed); }
+
+      /* Prometheus text exposition, written to `path` through a temporary
+       * file and rename(), so a scraper never sees a partial file.
+       */
+      bool writePrometheus(const std::string& path, const std::string& input) const {
+         const std::string tmp = path + ".tmp";
+         FILE* f = fopen(tmp.c_str(), "w");
+         if (!f)
+            return false;
+         std::string label;
+         for (size_t i = 0; i < input.size(); i++) {
+            if (input[i] == '"' || input[i] == '\\')
+               label += '\\';
+            if (input[i] != '\n')
+               label += input[i];
+         }
+
+         // cumulative buckets at fixed decimal bounds (seconds)
+         static const double bounds[] = {1e-6, 5e-6, 1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3,
+            1e-2, 5e-2, 0.1, 0.5, 1, 5};
+         fprintf(f, "# HELP ffseeker_stage_seconds Latency of one call per pipeline stage.\n"
+               "# TYPE ffseeker_stage_seconds histogram\n");
+         for (int s = 0; s < STAGE_COUNT; s++) {
+            const LatencyHistogram& h = stages[s];
+            int b = 0;
+            uint64_t cumulative = 0;
+            for (size_t k = 0; k < sizeof(bounds) / sizeof(bounds[0]); k++) {
+               const uint64_t limit_ns = static_cast<uint64_t>(bounds[k] * 1e9);
+               // bucket resolution is 1/16 octave, so a bound may split a bucket
+               while (b < LatencyHistogram::BUCKETS && LatencyHistogram::bucketLimit(b) <= limit_ns + 1)
+                  cumulative += h.bucket(b++);
+               fprintf(f, "ffseeker_stage_seconds_bucket{input=\"%s\",stage=\"%s\",le=\"%g\"} %llu\n",
+                     label.c_str(), stageName(s), bounds[k], static_cast<unsigned long long>(cumulative));
+            }
+            while (b < LatencyHistogram::BUCKETS)
+               cumulative += h.bucket(b++);
+            fprintf(f, "ffseeker_stage_seconds_bucket{input=\"%s\",stage=\"%s\",le=\"+Inf\"} %llu\n",
+                  label.c_str(), stageName(s), static_cast<unsigned long long>(cumulative));
+            fprintf(f, "ffseeker_stage_seconds_sum{input=\"%s\",stage=\"%s\"} %.9f\n",
+                  label.c_str(), stageName(s), h.sumNs() / 1e9);
+            fprintf(f, "ffseeker_stage_seconds_count{input=\"%s\",stage=\"%s\"} %llu\n",
+                  label.c_str(), stageName(s), static_cast<unsigned long long>(cumulative));
+         }
+         for (int c = 0; c < CNT_COUNT; c++) {
+            fprintf(f, "# TYPE ffseeker_%s_total counter\nffseeker_%s_total{input=\"%s\"} %llu\n",
+                  counterName(c), counterName(c), label.c_str(), static_cast<unsigned long long>(counter(c)));
+         }
+         bool ok = fclose(f) == 0;
+         if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            remove(tmp.c_str());
+            return false;
+         }
+         return true;
+      }
+
+   private:
+      LatencyHistogram stages[STAGE_COUNT];
+      std::atomic<uint64_t> counters[CNT_COUNT];
+};
+
+// "850ns", "12.3us", "4.1ms", "1.20s"
+inline const char* formatNs(uint64_t ns, char* buf, size_t size) {
+   if (ns < 1000)
+      snprintf(buf, size, "%lluns", static_cast<unsigned long long>(ns));
+   else if (ns < 1000000)
+      snprintf(buf, size, "%.1fus", ns / 1e3);
+   else if (ns < 1000000000)
+      snprintf(buf, size, "%.1fms", ns / 1e6);
+   else
+      snprintf(buf, size, "%.2fs", ns / 1e9);
+   return buf;
+}
+
+/* Background reporter: every `interval` seconds prints one stats line with
+ * the rates and per-stage p50/p99 of that interval (if `print_lines`) and
+ * refreshes the Prometheus file (if a path is set). The file is written a
+ * last time on stop().
+ */
+class StatsReporter {
+   public:
+      StatsReporter(const StageMetrics& metrics, double interval, bool print_lines,
+            const std::string& prometheus_path, const std::string& input)
+      : metrics(metrics),
+        interval(interval > 0 ? interval : 5),
+        print_lines(print_lines),
+        prometheus_path(prometheus_path),
+        input(input),
+        stopping(false)
+      {
+         for (int s = 0; s < STAGE_COUNT; s++)
+            previous[s].take(metrics.stage(s));
+         for (int c = 0; c < CNT_COUNT; c++)
+            previous_counters[c] = metrics.counter(c);
+         thread = std::thread(&StatsReporter::loop, this);
+      }
+
+      ~StatsReporter() { stop(); }
+
+      StatsReporter(const StatsReporter&) = delete;
+      StatsReporter& operator=(const StatsReporter&) = delete;
+
+      void stop() {
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+               return;
+            stopping = true;
+         }
+         cv.notify_all();
+         thread.join();
+         exportFile();
+      }
+
+   private:
+      const StageMetrics& metrics;
+      const double interval;
+      const bool print_lines;
+      const std::string prometheus_path;
+      const std::string input;
+
+      std::mutex mutex; // stopping
+      std::condition_variable cv;
+      bool stopping;
+      std::thread thread;
+
+      HistogramSnapshot previous[STAGE_COUNT]; // reporter thread only
+      HistogramSnapshot current;
+      uint64_t previous_counters[CNT_COUNT];
+
+      void exportFile() {
+         if (!prometheus_path.empty() && !metrics.writePrometheus(prometheus_path, input))
+            fprintf(stderr, "[Stats] Failed to write %s\n", prometheus_path.c_str());
+      }
+
+      void printLine(double elapsed) {
+         char line[1024];
+         int len = snprintf(line, sizeof(line), "[Stats] %.1fs | %.1f fps |",
+               elapsed, (metrics.counter(CNT_FRAMES) - previous_counters[CNT_FRAMES]) / interval);
+         for (int c = 0; c < CNT_COUNT && len < static_cast<int>(sizeof(line)); c++) {
+            if (c != CNT_PACKETS)
+               len += snprintf(line + len, sizeof(line) - len, " %s %llu", counterName(c),
+                     static_cast<unsigned long long>(metrics.counter(c)));
+         }
+         for (int s = 0; s < STAGE_COUNT && len < static_cast<int>(sizeof(line)); s++) {
+            current.take(metrics.stage(s));
+            HistogramSnapshot delta = current;
+            delta.subtract(previous[s]);
+            previous[s] = current;
+            if (!delta.count)
+               continue;
+            char p50[16], p99[16];
+            len += snprintf(line + len, sizeof(line) - len, " | %s p50 %s p99 %s", stageName(s),
+                  formatNs(delta.percentile(50), p50, sizeof(p50)), formatNs(delta.percentile(99), p99, sizeof(p99)));
+         }
+         for (int c = 0; c < CNT_COUNT; c++)
+            previous_counters[c] = metrics.counter(c);
+         fprintf(stderr, "%s\n", line);
+      }
+
+      void loop() {
+         const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+         std::unique_lock<std::mutex> lock(mutex);
+         for (;;) {
+            if (cv.wait_for(lock, std::chrono::duration<double>(interval), [this] { return stopping; }))
+               return;
+            lock.unlock();
+            if (print_lines)
+               printLine(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            exportFile();
+            lock.lock();
+         }
+      }
+};
+
+#endif // STAGE_METRICS_H
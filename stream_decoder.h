@@ -0,0 +1,281 @@
+#ifndef STREAM_DECODER_H
+#define STREAM_DECODER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/error.h>
+}
+
+#include "packet_queue.h"
+#include "mem_budget.h"
+#include "corruption_detector.h"
+#include "event_log.h"
+#include "ffseeker_types.h"
+
+/* --streams selection: `all` (every video and audio stream) or a comma
+ * separated list of `v:N` / `a:N`, N counting streams of that type from 0
+ * like ffmpeg's stream specifiers.
+ */
+inline bool parseStreamSelection(const std::string& arg, StreamSelection& selection) {
+   selection = StreamSelection();
+   if (arg == "all") {
+      selection.all = true;
+      return true;
+   }
+   size_t begin = 0;
+   while (begin <= arg.size()) {
+      size_t end = arg.find(',', begin);
+      if (end == std::string::npos)
+         end = arg.size();
+      const std::string item = arg.substr(begin, end - begin);
+      char* tail = nullptr;
+      if (item.size() < 3 || (item[0] != 'v' && item[0] != 'a') || item[1] != ':')
+         return false;
+      long index = strtol(item.c_str() + 2, &tail, 10);
+      if (*tail != '\0' || index < 0)
+         return false;
+      selection.specs.push_back(StreamSpec{item[0], static_cast<int>(index)});
+      begin = end + 1;
+   }
+   return !selection.specs.empty();
+}
+
+/* Absolute stream indexes picked by `selection`, in file order. Throws if a
+ * `v:N` / `a:N` does not exist.
+ */
+inline std::vector<int> selectStreams(const AVFormatContext* ctx, const StreamSelection& selection) {
+   std::vector<bool> picked(ctx->nb_streams, false);
+   int counts[2] = {0, 0}; // video, audio
+   for (unsigned i = 0; i < ctx->nb_streams; i++) {
+      const AVMediaType type = ctx->streams[i]->codecpar->codec_type;
+      if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO)
+         continue;
+      const char letter = type == AVMEDIA_TYPE_VIDEO ? 'v' : 'a';
+      int& nth = counts[letter == 'a'];
+      for (size_t k = 0; k < selection.specs.size(); k++) {
+         if (selection.specs[k].type == letter && selection.specs[k].index == nth)
+            picked[i] = true;
+      }
+      if (selection.all)
+         picked[i] = true;
+      nth++;
+   }
+   for (size_t k = 0; k < selection.specs.size(); k++) {
+      const StreamSpec& spec = selection.specs[k];
+      if (spec.index >= counts[spec.type == 'a'])
+         throw std::runtime_error(std::string("No stream ") + spec.type + ":" + std::to_string(spec.index));
+   }
+   std::vector<int> streams;
+   for (size_t i = 0; i < picked.size(); i++) {
+      if (picked[i])
+         streams.push_back(i);
+   }
+   return streams;
+}
+
+/* Decoder thread for one secondary (non-primary) video or audio stream.
+ *
+ * The demux thread hands packets over a bounded SPSC queue, so a decoder
+ * that falls behind throttles reading instead of growing memory. FLUSH
+ * follows seeks; packets read before the newest seek are skipped the same
+ * way as on the primary stream. Problems go to the event log as
+ * EV_STREAM_ERROR records, everything else is only counted. Always a
+ * software decoder: HW decoders have too few instances to spend on extras.
+ */
+class StreamDecoder {
+   public:
+      StreamDecoder(const AVStream* st, int queue_size, const std::atomic<int>& seek_serial,
+            const std::atomic<bool>& quit, EventLog* log, int detect_stride, const std::string& detect_kernel,
+            MemoryBudget* budget = nullptr)
+      : stream(st),
+        queue(queue_size),
+        free_packets(queue_size),
+        seek_serial(seek_serial),
+        quit(quit),
+        log(log),
+        budget(budget),
+        detector(detect_stride, detect_kernel),
+        dec(nullptr)
+      {
+         const AVCodec* codec = avcodec_find_decoder(st->codecpar->codec_id);
+         if (!codec)
+            throw std::runtime_error("No decoder for stream " + std::to_string(st->index));
+         dec = avcodec_alloc_context3(codec);
+         if (!dec)
+            throw std::runtime_error("Failed to allocate codec context");
+         avcodec_parameters_to_context(dec, st->codecpar);
+         dec->pkt_timebase = st->time_base;
+         dec->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT;
+         dec->err_recognition = AV_EF_CAREFUL | AV_EF_CRCCHECK | AV_EF_BITSTREAM | AV_EF_BUFFER;
+         dec->thread_count = 1; // one core per extra stream is plenty next to the primary decoder
+         if (avcodec_open2(dec, codec, nullptr) < 0) {
+            avcodec_free_context(&dec);
+            throw std::runtime_error("Failed to open decoder for stream " + std::to_string(st->index));
+         }
+         totals.index = st->index;
+         totals.type = st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? 'v' : 'a';
+         totals.codec = codec->name;
+      }
+
+      ~StreamDecoder() {
+         close();
+         if (worker.joinable())
+            worker.join();
+         Item item;
+         while (queue.tryPop(item))
+            freeItem(item);
+         AVPacket* spare;
+         while (free_packets.tryPop(spare))
+            av_packet_free(&spare);
+         avcodec_free_context(&dec);
+      }
+
+      StreamDecoder(const StreamDecoder&) = delete;
+      StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+      void start() { worker = std::thread(&StreamDecoder::decodeLoop, this); }
+
+      void join() {
+         if (worker.joinable())
+            worker.join();
+      }
+
+      // Demux thread: takes the packet's reference. Blocks while the queue is full
+      // or the memory budget is used up.
+      bool push(AVPacket* packet, int serial) {
+         if (budget && !budget->acquire(BUDGET_STREAMS, packetBytes(packet)))
+            return false;
+         AVPacket* queued;
+         if (!free_packets.tryPop(queued))
+            queued = av_packet_alloc();
+         av_packet_move_ref(queued, packet);
+         if (!queue.push(Item{Item::PACKET, queued, serial})) {
+            freeItem(Item{Item::PACKET, queued, serial});
+            return false;
+         }
+         return true;
+      }
+
+      void flush(int serial) { queue.push(Item{Item::FLUSH, nullptr, serial}); }
+      void finish(int serial) { queue.push(Item{Item::END, nullptr, serial}); }
+      void close() { queue.close(); }
+
+      // Valid once the worker has been joined.
+      const StreamStats& stats() const { return totals; }
+
+   private:
+      struct Item {
+         enum Kind {
+            PACKET,
+            FLUSH,
+            END // drain; more may follow after a seek
+         };
+         Kind kind;
+         AVPacket* pkt;
+         int serial;
+      };
+
+      const AVStream* stream;
+      SpscQueue<Item> queue;          // demux -> decoder
+      SpscQueue<AVPacket*> free_packets; // decoder -> demux, emptied shells for reuse
+      const std::atomic<int>& seek_serial;
+      const std::atomic<bool>& quit;
+      EventLog* log;
+      MemoryBudget* budget; // null: not accounted
+      CorruptionDetector detector;
+      AVCodecContext* dec;
+      StreamStats totals; // worker thread
+      std::thread worker;
+
+      void decodeLoop() {
+         AVFrame* frame = av_frame_alloc();
+         Item item;
+         while (queue.pop(item)) {
+            if (item.kind == Item::FLUSH) {
+               avcodec_flush_buffers(dec);
+            } else if (item.kind == Item::END) {
+               if (!quit)
+                  decode(nullptr, frame);
+            } else {
+               // after quit: drain without decoding
+               if (!quit && item.serial == seek_serial) {
+                  totals.packets++;
+                  decode(item.pkt, frame);
+               }
+               if (budget)
+                  budget->release(BUDGET_STREAMS, packetBytes(item.pkt));
+               av_packet_unref(item.pkt);
+               if (!free_packets.tryPush(item.pkt))
+                  av_packet_free(&item.pkt);
+            }
+         }
+         av_frame_free(&frame);
+      }
+
+      void freeItem(Item item) {
+         if (item.pkt && budget)
+            budget->release(BUDGET_STREAMS, packetBytes(item.pkt));
+         av_packet_free(&item.pkt);
+      }
+
+      void decode(const AVPacket* packet, AVFrame* frame) {
+         int ret = avcodec_send_packet(dec, packet);
+         if (ret < 0 && ret != AVERROR_EOF) {
+            totals.decode_errors++;
+            char errbuf[AV_ERROR_MAX_STRING_SIZE];
+            report(packet ? packet->pts : AV_NOPTS_VALUE, 0, 0,
+                  av_make_error_string(errbuf, AV_ERROR_MAX_STRING_SIZE, ret));
+            return;
+         }
+         while (avcodec_receive_frame(dec, frame) == 0) {
+            totals.frames++;
+            totals.samples += frame->nb_samples;
+            const bool corrupt = (frame->flags & AV_FRAME_FLAG_CORRUPT) || frame->decode_error_flags ||
+               (packet && (packet->flags & AV_PKT_FLAG_CORRUPT));
+            if (corrupt) {
+               totals.corrupt_frames++;
+               report(frame->pts, LOGF_CORRUPT, frame->decode_error_flags, "corrupt frame");
+            }
+            if (totals.type == 'v') {
+               DetectorResult detect = detector.analyze(frame);
+               if (detect.corrupt()) {
+                  totals.visual_corruption++;
+                  report(frame->pts, (detect.solid_luma ? LOGF_DETECT_SOLID : 0) |
+                        (detect.flat_chroma ? LOGF_DETECT_FLAT_UV : 0) |
+                        (detect.partial ? LOGF_DETECT_PARTIAL : 0), 0, detect.describe().c_str());
+               }
+            }
+            av_frame_unref(frame);
+         }
+      }
+
+      void report(int64_t pts, uint32_t flags, int error_flags, const char* text) {
+         if (!log)
+            return;
+         LogRecord record;
+         memset(&record, 0, sizeof(record));
+         record.type = EV_STREAM_ERROR;
+         record.stream = static_cast<uint8_t>(std::min(stream->index, 255));
+         record.pict_type = totals.type;
+         record.flags = flags;
+         record.decode_error_flags = error_flags;
+         record.frame_number = totals.frames;
+         record.pts = pts;
+         record.timestamp = pts != AV_NOPTS_VALUE ? pts * av_q2d(stream->time_base) : -1;
+         setRecordText(record, text);
+         log->push(record);
+      }
+};
+
+#endif // STREAM_DECODER_H
@@ -0,0 +1,377 @@
+#ifndef TEMPORAL_DETECTOR_H
+#define TEMPORAL_DETECTOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "corruption_detector.h" // DETECTOR_X86 / DETECTOR_NEON and their intrinsics
+#include "frame_planes.h"
+
+/* Temporal artifact detection across consecutive output frames (--temporal).
+ *
+ * The failures a single-frame check cannot see: a decoder handing out the
+ * same picture again and again (freeze), one frame of garbage between two
+ * normal ones (flash, e.g. a green frame), and a picture whose upper part is
+ * new while the rest is still the previous frame (tear).
+ *
+ * Every frame is reduced to a 1/8 scale luma thumbnail: one source row per
+ * 8-row block, each thumbnail sample the mean of 8 neighbouring samples
+ * (SSE2 psadbw / NEON pairwise adds). A 1080p frame becomes 240x135 bytes,
+ * so everything after that is a few microseconds. The last thumbnails stay
+ * in a small ring, compared by SAD (per row and in total) and by a 32-bin
+ * histogram distance.
+ */
+
+// dst[x] = rounded mean of src[8x .. 8x+7] for x < width
+typedef void (*ThumbRowKernel)(const uint8_t* src, int width, uint8_t* dst);
+// sum of |a[i] - b[i]| for i < n
+typedef uint32_t (*SadRowKernel)(const uint8_t* a, const uint8_t* b, int n);
+
+inline void thumbRowScalar(const uint8_t* src, int width, uint8_t* dst) {
+   for (int x = 0; x < width; x++) {
+      const uint8_t* p = src + 8 * x;
+      dst[x] = static_cast<uint8_t>((p[0] + p[1] + p[2] + p[3] + p[4] + p[5] + p[6] + p[7] + 4) >> 3);
+   }
+}
+
+inline uint32_t sadRowScalar(const uint8_t* a, const uint8_t* b, int n) {
+   uint32_t sum = 0;
+   for (int i = 0; i < n; i++)
+      sum += abs(a[i] - b[i]);
+   return sum;
+}
+
+#ifdef DETECTOR_X86
+inline void thumbRowSSE2(const uint8_t* src, int width, uint8_t* dst) {
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i round = _mm_set1_epi16(4);
+   int x = 0;
+   for (; x + 8 <= width; x += 8) {
+      const uint8_t* p = src + 8 * x;
+      // psadbw against zero: the sum of each 8-byte half, in its low 16 bits
+      __m128i a = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), zero);
+      __m128i b = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), zero);
+      __m128i c = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), zero);
+      __m128i d = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), zero);
+      __m128i sums = _mm_packs_epi32(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)); // 8 x 16 bit, in order
+      sums = _mm_srli_epi16(_mm_add_epi16(sums, round), 3);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(sums, sums));
+   }
+   thumbRowScalar(src + 8 * x, width - x, dst + x);
+}
+
+inline uint32_t sadRowSSE2(const uint8_t* a, const uint8_t* b, int n) {
+   __m128i acc = _mm_setzero_si128();
+   int i = 0;
+   for (; i + 16 <= n; i += 16) {
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+               _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+   }
+   uint32_t sum = static_cast<uint32_t>(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+   return sum + sadRowScalar(a + i, b + i, n - i);
+}
+#endif
+
+#if defined(DETECTOR_NEON) && defined(__aarch64__)
+inline void thumbRowNEON(const uint8_t* src, int width, uint8_t* dst) {
+   int x = 0;
+   for (; x + 8 <= width; x += 8) {
+      const uint8_t* p = src + 8 * x;
+      uint16x8_t s01 = vpaddq_u16(vpaddlq_u8(vld1q_u8(p)), vpaddlq_u8(vld1q_u8(p + 16)));
+      uint16x8_t s23 = vpaddq_u16(vpaddlq_u8(vld1q_u8(p + 32)), vpaddlq_u8(vld1q_u8(p + 48)));
+      vst1_u8(dst + x, vrshrn_n_u16(vpaddq_u16(s01, s23), 3)); // sums of 8, rounded / 8
+   }
+   thumbRowScalar(src + 8 * x, width - x, dst + x);
+}
+
+inline uint32_t sadRowNEON(const uint8_t* a, const uint8_t* b, int n) {
+   uint32x4_t acc = vdupq_n_u32(0);
+   int i = 0;
+   for (; i + 16 <= n; i += 16)
+      acc = vpadalq_u16(acc, vpaddlq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i))));
+   return vaddvq_u32(acc) + sadRowScalar(a + i, b + i, n - i);
+}
+#endif
+
+struct ThumbKernels {
+   ThumbRowKernel thumb_row;
+   SadRowKernel sad_row;
+   const char* name;
+};
+
+// Same names as --detect-kernel; there is no AVX2 variant, the loops are bound by the strided row loads.
+inline ThumbKernels selectThumbKernels(const std::string& name) {
+   ThumbKernels k = {thumbRowScalar, sadRowScalar, "scalar"};
+   if (name == "scalar")
+      return k;
+#ifdef DETECTOR_X86
+   k.thumb_row = thumbRowSSE2;
+   k.sad_row = sadRowSSE2;
+   k.name = "sse2";
+#elif defined(DETECTOR_NEON) && defined(__aarch64__)
+   k.thumb_row = thumbRowNEON;
+   k.sad_row = sadRowNEON;
+   k.name = "neon";
+#endif
+   return k;
+}
+
+struct TemporalResult {
+   bool supported = false;
+   double sad = 0;          // mean absolute thumbnail difference to the previous frame, 0-255
+   double hist_delta = 0;   // luma histogram distance to the previous frame, 0-1 (flash: into the spike)
+   int still_frames = 0;    // consecutive frames identical to their predecessor, this one included
+   bool freeze = false;     // the still run just reached the freeze length after steady motion
+   bool flash = false;      // the PREVIOUS frame (flash_pts) was an isolated spike
+   int64_t flash_pts = 0;
+   bool tear = false;       // moving above / still below tear_row (or the reverse), all moving one frame earlier
+   int tear_row = -1;       // full-resolution row of the seam
+
+   bool corrupt() const { return freeze || flash || tear; }
+
+   std::string describe() const {
+      std::string out;
+      if (freeze)
+         out += "frozen " + std::to_string(still_frames) + " frames";
+      if (flash)
+         out += std::string(out.empty() ? "" : ", ") + "flash before, delta " + std::to_string(hist_delta).substr(0, 4);
+      if (tear)
+         out += std::string(out.empty() ? "" : ", ") + "tear at row " + std::to_string(tear_row);
+      return out;
+   }
+};
+
+/* Decode thread only; reset() after every seek, where a discontinuity is
+ * expected. Thresholds are per thumbnail sample (0-255) or histogram
+ * distance (0-1) and deliberately conservative: a soak run over hours must
+ * not drown in hits on hard cuts, fades or slides.
+ */
+class TemporalDetector {
+   public:
+      explicit TemporalDetector(const std::string& kernel = "auto", int freeze_frames = 5)
+      : kernels(selectThumbKernels(kernel)),
+        freeze_frames(std::max(2, freeze_frames)),
+        width(0),
+        height(0),
+        format(-1),
+        count(0),
+        still_run(0),
+        moving_history(0),
+        freeze_armed(false)
+      {
+      }
+
+      const char* kernelName() const { return kernels.name; }
+
+      void reset() {
+         count = 0;
+         still_run = 0;
+         moving_history = 0;
+         freeze_armed = false;
+      }
+
+      // Supported: anything with an 8 to 16 bit luma (or first) plane, at least 64x64.
+      TemporalResult analyze(const AVFrame* frame) {
+         TemporalResult result;
+         const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+         PlaneSpan planes[4];
+         if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM)) ||
+               desc->comp[0].depth > 16 || framePlanes(frame, planes) < 1 ||
+               frame->width < 64 || frame->height < 64)
+            return result;
+         if (frame->width != width || frame->height != height || frame->format != format)
+            resize(frame->width, frame->height, frame->format);
+         result.supported = true;
+
+         Thumb& cur = ring[count % RING];
+         buildThumb(planes[0], desc, cur);
+         cur.pts = frame->pts;
+         count++;
+         if (count < 2)
+            return result;
+         const Thumb& prev = ring[(count - 2) % RING];
+
+         // SAD per thumbnail row and in total, the previous frame's profile kept for checkTear()
+         row_sad.swap(prev_row_sad);
+         uint64_t total = 0;
+         for (int y = 0; y < thumb_h; y++) {
+            row_sad[y] = kernels.sad_row(&cur.pixels[y * thumb_w], &prev.pixels[y * thumb_w], thumb_w);
+            total += row_sad[y];
+         }
+         result.sad = static_cast<double>(total) / (thumb_w * thumb_h);
+         result.hist_delta = histDelta(prev, cur);
+
+         checkFreeze(total == 0, result);
+         if (count >= 3)
+            checkFlash(ring[(count - 3) % RING], prev, cur, result);
+         if (total && count >= 3)
+            checkTear(result);
+         return result;
+      }
+
+   private:
+      static const int RING = 4;
+      static const int BINS = 32;
+
+      struct Thumb {
+         std::vector<uint8_t> pixels;
+         uint32_t hist[BINS];
+         int64_t pts;
+      };
+
+      ThumbKernels kernels;
+      int freeze_frames;
+      int width;
+      int height;
+      int format;
+      int thumb_w = 0;
+      int thumb_h = 0;
+      uint64_t count;             // thumbnails since reset()
+      Thumb ring[RING];
+      std::vector<uint32_t> row_sad;
+      std::vector<uint32_t> prev_row_sad;
+      std::vector<uint8_t> narrow_row; // packed or >8-bit source row, reduced to 8-bit samples
+      int still_run;
+      uint32_t moving_history;    // bit i: frame i back had real motion
+      bool freeze_armed;          // the still run started after steady motion
+
+      // freeze: identical thumbnails for freeze_frames frames after at least 6 of 8 moving ones
+      static constexpr double MOTION_SAD = 0.5;
+      // flash: both neighbours differ by FLASH_DELTA, they themselves by less than half
+      static constexpr double FLASH_DELTA = 0.4;
+      // tear: moving rows above TEAR_MOVING, still rows at most TEAR_STILL
+      static constexpr double TEAR_MOVING = 2.0;
+      static constexpr double TEAR_STILL = 0.25;
+
+      void resize(int w, int h, int fmt) {
+         width = w;
+         height = h;
+         format = fmt;
+         thumb_w = w / 8;
+         thumb_h = h / 8;
+         for (int i = 0; i < RING; i++)
+            ring[i].pixels.assign(static_cast<size_t>(thumb_w) * thumb_h, 0);
+         row_sad.assign(thumb_h, 0);
+         prev_row_sad.assign(thumb_h, 0);
+         narrow_row.assign(static_cast<size_t>(thumb_w) * 8, 0);
+         reset();
+      }
+
+      void buildThumb(const PlaneSpan& luma, const AVPixFmtDescriptor* desc, Thumb& thumb) {
+         const int step = desc->comp[0].step; // bytes between samples (2 for YUYV, P010, ...)
+         const int offset = desc->comp[0].offset;
+         for (int ty = 0; ty < thumb_h; ty++) {
+            const int y = std::min(ty * 8 + 4, height - 1); // middle row of the block
+            const uint8_t* row = luma.data + static_cast<ptrdiff_t>(y) * luma.linesize + offset;
+            uint8_t* out = &thumb.pixels[ty * thumb_w];
+            if (step == 1 && desc->comp[0].depth <= 8) {
+               kernels.thumb_row(row, thumb_w, out);
+               continue;
+            }
+            // packed or deep luma: pick the top 8 bits of every sample first
+            const int shift = desc->comp[0].shift + std::max(0, desc->comp[0].depth - 8);
+            const bool wide = desc->comp[0].depth > 8;
+            uint8_t* narrow = narrow_row.data();
+            for (int x = 0; x < thumb_w * 8; x++) {
+               const uint8_t* s = row + static_cast<ptrdiff_t>(x) * step;
+               uint16_t v = s[0];
+               if (wide)
+                  memcpy(&v, s, 2);
+               narrow[x] = static_cast<uint8_t>(v >> shift);
+            }
+            kernels.thumb_row(narrow, thumb_w, out);
+         }
+         // histogram of every other thumbnail row
+         memset(thumb.hist, 0, sizeof(thumb.hist));
+         for (int ty = 0; ty < thumb_h; ty += 2) {
+            const uint8_t* p = &thumb.pixels[ty * thumb_w];
+            for (int x = 0; x < thumb_w; x++)
+               thumb.hist[p[x] >> 3]++;
+         }
+      }
+
+      double histDelta(const Thumb& a, const Thumb& b) const {
+         uint32_t diff = 0, total = 0;
+         for (int i = 0; i < BINS; i++) {
+            diff += a.hist[i] > b.hist[i] ? a.hist[i] - b.hist[i] : b.hist[i] - a.hist[i];
+            total += a.hist[i];
+         }
+         return total ? diff / (2.0 * total) : 0;
+      }
+
+      void checkFreeze(bool identical, TemporalResult& result) {
+         if (!identical) {
+            moving_history = (moving_history << 1) | (result.sad >= MOTION_SAD);
+            still_run = 0;
+            freeze_armed = false;
+            return;
+         }
+         if (still_run == 0)
+            freeze_armed = __builtin_popcount(moving_history & 0xff) >= 6;
+         still_run++;
+         result.still_frames = still_run + 1; // the first copy is part of the run
+         result.freeze = freeze_armed && still_run + 1 == freeze_frames;
+      }
+
+      void checkFlash(const Thumb& before, const Thumb& spike, const Thumb& after, TemporalResult& result) {
+         const double into = histDelta(before, spike);
+         const double across = histDelta(before, after);
+         if (into >= FLASH_DELTA && result.hist_delta >= FLASH_DELTA && across < FLASH_DELTA / 2) {
+            result.flash = true;
+            result.flash_pts = spike.pts;
+            result.hist_delta = into;
+         }
+      }
+
+      /* Looks for the row where the per-row SAD profile steps from moving
+       * to still (or back), with nearly every row on the moving side moving
+       * and the still side moving in the previous frame: half a picture that
+       * stopped for exactly one frame. A static lower third or foreground
+       * is still in both frames and never matches.
+       */
+      void checkTear(TemporalResult& result) {
+         const double still_limit = TEAR_STILL * thumb_w;
+         const double moving_limit = TEAR_MOVING * thumb_w;
+         const int margin = std::max(2, thumb_h / 8);
+         // still rows from the top and from the bottom
+         int still_top = 0;
+         while (still_top < thumb_h && row_sad[still_top] <= still_limit)
+            still_top++;
+         int still_bottom = 0;
+         while (still_bottom < thumb_h && row_sad[thumb_h - 1 - still_bottom] <= still_limit)
+            still_bottom++;
+
+         int seam;
+         bool old_below;
+         if (still_bottom >= margin && still_bottom <= thumb_h - margin) {
+            seam = thumb_h - still_bottom; // new picture above, old below
+            old_below = true;
+         } else if (still_top >= margin && still_top <= thumb_h - margin) {
+            seam = still_top;              // old picture above, new below
+            old_below = false;
+         } else {
+            return;
+         }
+         const int moving_from = old_below ? 0 : seam;
+         const int moving_to = old_below ? seam : thumb_h;
+
+         int moving = 0, was_moving = 0;
+         for (int y = 0; y < thumb_h; y++) {
+            if (y >= moving_from && y < moving_to)
+               moving += row_sad[y] >= moving_limit;
+            else
+               was_moving += prev_row_sad[y] >= moving_limit;
+         }
+         const int moving_rows = moving_to - moving_from;
+         if (moving * 10 >= moving_rows * 9 && was_moving * 10 >= (thumb_h - moving_rows) * 9) {
+            result.tear = true;
+            result.tear_row = seam * 8;
+         }
+      }
+};
+
+#endif // TEMPORAL_DETECTOR_H
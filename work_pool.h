@@ -0,0 +1,147 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed-size thread pool with one task deque per worker.
+ *
+ * A worker takes new work from the back of its own deque and, when that is
+ * empty, steals from the front of the others, so a few long files cannot
+ * leave the remaining workers idle behind them. Tasks submitted from a
+ * worker go to that worker's deque; outside submissions are spread round
+ * robin. The deques are only touched on task boundaries (whole files), so a
+ * mutex per deque is plenty.
+ */
+class WorkStealingPool {
+   public:
+      typedef std::function<void()> Task;
+
+      explicit WorkStealingPool(int threads)
+      : next_queue(0),
+        pending(0),
+        stopping(false)
+      {
+         if (threads < 1)
+            threads = 1;
+         for (int i = 0; i < threads; i++)
+            queues.emplace_back(new Queue);
+         for (int i = 0; i < threads; i++)
+            workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+      }
+
+      ~WorkStealingPool() {
+         {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            stopping = true;
+         }
+         idle_cv.notify_all();
+         for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+      }
+
+      WorkStealingPool(const WorkStealingPool&) = delete;
+      WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+      size_t size() const { return workers.size(); }
+
+      void submit(Task task) {
+         const WorkerSlot& self = currentWorker();
+         size_t q = self.pool != this
+            ? next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size()
+            : static_cast<size_t>(self.index);
+         pending.fetch_add(1, std::memory_order_relaxed);
+         {
+            std::lock_guard<std::mutex> lock(queues[q]->mutex);
+            queues[q]->tasks.push_back(std::move(task));
+         }
+         std::lock_guard<std::mutex> lock(idle_mutex);
+         idle_cv.notify_one();
+      }
+
+      // Blocks until every submitted task has finished.
+      void wait() {
+         std::unique_lock<std::mutex> lock(idle_mutex);
+         done_cv.wait(lock, [this] { return pending.load(std::memory_order_acquire) == 0; });
+      }
+
+   private:
+      struct Queue {
+         std::mutex mutex;
+         std::deque<Task> tasks;
+      };
+
+      std::vector<std::unique_ptr<Queue> > queues;
+      std::vector<std::thread> workers;
+      std::atomic<size_t> next_queue;
+      std::atomic<size_t> pending; // submitted but not finished
+
+      std::mutex idle_mutex; // stopping; sleeping workers and wait()
+      std::condition_variable idle_cv;
+      std::condition_variable done_cv;
+      bool stopping;
+
+      struct WorkerSlot {
+         const WorkStealingPool* pool;
+         int index;
+      };
+
+      // pool worker running on this thread, if any
+      static WorkerSlot& currentWorker() {
+         static thread_local WorkerSlot slot = {nullptr, -1};
+         return slot;
+      }
+
+      bool take(size_t self, Task& task) {
+         {
+            Queue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+               task = std::move(own.tasks.back());
+               own.tasks.pop_back();
+               return true;
+            }
+         }
+         for (size_t i = 1; i < queues.size(); i++) {
+            Queue& victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+               task = std::move(victim.tasks.front());
+               victim.tasks.pop_front();
+               return true;
+            }
+         }
+         return false;
+      }
+
+      void workerLoop(int self) {
+         currentWorker().pool = this;
+         currentWorker().index = self;
+         for (;;) {
+            Task task;
+            if (take(self, task)) {
+               task();
+               if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                  std::lock_guard<std::mutex> lock(idle_mutex);
+                  done_cv.notify_all();
+               }
+               continue;
+            }
+            std::unique_lock<std::mutex> lock(idle_mutex);
+            if (stopping)
+               return;
+            // the timeout covers a submit() racing with our empty scan
+            idle_cv.wait_for(lock, std::chrono::milliseconds(10));
+         }
+      }
+};
+
+#endif // WORK_POOL_H